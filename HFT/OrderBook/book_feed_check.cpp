@@ -0,0 +1,451 @@
+#include "market_data_shm.hpp"
+#include "order_flow.hpp"
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+/**
+ * Consistency and stress check for the book's published top of book and depth feed
+ * Runs simulator-style order flow through a book on the matching thread and, after every
+ * order, checks that the top-of-book record and a replica rebuilt from the delta ring agree
+ * with the book's own queries. Depth readers follow the ring concurrently, resynchronising from
+ * snapshots served by the matching thread when they are overrun, and must end on the final
+ * depth. Top-of-book readers hammer the seqlock and check every copy they keep is a whole
+ * record. Market-data clients follow the same book through a shared-memory segment and must
+ * also end on the final depth, the publisher periodically stops forwarding for a stretch of
+ * orders so its cursor is overrun and the Reset snapshot path runs too. Build with
+ * -fsanitize=thread to check for data races, TSan does not model the seqlocks' fences, so
+ * their ordering is what the torn-record checks cover
+ *
+ * Usage: book_feed_check [options]
+ *   --orders N    Orders to process (default 1000000)
+ *   --depth N     Levels per side in the depth feed (default 10)
+ *   --ring N      Depth ring capacity, at least 4 * depth (default 4096), small rings force overruns
+ *   --readers N   Concurrent depth reader threads (default 2)
+ *   --top-readers N  Concurrent top-of-book reader threads (default 2)
+ *   --clients N   Shared-memory market-data clients (default 2), 0 leaves the segment out
+ *   --stall N     Orders the publisher does not forward at the start of every 100000 (default 8192)
+ *   --slots N     Market-data segment capacity (default 65536), small ones overrun the clients
+ *   --seed S      Order flow seed (default 1)
+ */
+
+struct CheckOptions
+{
+    std::uint64_t orders{1000000};
+    std::size_t depth{10};
+    std::size_t ring{4096};
+    unsigned readers{2};
+    unsigned topReaders{2};
+    unsigned clients{2};
+    std::uint64_t stall{8192};
+    std::size_t slots{1 << 16};
+    std::uint64_t seed{1};
+};
+
+constexpr std::uint64_t StallPeriod = 100000;
+constexpr std::chrono::seconds CatchUpTimeout{10};
+
+class CheckFailures
+{
+private:
+    std::atomic<std::uint64_t> count_{0};
+
+public:
+    void expect(bool condition, const char *what)
+    {
+        if (!condition && count_.fetch_add(1, std::memory_order_relaxed) < 10)
+        {
+            std::cerr << "Check failed: " << what << "\n";
+        }
+    }
+
+    std::uint64_t getCount() const { return count_.load(std::memory_order_relaxed); }
+};
+
+static bool sameDepth(const DepthReplica &replica, const DepthSnapshot &snapshot)
+{
+    return replica.getSequence() == snapshot.sequence && replica.getBids() == snapshot.bids && replica.getAsks() == snapshot.asks;
+}
+
+// Snapshot against the book itself: best prices, level quantities and ordering
+static void checkAgainstBook(const OrderBook &book, const DepthSnapshot &snapshot, std::size_t depth, CheckFailures &failures)
+{
+    for (Side side : {Side::Buy, Side::Sell})
+    {
+        const std::vector<DepthLevel> &levels = side == Side::Buy ? snapshot.bids : snapshot.asks;
+        std::optional<Price> best = book.tryGetBestSidePrice(side);
+        failures.expect(levels.size() <= depth, "depth holds more levels than configured");
+        failures.expect(levels.empty() == !best.has_value(), "depth and book disagree on an empty side");
+        if (best && !levels.empty())
+        {
+            failures.expect(levels.front().price == *best, "first depth level is not the best price");
+        }
+        for (std::size_t i = 0; i < levels.size(); ++i)
+        {
+            failures.expect(levels[i].quantity == book.findLevelQuantity(side, levels[i].price), "depth level quantity differs from the book");
+            failures.expect(levels[i].orders > 0, "depth level without orders");
+            if (i > 0)
+            {
+                failures.expect(side == Side::Buy ? levels[i].price < levels[i - 1].price : levels[i].price > levels[i - 1].price,
+                                "depth levels out of order");
+            }
+        }
+    }
+}
+
+// Matching thread: the published record against the book it was taken from
+static void checkTopOfBook(const OrderBook &book, const TopOfBook &top, CheckFailures &failures)
+{
+    std::optional<Price> bid = book.tryGetBestSidePrice(Side::Buy);
+    std::optional<Price> ask = book.tryGetBestSidePrice(Side::Sell);
+    failures.expect(top.hasBid == bid.has_value() && top.hasAsk == ask.has_value(), "top of book disagrees on an empty side");
+    if (top.hasBid && bid)
+    {
+        failures.expect(top.bestBid == *bid && top.bestBidQuantity == book.findLevelQuantity(Side::Buy, *bid), "top of book best bid is stale");
+    }
+    if (top.hasAsk && ask)
+    {
+        failures.expect(top.bestAsk == *ask && top.bestAskQuantity == book.findLevelQuantity(Side::Sell, *ask), "top of book best ask is stale");
+    }
+    failures.expect(top.totalBidQuantity == book.getSideQuantity(Side::Buy) && top.totalAskQuantity == book.getSideQuantity(Side::Sell),
+                    "top of book side totals are stale");
+    failures.expect(top.lastPrice == book.getPrice(), "top of book last price is stale");
+}
+
+struct TopReaderStats
+{
+    std::uint64_t reads{0};
+    std::uint64_t retries{0};
+};
+
+// Reader threads: every copy tryRead keeps must be one whole, self-consistent record
+static void topReader(const TopOfBookPublisher &publisher, const std::atomic<bool> &done, TopReaderStats &stats, CheckFailures &failures)
+{
+    std::uint64_t lastSequence = 0;
+    while (!done.load(std::memory_order_acquire))
+    {
+        TopOfBook top;
+        if (!publisher.tryRead(top))
+        {
+            stats.retries++;
+            continue;
+        }
+        stats.reads++;
+        failures.expect(top.sequence >= lastSequence, "top of book sequence went backwards");
+        lastSequence = top.sequence;
+        if (top.hasBid && top.hasAsk)
+        {
+            failures.expect(top.bestBid < top.bestAsk, "top of book is crossed");
+            failures.expect(top.spread == top.bestAsk - top.bestBid && top.mid == (top.bestBid + top.bestAsk) / 2, "torn top of book record");
+        }
+        if (top.hasBid)
+        {
+            failures.expect(top.bestBidQuantity > 0 && top.totalBidQuantity >= top.bestBidQuantity, "torn top of book bid");
+        }
+        if (top.hasAsk)
+        {
+            failures.expect(top.bestAskQuantity > 0 && top.totalAskQuantity >= top.bestAskQuantity, "torn top of book ask");
+        }
+    }
+}
+
+/**
+ * Snapshot handoff between the matching thread and one reader
+ * The reader raises wanted, the matching thread fills snapshot between two orders
+ */
+struct SnapshotRequest
+{
+    std::atomic<bool> wanted{false};
+    std::mutex mutex;
+    DepthSnapshot snapshot;
+};
+
+struct DepthReaderStats
+{
+    std::uint64_t applied{0};
+    std::uint64_t resyncs{0};
+};
+
+static void depthReader(const DepthDeltaRing &ring, SnapshotRequest &request, const std::atomic<bool> &done,
+                        DepthReaderStats &stats, DepthReplica &replica)
+{
+    DepthCursor cursor(ring);
+    bool synced = false;
+    while (true)
+    {
+        if (!synced)
+        {
+            request.wanted.store(true, std::memory_order_release);
+            while (request.wanted.load(std::memory_order_acquire))
+            {
+                if (done.load(std::memory_order_acquire))
+                    return;
+                std::this_thread::yield();
+            }
+            std::lock_guard<std::mutex> lock(request.mutex);
+            replica.reset(request.snapshot);
+            synced = true;
+            stats.resyncs++;
+        }
+
+        DepthDelta delta;
+        DepthReadStatus status = cursor.next(delta);
+        if (status == DepthReadStatus::Empty)
+        {
+            // Matching has stopped once done is set, an empty ring then means fully caught up
+            if (done.load(std::memory_order_acquire) && cursor.next(delta) == DepthReadStatus::Empty)
+                return;
+            std::this_thread::yield();
+            continue;
+        }
+        if (status == DepthReadStatus::Overrun || (status == DepthReadStatus::Ok && !replica.apply(delta)))
+        {
+            cursor.skipToHead();
+            synced = false;
+            continue;
+        }
+        stats.applied++;
+    }
+}
+
+struct ClientStats
+{
+    std::uint64_t trades{0};
+    std::uint64_t resyncs{0};
+};
+
+/**
+ * Market-data client thread, checks its replica once the matching thread has published the
+ * final depth and it has caught up to it, then reads on until the publisher closes
+ */
+static void marketDataClient(const std::string &name, const std::atomic<bool> &finished, const DepthSnapshot &finalDepth,
+                             std::atomic<bool> &caughtUp, ClientStats &stats, CheckFailures &failures)
+{
+    MarketDataClient client(name);
+    auto onTrade = [&](const MarketTrade &trade)
+    {
+        stats.trades++;
+        failures.expect(trade.quantity > 0 && trade.price > 0 && trade.incomingId != trade.restingId, "torn market-data trade");
+    };
+    while (client.poll(onTrade))
+    {
+        if (!caughtUp.load(std::memory_order_relaxed) && finished.load(std::memory_order_acquire) && client.isSynced() &&
+            client.getDepth().getSequence() == finalDepth.sequence)
+        {
+            failures.expect(sameDepth(client.getDepth(), finalDepth), "market-data client did not end on the final depth");
+            caughtUp.store(true, std::memory_order_release);
+        }
+        std::this_thread::yield();
+    }
+    stats.resyncs = client.getResyncCount();
+}
+
+static int run(const CheckOptions &options)
+{
+    CheckFailures failures;
+    OrderBook book(100.0);
+    book.enableDepth(options.depth, options.ring);
+    const DepthDeltaRing &ring = book.getDepthFeed()->getRing();
+
+    std::atomic<bool> done{false};
+    std::vector<SnapshotRequest> requests(options.readers);
+    std::vector<DepthReaderStats> stats(options.readers);
+    std::vector<DepthReplica> replicas(options.readers);
+    std::vector<std::thread> readers;
+    for (unsigned r = 0; r < options.readers; ++r)
+    {
+        readers.emplace_back(depthReader, std::cref(ring), std::ref(requests[r]), std::cref(done), std::ref(stats[r]), std::ref(replicas[r]));
+    }
+    std::vector<TopReaderStats> topStats(options.topReaders);
+    for (unsigned r = 0; r < options.topReaders; ++r)
+    {
+        readers.emplace_back(topReader, std::cref(book.getTopOfBook()), std::cref(done), std::ref(topStats[r]), std::ref(failures));
+    }
+
+    // Segment named after the process so concurrent runs do not collide
+    std::string segment = "/book_feed_check." + std::to_string(::getpid());
+    std::optional<MarketDataPublisher> publisher;
+    std::optional<DepthCursor> publisherCursor;
+    std::atomic<bool> finished{false};
+    DepthSnapshot finalDepth;
+    std::vector<std::atomic<bool>> caughtUp(options.clients);
+    std::vector<ClientStats> clientStats(options.clients);
+    std::vector<std::thread> clients;
+    if (options.clients > 0)
+    {
+        publisher.emplace(segment, options.slots);
+        publisher->attach(book);
+        publisherCursor.emplace(ring);
+        for (unsigned c = 0; c < options.clients; ++c)
+        {
+            clients.emplace_back(marketDataClient, segment, std::cref(finished), std::cref(finalDepth), std::ref(caughtUp[c]),
+                                 std::ref(clientStats[c]), std::ref(failures));
+        }
+    }
+
+    // The matching thread's own replica, it reads every delta as soon as it is published
+    DepthCursor cursor(ring);
+    DepthReplica mirror;
+    DepthSnapshot snapshot;
+    book.getDepthSnapshot(snapshot);
+    mirror.reset(snapshot);
+
+    OrderFlowModel flow(SimulationParamaters{3, 3, 3}, 100.0, options.seed);
+    for (std::uint64_t i = 0; i < options.orders; ++i)
+    {
+        Order order = flow.next(book.getPrice() > 0 ? book.getPrice() : flow.getReferencePrice());
+        book.processOrder(order);
+        checkTopOfBook(book, book.getTopOfBook().read(), failures);
+        if (publisher && i % StallPeriod >= options.stall)
+        {
+            publisher->forward(book, *publisherCursor);
+        }
+
+        DepthDelta delta;
+        DepthReadStatus status;
+        while ((status = cursor.next(delta)) == DepthReadStatus::Ok)
+        {
+            failures.expect(mirror.apply(delta), "delta does not fit the replica");
+        }
+        failures.expect(status == DepthReadStatus::Empty, "matching thread's cursor was overrun");
+        book.getDepthSnapshot(snapshot);
+        failures.expect(sameDepth(mirror, snapshot), "replica differs from the depth snapshot");
+        checkAgainstBook(book, snapshot, options.depth, failures);
+
+        for (SnapshotRequest &request : requests)
+        {
+            if (request.wanted.load(std::memory_order_acquire))
+            {
+                std::lock_guard<std::mutex> lock(request.mutex);
+                book.getDepthSnapshot(request.snapshot);
+                request.wanted.store(false, std::memory_order_release);
+            }
+        }
+        if (i % 256 == 255)
+        {
+            std::this_thread::yield(); // Lets readers interleave with matching on hosts with few cores
+        }
+    }
+
+    done.store(true, std::memory_order_release);
+    for (std::thread &reader : readers)
+    {
+        reader.join();
+    }
+
+    book.getDepthSnapshot(snapshot);
+    std::uint64_t published = 0;
+    std::uint64_t resets = 0;
+    if (publisher)
+    {
+        // Keep forwarding, which also answers snapshot requests, until every client has the final depth
+        finalDepth = snapshot;
+        finished.store(true, std::memory_order_release);
+        auto deadline = std::chrono::steady_clock::now() + CatchUpTimeout;
+        auto allCaughtUp = [&]()
+        { return std::all_of(caughtUp.begin(), caughtUp.end(), [](const std::atomic<bool> &c) { return c.load(std::memory_order_acquire); }); };
+        while (!allCaughtUp() && std::chrono::steady_clock::now() < deadline)
+        {
+            publisher->forward(book, *publisherCursor);
+            publisher->heartbeat();
+            std::this_thread::yield();
+        }
+        published = publisher->getHead();
+        resets = publisher->getResetCount();
+        publisher.reset(); // Clients see the segment close and stop
+        for (std::thread &client : clients)
+        {
+            client.join();
+        }
+    }
+    std::printf("depth: %llu orders, %llu changes, ring %zu\n", static_cast<unsigned long long>(options.orders),
+                static_cast<unsigned long long>(snapshot.sequence), ring.capacity());
+    for (unsigned r = 0; r < options.readers; ++r)
+    {
+        // A reader that stopped while waiting for a snapshot has nothing to compare
+        if (!requests[r].wanted.load(std::memory_order_acquire))
+        {
+            failures.expect(sameDepth(replicas[r], snapshot), "reader did not end on the final depth");
+        }
+        std::printf("  reader %u: %llu deltas applied, %llu snapshots\n", r, static_cast<unsigned long long>(stats[r].applied),
+                    static_cast<unsigned long long>(stats[r].resyncs));
+    }
+
+    std::printf("top of book: %llu publications\n", static_cast<unsigned long long>(book.getTopOfBook().read().sequence));
+    for (unsigned r = 0; r < options.topReaders; ++r)
+    {
+        std::printf("  reader %u: %llu reads, %llu retries\n", r, static_cast<unsigned long long>(topStats[r].reads),
+                    static_cast<unsigned long long>(topStats[r].retries));
+    }
+
+    if (options.clients > 0)
+    {
+        std::printf("market data: %llu messages, %llu reset snapshots\n", static_cast<unsigned long long>(published),
+                    static_cast<unsigned long long>(resets));
+        for (unsigned c = 0; c < options.clients; ++c)
+        {
+            failures.expect(caughtUp[c].load(std::memory_order_acquire), "market-data client never caught up with the final depth");
+            std::printf("  client %u: %llu trades, %llu resyncs\n", c, static_cast<unsigned long long>(clientStats[c].trades),
+                        static_cast<unsigned long long>(clientStats[c].resyncs));
+        }
+    }
+
+    if (failures.getCount() != 0)
+    {
+        std::printf("FAILED: %llu checks\n", static_cast<unsigned long long>(failures.getCount()));
+        return 1;
+    }
+    std::printf("ok\n");
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    CheckOptions options;
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (i + 1 >= argc)
+            {
+                throw std::invalid_argument("Missing value for " + arg);
+            }
+            std::string value = argv[++i];
+
+            if (arg == "--orders")
+                options.orders = std::stoull(value);
+            else if (arg == "--depth")
+                options.depth = std::stoul(value);
+            else if (arg == "--ring")
+                options.ring = std::stoul(value);
+            else if (arg == "--readers")
+                options.readers = static_cast<unsigned>(std::stoul(value));
+            else if (arg == "--top-readers")
+                options.topReaders = static_cast<unsigned>(std::stoul(value));
+            else if (arg == "--clients")
+                options.clients = static_cast<unsigned>(std::stoul(value));
+            else if (arg == "--stall")
+                options.stall = std::stoull(value);
+            else if (arg == "--slots")
+                options.slots = std::stoul(value);
+            else if (arg == "--seed")
+                options.seed = std::stoull(value);
+            else
+                throw std::invalid_argument("Unknown option " + arg);
+        }
+        if (options.depth == 0 || options.ring < 4 * options.depth)
+            throw std::invalid_argument("--depth must be positive and --ring at least 4 * depth");
+        if (options.slots < 2 * options.depth + 1)
+            throw std::invalid_argument("--slots must hold a whole snapshot, 2 * depth + 1");
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    return run(options);
+}
@@ -0,0 +1,346 @@
+#pragma once
+
+#include "helper.hpp"
+#include <array>
+#include <atomic>
+#include <cstring>
+
+/**
+ * Top-N market-by-price depth with incremental publication
+ * The feed keeps the last published top-N of each side. After every book change the new
+ * top-N is diffed against it and the difference goes out as level deltas, each one an insert,
+ * update or delete at an index, applied in order:
+ *   Insert at i shifts levels i.. down, Delete at i shifts levels i+1.. up
+ * Every delta of one change carries the same sequence and the last one is flagged, after it a
+ * replica holds exactly the book's top-N again. Within a change a replica may briefly hold
+ * more than N levels, an insert above the last level comes before that level's delete
+ *
+ * One change produces at most 4N deltas, every level of both sides deleted and replaced, and
+ * the ring must hold at least that many or a change would overwrite its own deltas.
+ * Deltas go to a fixed ring that overwrites its oldest entries and never waits for readers.
+ * Any number of readers follow it with their own DepthCursor, one that falls a full ring
+ * behind sees an overrun and starts again from snapshot(), which is served by the matching
+ * thread, and the deltas after the snapshot's sequence
+ */
+
+struct DepthLevel
+{
+    Price price;
+    Quantity quantity;
+    std::uint32_t orders;
+
+    bool operator==(const DepthLevel &) const = default;
+};
+
+enum class DepthAction : std::uint8_t
+{
+    Insert,
+    Update,
+    Delete
+};
+
+struct DepthDelta
+{
+    static constexpr std::uint8_t LastInChange = 1;
+
+    std::uint64_t sequence; // Book change the delta belongs to
+    Price price;
+    Quantity quantity; // 0 for a delete
+    std::uint32_t orders;
+    Side side;
+    std::uint16_t index; // 0 is the best level
+    DepthAction action;
+    std::uint8_t flags;
+};
+
+static_assert(std::is_trivially_copyable_v<DepthDelta> && sizeof(DepthDelta) == 32, "Depth deltas are copied as four words");
+
+struct DepthSnapshot
+{
+    std::uint64_t sequence; // Apply deltas with a later sequence on top
+    std::vector<DepthLevel> bids;
+    std::vector<DepthLevel> asks;
+};
+
+enum class DepthReadStatus
+{
+    Ok,
+    Empty,  // Nothing newer yet
+    Overrun // The ring wrapped past the cursor, resynchronise from a snapshot
+};
+
+/**
+ * Overwriting broadcast ring of deltas, one writer, any number of readers
+ * Each slot is a small seqlock whose version also names the ring position it holds
+ */
+class DepthDeltaRing
+{
+private:
+    static constexpr std::size_t Words = sizeof(DepthDelta) / sizeof(std::uint64_t);
+
+    struct alignas(64) Slot
+    {
+        std::atomic<std::uint64_t> version{0}; // 2 * position + 2 once written, odd while being written
+        std::array<std::atomic<std::uint64_t>, Words> words{};
+    };
+
+    std::vector<Slot> slots_;
+    std::size_t mask_;
+    alignas(64) std::atomic<std::uint64_t> head_{0}; // Deltas ever written
+
+public:
+    explicit DepthDeltaRing(std::size_t capacity)
+    {
+        std::size_t rounded = 1;
+        while (rounded < capacity)
+        {
+            rounded <<= 1;
+        }
+        slots_ = std::vector<Slot>(rounded);
+        mask_ = rounded - 1;
+    }
+
+    DepthDeltaRing(const DepthDeltaRing &) = delete;
+    DepthDeltaRing &operator=(const DepthDeltaRing &) = delete;
+
+    std::size_t capacity() const noexcept { return slots_.size(); }
+    std::uint64_t head() const noexcept { return head_.load(std::memory_order_acquire); }
+
+    // Writer only
+    void push(const DepthDelta &delta) noexcept
+    {
+        std::uint64_t position = head_.load(std::memory_order_relaxed);
+        Slot &slot = slots_[position & mask_];
+        std::array<std::uint64_t, Words> raw;
+        std::memcpy(raw.data(), &delta, sizeof(DepthDelta));
+
+        slot.version.store(2 * position + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (std::size_t i = 0; i < Words; ++i)
+        {
+            slot.words[i].store(raw[i], std::memory_order_relaxed);
+        }
+        slot.version.store(2 * position + 2, std::memory_order_release);
+        head_.store(position + 1, std::memory_order_release);
+    }
+
+    // Wait-free, the delta at position if it is still in the ring
+    DepthReadStatus read(std::uint64_t position, DepthDelta &out) const noexcept
+    {
+        const Slot &slot = slots_[position & mask_];
+        std::uint64_t expected = 2 * position + 2;
+        std::uint64_t before = slot.version.load(std::memory_order_acquire);
+        if (before < expected - 1)
+        {
+            return DepthReadStatus::Empty;
+        }
+        if (before != expected)
+        {
+            // Either being overwritten by a later lap or still being written for this one
+            return before == expected - 1 ? DepthReadStatus::Empty : DepthReadStatus::Overrun;
+        }
+
+        std::array<std::uint64_t, Words> raw;
+        for (std::size_t i = 0; i < Words; ++i)
+        {
+            raw[i] = slot.words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.version.load(std::memory_order_relaxed) != before)
+        {
+            return DepthReadStatus::Overrun;
+        }
+        std::memcpy(&out, raw.data(), sizeof(DepthDelta));
+        return DepthReadStatus::Ok;
+    }
+};
+
+/**
+ * One reader's position in the ring
+ */
+class DepthCursor
+{
+private:
+    const DepthDeltaRing *ring_;
+    std::uint64_t next_;
+
+public:
+    // Starts at the newest delta, earlier ones are left to a snapshot
+    explicit DepthCursor(const DepthDeltaRing &ring) : ring_{&ring}, next_{ring.head()} {}
+
+    DepthReadStatus next(DepthDelta &out) noexcept
+    {
+        DepthReadStatus status = ring_->read(next_, out);
+        if (status == DepthReadStatus::Ok)
+        {
+            next_++;
+        }
+        return status;
+    }
+
+    // After an overrun, skip to the newest delta and take a snapshot
+    void skipToHead() noexcept { next_ = ring_->head(); }
+};
+
+/**
+ * Owned by the book, the producer side. Not thread-safe, call it from the matching thread
+ */
+class DepthFeed
+{
+private:
+    std::size_t depth_;
+    std::uint64_t sequence_{0};
+    std::vector<DepthLevel> bids_; // Last published top-N
+    std::vector<DepthLevel> asks_;
+    std::vector<DepthLevel> scratch_;
+    std::vector<DepthDelta> pending_; // Deltas of the change in progress
+    DepthDeltaRing ring_;
+
+    static bool better(Side side, Price a, Price b) { return side == Side::Buy ? a > b : a < b; }
+
+    void delta(Side side, DepthAction action, std::size_t index, const DepthLevel &level)
+    {
+        pending_.push_back(DepthDelta{sequence_ + 1, level.price, action == DepthAction::Delete ? 0 : level.quantity,
+                                      action == DepthAction::Delete ? 0 : level.orders, side, static_cast<std::uint16_t>(index), action, 0});
+    }
+
+    // Ordered merge of two best-first lists, index is the position in the list being edited
+    void diff(Side side, std::vector<DepthLevel> &published, const std::vector<DepthLevel> &current)
+    {
+        std::size_t i = 0, j = 0, index = 0;
+        while (i < published.size() || j < current.size())
+        {
+            if (i < published.size() && j < current.size() && published[i].price == current[j].price)
+            {
+                if (!(published[i] == current[j]))
+                {
+                    delta(side, DepthAction::Update, index, current[j]);
+                }
+                i++, j++, index++;
+            }
+            else if (j < current.size() && (i == published.size() || better(side, current[j].price, published[i].price)))
+            {
+                delta(side, DepthAction::Insert, index, current[j]);
+                j++, index++;
+            }
+            else
+            {
+                delta(side, DepthAction::Delete, index, published[i]);
+                i++;
+            }
+        }
+        published = current;
+    }
+
+public:
+    DepthFeed(std::size_t depth, std::size_t ringCapacity)
+        : depth_{depth}, ring_{ringCapacity}
+    {
+        bids_.reserve(depth_);
+        asks_.reserve(depth_);
+        scratch_.reserve(depth_);
+        pending_.reserve(4 * depth_);
+    }
+
+    std::size_t getDepth() const noexcept { return depth_; }
+    std::uint64_t getSequence() const noexcept { return sequence_; }
+    const DepthDeltaRing &getRing() const noexcept { return ring_; }
+
+    // Diff one side's best levels, any range of PriceLevel in best-first order
+    template <typename Levels>
+    void refresh(Side side, const Levels &levels)
+    {
+        scratch_.clear();
+        for (const PriceLevel &level : levels)
+        {
+            if (scratch_.size() == depth_)
+                break;
+            scratch_.push_back(DepthLevel{level.getPrice(), level.getTotalQuantity(), static_cast<std::uint32_t>(level.getOrders().size())});
+        }
+        diff(side, side == Side::Buy ? bids_ : asks_, scratch_);
+    }
+
+    // Publish the deltas of the change, nothing is published if the top-N did not move
+    void commit() noexcept
+    {
+        if (pending_.empty())
+        {
+            return;
+        }
+        sequence_++;
+        pending_.back().flags |= DepthDelta::LastInChange;
+        for (const DepthDelta &pendingDelta : pending_)
+        {
+            ring_.push(pendingDelta);
+        }
+        pending_.clear();
+    }
+
+    void snapshot(DepthSnapshot &out) const
+    {
+        out.sequence = sequence_;
+        out.bids.assign(bids_.begin(), bids_.end());
+        out.asks.assign(asks_.begin(), asks_.end());
+    }
+};
+
+/**
+ * Consumer-side copy of the depth, rebuilt from a snapshot and the deltas after it
+ */
+class DepthReplica
+{
+private:
+    std::uint64_t sequence_{0};
+    std::vector<DepthLevel> bids_;
+    std::vector<DepthLevel> asks_;
+
+public:
+    void reset(const DepthSnapshot &snapshot)
+    {
+        sequence_ = snapshot.sequence;
+        bids_ = snapshot.bids;
+        asks_ = snapshot.asks;
+    }
+
+    // Returns false if the delta does not fit the replica, which then needs a new snapshot
+    // Changes must arrive back to back, one whose sequence skips ahead means a change was lost
+    bool apply(const DepthDelta &delta)
+    {
+        if (delta.sequence <= sequence_)
+        {
+            return true; // Already in the snapshot
+        }
+        if (delta.sequence != sequence_ + 1)
+        {
+            return false;
+        }
+        std::vector<DepthLevel> &levels = delta.side == Side::Buy ? bids_ : asks_;
+        switch (delta.action)
+        {
+        case DepthAction::Insert:
+            if (delta.index > levels.size())
+                return false;
+            levels.insert(levels.begin() + delta.index, DepthLevel{delta.price, delta.quantity, delta.orders});
+            break;
+        case DepthAction::Update:
+            if (delta.index >= levels.size())
+                return false;
+            levels[delta.index] = DepthLevel{delta.price, delta.quantity, delta.orders};
+            break;
+        case DepthAction::Delete:
+            if (delta.index >= levels.size())
+                return false;
+            levels.erase(levels.begin() + delta.index);
+            break;
+        }
+        if (delta.flags & DepthDelta::LastInChange)
+        {
+            sequence_ = delta.sequence;
+        }
+        return true;
+    }
+
+    std::uint64_t getSequence() const { return sequence_; }
+    const std::vector<DepthLevel> &getBids() const { return bids_; }
+    const std::vector<DepthLevel> &getAsks() const { return asks_; }
+};
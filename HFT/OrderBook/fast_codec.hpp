@@ -0,0 +1,284 @@
+#pragma once
+
+#include "helper.hpp"
+#include <cstdint>
+
+/**
+ * Software FAST codec for order entry messages, same wire rules as the RTL encoder/decoder
+ * Integers are stop-bit encoded 7 bits per byte, most significant group first, with bit 7 set
+ * on the last byte. Signed integers carry their sign in bit 6 of the first byte
+ *
+ * Templates:
+ *   1 NewOrder     PMAP, [TemplateID], MsgSeqNum, SendingTime, ClOrdID, [Side], [OrdType], [Price], [OrderQty]
+ *   2 CancelOrder  PMAP, [TemplateID], MsgSeqNum, SendingTime, ClOrdID, [Side]
+ *   3 ModifyOrder  PMAP, [TemplateID], MsgSeqNum, SendingTime, ClOrdID, [Side], [OrdType], [Price], [OrderQty]
+ * MsgSeqNum, SendingTime and ClOrdID are delta coded. Bracketed fields use the copy operator
+ * and are only sent when the PMAP bit is set, Price is a delta on the previous mantissa with
+ * a constant exponent (the tick size), same as PresenceCalc_Enc.sv
+ * Dictionaries are per stream and reset with reset()
+ */
+
+enum class FastTemplate : std::uint8_t
+{
+    NewOrder = 1,
+    CancelOrder = 2,
+    ModifyOrder = 3
+};
+
+struct FastMessage
+{
+    FastTemplate templateId{FastTemplate::NewOrder};
+    std::uint64_t seqNum{0};
+    std::uint64_t sendingTime{0}; // Nanoseconds
+    OrderId orderId{0};
+    Side side{Side::Buy};
+    OrderType type{OrderType::GoodTillCancel};
+    std::int64_t priceMantissa{0}; // Ticks
+    Quantity qty{0};
+
+    static FastMessage fromOrder(const Order &order, std::uint64_t seqNum, std::uint64_t sendingTime, Price tickSize = 0.01)
+    {
+        FastMessage message;
+        switch (order.getAction())
+        {
+        case Action::Cancel:
+            message.templateId = FastTemplate::CancelOrder;
+            break;
+        case Action::Modify:
+            message.templateId = FastTemplate::ModifyOrder;
+            break;
+        default:
+            message.templateId = FastTemplate::NewOrder;
+            break;
+        }
+        message.seqNum = seqNum;
+        message.sendingTime = sendingTime;
+        message.orderId = order.getId();
+        message.side = order.getSide();
+        message.type = order.getType();
+        message.priceMantissa = order.getType() == OrderType::Market ? 0 : std::llround(order.getPrice() / tickSize);
+        message.qty = order.getRemainingQuantity();
+        return message;
+    }
+
+    Order toOrder(Price tickSize = 0.01) const
+    {
+        Action action = templateId == FastTemplate::CancelOrder   ? Action::Cancel
+                        : templateId == FastTemplate::ModifyOrder ? Action::Modify
+                                                                  : Action::Add;
+        Price price = type == OrderType::Market ? -1 : static_cast<Price>(priceMantissa) * tickSize;
+        return Order(orderId, side, price, qty, type, action, sendingTime);
+    }
+};
+
+namespace fast
+{
+    // PMAP bits, first field in the most significant of the 7 data bits
+    constexpr std::uint8_t PmapTemplate = 0x40;
+    constexpr std::uint8_t PmapSide = 0x20;
+    constexpr std::uint8_t PmapType = 0x10;
+    constexpr std::uint8_t PmapPrice = 0x08;
+    constexpr std::uint8_t PmapQty = 0x04;
+
+    constexpr std::size_t MaxFieldBytes = 10;
+    constexpr std::size_t MaxMessageBytes = 1 + 8 * MaxFieldBytes;
+
+    inline std::uint8_t *encodeUint(std::uint8_t *out, std::uint64_t value)
+    {
+        std::uint8_t groups[MaxFieldBytes];
+        std::size_t n = 0;
+        do
+        {
+            groups[n++] = static_cast<std::uint8_t>(value & 0x7f);
+            value >>= 7;
+        } while (value != 0);
+
+        while (n > 1)
+        {
+            *out++ = groups[--n];
+        }
+        *out++ = groups[0] | 0x80; // Stop bit
+        return out;
+    }
+
+    inline std::uint8_t *encodeInt(std::uint8_t *out, std::int64_t value)
+    {
+        std::uint8_t groups[MaxFieldBytes];
+        std::size_t n = 0;
+        while (true)
+        {
+            groups[n++] = static_cast<std::uint8_t>(value & 0x7f);
+            value >>= 7; // Arithmetic shift keeps the sign
+            bool signBit = groups[n - 1] & 0x40;
+            if ((value == 0 && !signBit) || (value == -1 && signBit))
+                break;
+        }
+
+        while (n > 1)
+        {
+            *out++ = groups[--n];
+        }
+        *out++ = groups[0] | 0x80;
+        return out;
+    }
+
+    // Returns nullptr if the field runs past end or is longer than a 64-bit value allows
+    inline const std::uint8_t *decodeUint(const std::uint8_t *in, const std::uint8_t *end, std::uint64_t &value)
+    {
+        value = 0;
+        for (std::size_t i = 0; i < MaxFieldBytes && in < end; ++i)
+        {
+            std::uint8_t byte = *in++;
+            value = (value << 7) | (byte & 0x7f);
+            if (byte & 0x80)
+                return in;
+        }
+        return nullptr;
+    }
+
+    inline const std::uint8_t *decodeInt(const std::uint8_t *in, const std::uint8_t *end, std::int64_t &value)
+    {
+        if (in >= end)
+            return nullptr;
+        std::uint64_t raw = (*in & 0x40) ? ~std::uint64_t{0} : 0;
+        for (std::size_t i = 0; i < MaxFieldBytes && in < end; ++i)
+        {
+            std::uint8_t byte = *in++;
+            raw = (raw << 7) | (byte & 0x7f);
+            if (byte & 0x80)
+            {
+                value = static_cast<std::int64_t>(raw);
+                return in;
+            }
+        }
+        return nullptr;
+    }
+}
+
+class FastEncoder
+{
+private:
+    FastMessage prev_;
+    bool first_{true};
+
+public:
+    void reset()
+    {
+        prev_ = FastMessage{};
+        first_ = true;
+    }
+
+    // Writes one message at out, which needs fast::MaxMessageBytes of room, returns the new end
+    std::uint8_t *encode(const FastMessage &message, std::uint8_t *out)
+    {
+        bool hasOrderFields = message.templateId != FastTemplate::CancelOrder;
+        bool hasPrice = hasOrderFields && message.type != OrderType::Market;
+
+        std::uint8_t pmap = 0;
+        if (first_ || message.templateId != prev_.templateId)
+            pmap |= fast::PmapTemplate;
+        if (first_ || message.side != prev_.side)
+            pmap |= fast::PmapSide;
+        if (hasOrderFields && (first_ || message.type != prev_.type))
+            pmap |= fast::PmapType;
+        if (hasPrice && (first_ || message.priceMantissa != prev_.priceMantissa))
+            pmap |= fast::PmapPrice;
+        if (hasOrderFields && (first_ || message.qty != prev_.qty))
+            pmap |= fast::PmapQty;
+
+        *out++ = pmap | 0x80;
+        if (pmap & fast::PmapTemplate)
+            out = fast::encodeUint(out, static_cast<std::uint64_t>(message.templateId));
+        out = fast::encodeInt(out, static_cast<std::int64_t>(message.seqNum - prev_.seqNum));
+        out = fast::encodeInt(out, static_cast<std::int64_t>(message.sendingTime - prev_.sendingTime));
+        out = fast::encodeInt(out, static_cast<std::int64_t>(message.orderId - prev_.orderId));
+        if (pmap & fast::PmapSide)
+            out = fast::encodeUint(out, static_cast<std::uint64_t>(message.side));
+        if (pmap & fast::PmapType)
+            out = fast::encodeUint(out, static_cast<std::uint64_t>(message.type));
+        if (pmap & fast::PmapPrice)
+            out = fast::encodeInt(out, message.priceMantissa - prev_.priceMantissa);
+        if (pmap & fast::PmapQty)
+            out = fast::encodeUint(out, message.qty);
+
+        // Copy fields keep their old value when absent
+        FastMessage next = message;
+        if (!hasOrderFields)
+        {
+            next.type = prev_.type;
+            next.qty = prev_.qty;
+        }
+        if (!hasPrice)
+        {
+            next.priceMantissa = prev_.priceMantissa;
+        }
+        prev_ = next;
+        first_ = false;
+        return out;
+    }
+};
+
+class FastDecoder
+{
+private:
+    FastMessage prev_;
+
+public:
+    void reset() { prev_ = FastMessage{}; }
+
+    // Decodes one message starting at in, returns the byte after it or nullptr if malformed
+    const std::uint8_t *decode(const std::uint8_t *in, const std::uint8_t *end, FastMessage &message)
+    {
+        if (in >= end)
+            return nullptr;
+        std::uint8_t pmap = *in++ & 0x7f;
+
+        message = prev_;
+        std::uint64_t uvalue = 0;
+        std::int64_t svalue = 0;
+
+        if (pmap & fast::PmapTemplate)
+        {
+            if (!(in = fast::decodeUint(in, end, uvalue)))
+                return nullptr;
+            message.templateId = static_cast<FastTemplate>(uvalue);
+        }
+        if (!(in = fast::decodeInt(in, end, svalue)))
+            return nullptr;
+        message.seqNum = prev_.seqNum + static_cast<std::uint64_t>(svalue);
+        if (!(in = fast::decodeInt(in, end, svalue)))
+            return nullptr;
+        message.sendingTime = prev_.sendingTime + static_cast<std::uint64_t>(svalue);
+        if (!(in = fast::decodeInt(in, end, svalue)))
+            return nullptr;
+        message.orderId = prev_.orderId + static_cast<std::uint64_t>(svalue);
+
+        if (pmap & fast::PmapSide)
+        {
+            if (!(in = fast::decodeUint(in, end, uvalue)))
+                return nullptr;
+            message.side = static_cast<Side>(uvalue);
+        }
+        if (pmap & fast::PmapType)
+        {
+            if (!(in = fast::decodeUint(in, end, uvalue)))
+                return nullptr;
+            message.type = static_cast<OrderType>(uvalue);
+        }
+        if (pmap & fast::PmapPrice)
+        {
+            if (!(in = fast::decodeInt(in, end, svalue)))
+                return nullptr;
+            message.priceMantissa = prev_.priceMantissa + svalue;
+        }
+        if (pmap & fast::PmapQty)
+        {
+            if (!(in = fast::decodeUint(in, end, uvalue)))
+                return nullptr;
+            message.qty = static_cast<Quantity>(uvalue);
+        }
+
+        prev_ = message;
+        return in;
+    }
+};
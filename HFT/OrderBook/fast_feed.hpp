@@ -0,0 +1,212 @@
+#pragma once
+
+#include "fast_codec.hpp"
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * On-disk format for FAST capture files
+ * A file header is followed by independent blocks. Each block starts a new FAST dictionary,
+ * so blocks can be generated, and replayed, in parallel and in any order. Block headers are
+ * 8-byte aligned so the whole file can be memory-mapped and walked in place
+ *
+ *   FastFeedFileHeader | FastFeedBlockHeader | payload | pad | FastFeedBlockHeader | ...
+ */
+
+struct FastFeedFileHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t templateMask; // Bit n set when template n may appear
+    std::uint64_t blockCount;
+    std::uint64_t messageCount;
+    double tickSize;
+};
+
+struct FastFeedBlockHeader
+{
+    std::uint32_t bytes; // Payload bytes, excluding this header and padding
+    std::uint32_t messages;
+    std::uint64_t firstSeqNum;
+};
+
+constexpr char FastFeedMagic[8] = {'F', 'A', 'S', 'T', 'F', 'E', 'E', 'D'};
+constexpr std::uint32_t FastFeedVersion = 1;
+
+inline std::size_t fastFeedPadded(std::size_t bytes)
+{
+    return (bytes + 7) & ~std::size_t{7};
+}
+
+/**
+ * Encodes messages into one self-contained block, header included
+ */
+class FastFeedBlockBuilder
+{
+private:
+    std::vector<std::uint8_t> buffer_;
+    std::size_t used_{sizeof(FastFeedBlockHeader)};
+    FastFeedBlockHeader header_{};
+    FastEncoder encoder_;
+
+public:
+    explicit FastFeedBlockBuilder(std::size_t reserveBytes = 1 << 20)
+    {
+        buffer_.resize(std::max(reserveBytes, sizeof(FastFeedBlockHeader) + fast::MaxMessageBytes));
+    }
+
+    void reset()
+    {
+        used_ = sizeof(FastFeedBlockHeader);
+        header_ = FastFeedBlockHeader{};
+        encoder_.reset();
+    }
+
+    void add(const FastMessage &message)
+    {
+        if (buffer_.size() - used_ < fast::MaxMessageBytes)
+        {
+            buffer_.resize(buffer_.size() * 2);
+        }
+        if (header_.messages == 0)
+        {
+            header_.firstSeqNum = message.seqNum;
+        }
+        std::uint8_t *end = encoder_.encode(message, buffer_.data() + used_);
+        used_ = static_cast<std::size_t>(end - buffer_.data());
+        header_.messages++;
+    }
+
+    std::uint32_t getMessageCount() const { return header_.messages; }
+
+    // Finalises the header and padding, the returned bytes stay valid until the next add/reset
+    const std::uint8_t *finish(std::size_t &bytes)
+    {
+        header_.bytes = static_cast<std::uint32_t>(used_ - sizeof(FastFeedBlockHeader));
+        std::memcpy(buffer_.data(), &header_, sizeof(header_));
+        bytes = fastFeedPadded(used_);
+        if (bytes > buffer_.size())
+        {
+            buffer_.resize(bytes);
+        }
+        std::memset(buffer_.data() + used_, 0, bytes - used_);
+        return buffer_.data();
+    }
+};
+
+/**
+ * Read-only, memory-mapped view of a FAST capture file
+ */
+class FastFeedReader
+{
+private:
+    int fd_{-1};
+    const std::uint8_t *data_{nullptr};
+    std::size_t size_{0};
+    FastFeedFileHeader header_{};
+    std::vector<const FastFeedBlockHeader *> blocks_;
+
+public:
+    explicit FastFeedReader(const std::string &path)
+    {
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0)
+        {
+            throw std::runtime_error("Cannot open FAST capture: " + path);
+        }
+
+        struct stat info;
+        if (::fstat(fd_, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(FastFeedFileHeader))
+        {
+            ::close(fd_);
+            throw std::runtime_error("FAST capture too small: " + path);
+        }
+        size_ = static_cast<std::size_t>(info.st_size);
+
+        void *mapped = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (mapped == MAP_FAILED)
+        {
+            ::close(fd_);
+            throw std::runtime_error("Cannot map FAST capture: " + path);
+        }
+        data_ = static_cast<const std::uint8_t *>(mapped);
+        ::madvise(mapped, size_, MADV_SEQUENTIAL);
+
+        std::memcpy(&header_, data_, sizeof(header_));
+        if (std::memcmp(header_.magic, FastFeedMagic, sizeof(FastFeedMagic)) != 0 || header_.version != FastFeedVersion)
+        {
+            ::munmap(mapped, size_);
+            ::close(fd_);
+            throw std::runtime_error("Not a FAST capture: " + path);
+        }
+
+        // Index the blocks once so replay can hand them to several threads
+        blocks_.reserve(header_.blockCount);
+        std::size_t offset = fastFeedPadded(sizeof(FastFeedFileHeader));
+        while (offset + sizeof(FastFeedBlockHeader) <= size_)
+        {
+            const auto *block = reinterpret_cast<const FastFeedBlockHeader *>(data_ + offset);
+            std::size_t next = offset + fastFeedPadded(sizeof(FastFeedBlockHeader) + block->bytes);
+            if (next > size_)
+                break;
+            blocks_.push_back(block);
+            offset = next;
+        }
+    }
+
+    ~FastFeedReader()
+    {
+        if (data_)
+        {
+            ::munmap(const_cast<std::uint8_t *>(data_), size_);
+        }
+        if (fd_ >= 0)
+        {
+            ::close(fd_);
+        }
+    }
+
+    FastFeedReader(const FastFeedReader &) = delete;
+    FastFeedReader &operator=(const FastFeedReader &) = delete;
+
+    const FastFeedFileHeader &getHeader() const { return header_; }
+    const std::vector<const FastFeedBlockHeader *> &getBlocks() const { return blocks_; }
+
+    // Decodes every message of one block, returns false if the block is corrupt
+    template <typename Callback>
+    static bool decodeBlock(const FastFeedBlockHeader *block, Callback &&callback)
+    {
+        const auto *in = reinterpret_cast<const std::uint8_t *>(block + 1);
+        const std::uint8_t *end = in + block->bytes;
+        FastDecoder decoder;
+        FastMessage message;
+        for (std::uint32_t i = 0; i < block->messages; ++i)
+        {
+            in = decoder.decode(in, end, message);
+            if (!in)
+                return false;
+            callback(message);
+        }
+        return true;
+    }
+
+    // Replays the whole file in order, returns the number of messages delivered
+    template <typename Callback>
+    std::uint64_t forEach(Callback &&callback) const
+    {
+        std::uint64_t delivered = 0;
+        for (const FastFeedBlockHeader *block : blocks_)
+        {
+            if (!decodeBlock(block, callback))
+            {
+                throw std::runtime_error("Corrupt FAST block");
+            }
+            delivered += block->messages;
+        }
+        return delivered;
+    }
+};
@@ -0,0 +1,435 @@
+#include "fast_feed.hpp"
+#include "order_flow.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <sstream>
+
+/**
+ * Synthetic FAST feed generator
+ * Builds order traffic with the simulator's order model (OrderFlowModel), encodes it with the
+ * software FAST codec and writes a block-structured capture that FastFeedReader can mmap and
+ * replay. Blocks are generated in parallel and written in order by a single writer
+ * SendingTime and the reference price run on across block boundaries, so the feed is one
+ * continuous session. The resting orders that modifies and cancels target do
+ * not: each block starts with no live orders and only touches orders it added itself
+ *
+ * Usage: fast_feed_gen --out FILE [options]
+ *   --size N[K|M|G]       Target file size (default 1G), rounded up to a whole block
+ *   --block-messages N    Messages per block (default 65536)
+ *   --threads N           Generator threads (default: hardware concurrency)
+ *   --seed S              Base seed, the output only depends on the seed and the options
+ *   --mix A,M,C           Relative weights of adds, modifies and cancels (default 50,25,25)
+ *   --templates 1,2,3     Templates allowed in the output (1 new, 2 cancel, 3 modify)
+ *   --rate N              Mean messages per second of feed time (default 1000000)
+ *   --burstiness F        Fraction of messages sent in bursts at 20x the rate (default 0.2)
+ *   --burst-length N      Mean messages per burst (default 1000)
+ *   --price P             Reference price the walk starts at and reverts to (default 100)
+ *   --volume N            SimulationParamaters OrderVolume, 1 - 5 (default 3)
+ *   --volatility N        SimulationParamaters PriceVolatility, 1 - 5 (default 3)
+ *   --verify              Map the finished file and replay it
+ */
+
+struct FeedOptions
+{
+    std::string out;
+    std::uint64_t size{1ull << 30};
+    std::uint32_t blockMessages{65536};
+    unsigned threads{std::max(1u, std::thread::hardware_concurrency())};
+    std::uint64_t seed{1};
+    double addWeight{50};
+    double modifyWeight{25};
+    double cancelWeight{25};
+    std::uint32_t templateMask{(1u << 1) | (1u << 2) | (1u << 3)};
+    double rate{1e6};
+    double burstiness{0.2};
+    double burstLength{1000};
+    Price initialPrice{100.0};
+    SimulationParamaters simParameters{3, 3, 3};
+    bool verify{false};
+};
+
+static std::uint64_t parseSize(const std::string &value)
+{
+    std::size_t used = 0;
+    double number = std::stod(value, &used);
+    std::string suffix = value.substr(used);
+    double scale = 1;
+    if (suffix == "K" || suffix == "k")
+        scale = 1ull << 10;
+    else if (suffix == "M" || suffix == "m")
+        scale = 1ull << 20;
+    else if (suffix == "G" || suffix == "g")
+        scale = 1ull << 30;
+    else if (!suffix.empty())
+        throw std::invalid_argument("Bad size suffix: " + value);
+    return static_cast<std::uint64_t>(number * scale);
+}
+
+static std::vector<double> parseNumbers(const std::string &value)
+{
+    std::vector<double> numbers;
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ','))
+    {
+        numbers.push_back(std::stod(item));
+    }
+    return numbers;
+}
+
+/**
+ * Where the feed clock and reference price stand at a block boundary
+ */
+struct BlockStart
+{
+    double sendingTime{0};
+    Price referencePrice{0};
+};
+
+// Messages over which the reference price forgets its distance from --price, without the pull
+// a feed of a few hundred million messages would wander off by hundreds of ticks per step size
+constexpr double ReversionMessages = 1 << 20;
+
+/**
+ * Feed clock and reference price of one block, drawn from their own engine seeded from the
+ * block index
+ * The reference price steps by the model's volatility and reverts slowly towards --price, an
+ * AR(1) walk whose position after N steps has a closed form, and N exponential gaps at the
+ * mean rate add up to a gamma(N) duration. The block's end is drawn from those first, run()
+ * chains just these two draws from block to block to find where every block starts, a few
+ * draws per block however large the blocks are. The path inside the block is then tied to
+ * both ends: the walk is bridged onto the drawn end price and the gaps of the burst process
+ * are scaled to the drawn duration
+ */
+class BlockPath
+{
+private:
+    std::mt19937_64 generator_;
+    BlockStart start_;
+    BlockStart end_;
+    std::vector<double> sendingTimes_;
+    std::vector<Price> referencePrices_;
+
+public:
+    BlockPath(const FeedOptions &options, std::uint64_t blockIdx, const BlockStart &start)
+        : generator_{options.seed * 0xC2B2AE3D27D4EB4Full + blockIdx}, start_{start}
+    {
+        double steps = options.blockMessages;
+        double meanGapNs = 1e9 / options.rate;
+        double priceSigma = TICK_SIZE * options.simParameters.PriceVolatility;
+        double keep = 1 - 1 / ReversionMessages;
+        double keepAll = std::pow(keep, steps);
+        std::normal_distribution<double> priceMove(0.0, priceSigma * std::sqrt((1 - keepAll * keepAll) / (1 - keep * keep)));
+        std::gamma_distribution<double> duration(steps, meanGapNs);
+        end_.referencePrice = std::max<Price>(options.initialPrice + (start_.referencePrice - options.initialPrice) * keepAll + priceMove(generator_), TICK_SIZE);
+        end_.sendingTime = start_.sendingTime + duration(generator_);
+    }
+
+    const BlockStart &end() const { return end_; }
+
+    // Draws the path inside the block, only generateBlock needs it
+    void walk(const FeedOptions &options)
+    {
+        std::uint32_t steps = options.blockMessages;
+        std::normal_distribution<double> priceStep(0.0, TICK_SIZE * options.simParameters.PriceVolatility);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+        // Two-state arrival process: normal and burst, tuned so the long-run rate matches options.rate
+        double meanGapNs = 1e9 / options.rate;
+        double normalGapNs = meanGapNs / ((1 - options.burstiness) + options.burstiness / 20);
+        double burstGapNs = normalGapNs / 20;
+        double leaveBurst = 1.0 / options.burstLength;
+        double enterBurst = options.burstiness >= 1 ? 1.0 : options.burstiness / ((1 - options.burstiness) * options.burstLength);
+        bool inBurst = uniform(generator_) < options.burstiness;
+
+        sendingTimes_.resize(steps);
+        referencePrices_.resize(steps);
+        double keep = 1 - 1 / ReversionMessages;
+        double elapsed = 0;
+        double price = start_.referencePrice;
+        for (std::uint32_t i = 0; i < steps; ++i)
+        {
+            if (uniform(generator_) < (inBurst ? leaveBurst : enterBurst))
+            {
+                inBurst = !inBurst;
+            }
+            elapsed += -std::log(1.0 - uniform(generator_)) * (inBurst ? burstGapNs : normalGapNs); // Exponential inter-arrival
+            price = options.initialPrice + (price - options.initialPrice) * keep + priceStep(generator_);
+            sendingTimes_[i] = elapsed;
+            referencePrices_[i] = price;
+        }
+
+        // Pin both walks to the block's end, the last message lands exactly on it
+        double timeScale = (end_.sendingTime - start_.sendingTime) / elapsed;
+        double priceGap = end_.referencePrice - price;
+        for (std::uint32_t i = 0; i < steps; ++i)
+        {
+            sendingTimes_[i] = start_.sendingTime + sendingTimes_[i] * timeScale;
+            referencePrices_[i] = std::max<Price>(referencePrices_[i] + priceGap * (i + 1) / steps, TICK_SIZE);
+        }
+    }
+
+    double sendingTime(std::uint32_t i) const { return sendingTimes_[i]; }
+    Price referencePrice(std::uint32_t i) const { return referencePrices_[i]; }
+};
+
+/**
+ * Generates block blockIdx from its start state, so the output does not depend on the thread count
+ * Each block gets its own model seeded from the block index and a disjoint order id range
+ */
+static void generateBlock(const FeedOptions &options, std::uint64_t blockIdx, const BlockStart &start, FastFeedBlockBuilder &builder)
+{
+    OrderFlowModel orderFlow(options.simParameters, start.referencePrice, options.seed * 0x9E3779B97F4A7C15ull + blockIdx);
+    BlockPath path(options, blockIdx, start);
+    path.walk(options);
+    std::uint64_t firstSeq = blockIdx * options.blockMessages + 1;
+    orderFlow.setNextOrderId(firstSeq);
+
+    double totalWeight = options.addWeight + options.modifyWeight + options.cancelWeight;
+    auto enabled = [&](FastTemplate t)
+    { return (options.templateMask >> static_cast<unsigned>(t)) & 1u; };
+
+    builder.reset();
+    for (std::uint32_t i = 0; i < options.blockMessages;)
+    {
+        // The path only moves for messages that are sent, skipped ones price off the same step
+        Price basePrice = path.referencePrice(i);
+        double pick = orderFlow.nextUniform() * totalWeight;
+        Order order = (pick >= options.addWeight && orderFlow.hasLiveOrders())
+                          ? (pick < options.addWeight + options.modifyWeight ? orderFlow.nextModify(basePrice) : orderFlow.nextCancel())
+                          : orderFlow.nextAdd(basePrice);
+
+        FastMessage message = FastMessage::fromOrder(order, firstSeq + i, 0, TICK_SIZE);
+        if (!enabled(message.templateId))
+        {
+            // Still advances the model so modifies/cancels have targets
+            continue;
+        }
+
+        message.sendingTime = static_cast<std::uint64_t>(path.sendingTime(i));
+
+        builder.add(message);
+        ++i;
+    }
+}
+
+static int run(const FeedOptions &options)
+{
+    std::FILE *out = std::fopen(options.out.c_str(), "wb");
+    if (!out)
+    {
+        std::cerr << "Error: cannot open " << options.out << "\n";
+        return 1;
+    }
+    std::vector<char> fileBuffer(8 << 20);
+    std::setvbuf(out, fileBuffer.data(), _IOFBF, fileBuffer.size());
+
+    FastFeedFileHeader header{};
+    std::memcpy(header.magic, FastFeedMagic, sizeof(FastFeedMagic));
+    header.version = FastFeedVersion;
+    header.templateMask = options.templateMask;
+    header.tickSize = TICK_SIZE;
+    std::fwrite(&header, sizeof(header), 1, out);
+    std::uint64_t written = sizeof(header);
+
+    // Finished blocks wait here until the writer reaches their index
+    std::mutex mutex;
+    std::condition_variable blockReady;
+    std::condition_variable slotFree;
+    std::map<std::uint64_t, std::vector<std::uint8_t>> finished;
+    std::atomic<std::uint64_t> nextBlock{0};
+    std::uint64_t nextToWrite = 0;
+    bool stop = false;
+    const std::uint64_t maxInFlight = 2 * options.threads;
+
+    // Start of every block handed out so far, each one is the drawn end of the block before it
+    std::mutex startsMutex;
+    std::vector<BlockStart> starts{BlockStart{0, options.initialPrice}};
+    auto startOf = [&](std::uint64_t blockIdx)
+    {
+        std::lock_guard<std::mutex> lock(startsMutex);
+        while (starts.size() <= blockIdx)
+        {
+            starts.push_back(BlockPath(options, starts.size() - 1, starts.back()).end());
+        }
+        return starts[blockIdx];
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < options.threads; ++t)
+    {
+        workers.emplace_back([&]()
+                             {
+            FastFeedBlockBuilder builder;
+            while (true)
+            {
+                std::uint64_t blockIdx = nextBlock++;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    slotFree.wait(lock, [&]() { return stop || blockIdx < nextToWrite + maxInFlight; });
+                    if (stop)
+                        return;
+                }
+
+                generateBlock(options, blockIdx, startOf(blockIdx), builder);
+                std::size_t bytes = 0;
+                const std::uint8_t *data = builder.finish(bytes);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                finished.emplace(blockIdx, std::vector<std::uint8_t>(data, data + bytes));
+                blockReady.notify_one();
+            } });
+    }
+
+    bool writeFailed = false;
+    while (written < options.size)
+    {
+        std::vector<std::uint8_t> block;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            blockReady.wait(lock, [&]() { return finished.count(nextToWrite) != 0; });
+            auto it = finished.find(nextToWrite);
+            block = std::move(it->second);
+            finished.erase(it);
+            nextToWrite++;
+        }
+        slotFree.notify_all();
+
+        if (std::fwrite(block.data(), 1, block.size(), out) != block.size())
+        {
+            writeFailed = true;
+            break;
+        }
+        written += block.size();
+        header.blockCount++;
+        header.messageCount += options.blockMessages;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    slotFree.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    // Counts are only known now, patch them into the header
+    std::fseek(out, 0, SEEK_SET);
+    std::fwrite(&header, sizeof(header), 1, out);
+    if (std::fclose(out) != 0 || writeFailed)
+    {
+        std::cerr << "Error: write to " << options.out << " failed\n";
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Wrote " << written << " bytes, " << header.messageCount << " messages in " << header.blockCount << " blocks, "
+              << seconds << " s (" << written / seconds / (1 << 20) << " MiB/s)\n";
+
+    if (options.verify)
+    {
+        FastFeedReader reader(options.out);
+        std::uint64_t expectedSeq = 1;
+        bool ordered = true;
+        start = std::chrono::steady_clock::now();
+        std::uint64_t replayed = reader.forEach([&](const FastMessage &message)
+                                                {
+            ordered = ordered && message.seqNum == expectedSeq;
+            expectedSeq++; });
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Replayed " << replayed << " messages in " << seconds << " s (" << replayed / seconds / 1e6
+                  << " M msg/s), sequence " << (ordered ? "ok" : "BROKEN") << "\n";
+        if (!ordered || replayed != header.messageCount)
+            return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    FeedOptions options;
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "--verify")
+            {
+                options.verify = true;
+                continue;
+            }
+            if (i + 1 >= argc)
+            {
+                throw std::invalid_argument("Missing value for " + arg);
+            }
+            std::string value = argv[++i];
+
+            if (arg == "--out")
+                options.out = value;
+            else if (arg == "--size")
+                options.size = parseSize(value);
+            else if (arg == "--block-messages")
+                options.blockMessages = static_cast<std::uint32_t>(std::stoul(value));
+            else if (arg == "--threads")
+                options.threads = std::max(1u, static_cast<unsigned>(std::stoul(value)));
+            else if (arg == "--seed")
+                options.seed = std::stoull(value);
+            else if (arg == "--mix")
+            {
+                std::vector<double> mix = parseNumbers(value);
+                if (mix.size() != 3)
+                    throw std::invalid_argument("--mix takes three weights");
+                options.addWeight = mix[0];
+                options.modifyWeight = mix[1];
+                options.cancelWeight = mix[2];
+            }
+            else if (arg == "--templates")
+            {
+                options.templateMask = 0;
+                for (double t : parseNumbers(value))
+                {
+                    if (t < 1 || t > 3)
+                        throw std::invalid_argument("Unknown template " + value);
+                    options.templateMask |= 1u << static_cast<unsigned>(t);
+                }
+            }
+            else if (arg == "--rate")
+                options.rate = std::stod(value);
+            else if (arg == "--burstiness")
+                options.burstiness = std::clamp(std::stod(value), 0.0, 1.0);
+            else if (arg == "--burst-length")
+                options.burstLength = std::max(1.0, std::stod(value));
+            else if (arg == "--price")
+                options.initialPrice = std::stod(value);
+            else if (arg == "--volume")
+                options.simParameters.OrderVolume = std::stoi(value);
+            else if (arg == "--volatility")
+                options.simParameters.PriceVolatility = std::stoi(value);
+            else
+                throw std::invalid_argument("Unknown option " + arg);
+        }
+
+        if (options.out.empty())
+            throw std::invalid_argument("--out is required");
+        if (options.blockMessages == 0 || options.rate <= 0)
+            throw std::invalid_argument("--block-messages and --rate must be positive");
+        if (options.addWeight <= 0)
+            throw std::invalid_argument("Add weight must be positive, modifies and cancels need resting orders");
+        auto allowed = [&](FastTemplate t)
+        { return (options.templateMask >> static_cast<unsigned>(t)) & 1u; };
+        if (!allowed(FastTemplate::NewOrder) && !(allowed(FastTemplate::ModifyOrder) && options.modifyWeight > 0) &&
+            !(allowed(FastTemplate::CancelOrder) && options.cancelWeight > 0))
+            throw std::invalid_argument("No allowed template has a positive weight in --mix");
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    return run(options);
+}
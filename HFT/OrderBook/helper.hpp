@@ -1,3 +1,5 @@
+#pragma once
+
 #include <iostream>
 #include <fstream>
 #include <map>
@@ -83,6 +85,19 @@ public:
     {
     }
 
+    // Constructor for orders rebuilt from a packed record or capture, keeps the original timestamp
+    Order(OrderId id, Side side, Price price, Quantity quantity, OrderType type, Action action, Timestamp timestamp)
+        : id_{id},
+          side_{side},
+          price_{price},
+          action_{action},
+          initialQuantity_{quantity},
+          remainingQuantity_{quantity},
+          type_{type},
+          timestamp_{timestamp}
+    {
+    }
+
     OrderId getId() const { return id_; }
     Side getSide() const { return side_; }
     Price getPrice() const { return price_; }
@@ -91,6 +106,8 @@ public:
     Quantity getFilledQuantity() const { return initialQuantity_ - remainingQuantity_; }
     bool isFilled() const { return remainingQuantity_ == 0; }
     OrderType getType() const { return type_; }
+    Action getAction() const { return action_; }
+    Timestamp getTimestamp() const { return timestamp_; }
 
     void fillOrder(Quantity qty)
     {
@@ -123,10 +140,10 @@ private:
     OrderId id_;
     Side side_;
     Price price_;
+    Action action_;
     Quantity initialQuantity_;
     Quantity remainingQuantity_;
     OrderType type_;
-    Action action_;
     Timestamp timestamp_;
 };
 
@@ -153,11 +170,26 @@ public:
         totalQuantity_ += order.getRemainingQuantity();
     }
 
+    // Orders that arrive already in priority order, e.g. from a snapshot, go straight to the back
+    void appendOrder(const Order &order)
+    {
+        levelOrders_.emplace_hint(levelOrders_.end(), order.getId(), order);
+        totalQuantity_ += order.getRemainingQuantity();
+    }
+
     void removeOrder(const Order &order)
     {
-        levelOrders_.erase(order.getId());
+        // order may live in this level, read it before the erase
         totalQuantity_ -= order.getRemainingQuantity();
+        levelOrders_.erase(order.getId());
+    }
+
+    // Partial fills leave the order in place but still reduce the level
+    void reduceQuantity(Quantity qty)
+    {
+        totalQuantity_ -= qty;
     }
 
     std::map<OrderId, Order> &getOrders() { return levelOrders_; }
+    const std::map<OrderId, Order> &getOrders() const { return levelOrders_; }
 };
@@ -0,0 +1,184 @@
+#include "hybrid_memory_model.hpp"
+#include "order_flow.hpp"
+#include <atomic>
+#include <sstream>
+
+/**
+ * Design-space explorer for the Hybrid_Memory parameters
+ * Replays one trace (generated from the simulator's order model or read from a packed
+ * capture) through HybridMemoryModel for every combination of L1_capacity, L2_capacity,
+ * price_bits, qty_bits and orderID_bits, one sweep point per worker thread at a time
+ *
+ * Usage: hybrid_memory_explorer [options]
+ *   --orders N          Orders to generate when no capture is given (default 1000000)
+ *   --capture FILE      Replay a packed capture (TraceOrderLayout) instead of generating
+ *   --save-trace FILE   Write the generated trace as a packed capture
+ *   --seed S            Seed for the generated trace
+ *   --l1 A,B,...        L1 capacities to sweep
+ *   --l2 A,B,...        L2 capacities to sweep
+ *   --price-bits A,...  Price widths to sweep
+ *   --qty-bits A,...    Quantity widths to sweep
+ *   --id-bits A,...     Order id widths to sweep
+ *   --cpu-cycles N      Cycles charged per CPU access
+ *   --threads N         Worker threads (default: hardware concurrency)
+ *
+ * Output is one CSV row per sweep point on stdout
+ */
+
+struct SweepPoint
+{
+    HybridMemoryConfig config;
+    HybridMemoryStats stats;
+};
+
+static std::vector<std::size_t> parseList(const std::string &arg)
+{
+    std::vector<std::size_t> values;
+    std::stringstream stream(arg);
+    std::string item;
+    while (std::getline(stream, item, ','))
+    {
+        values.push_back(static_cast<std::size_t>(std::stoull(item)));
+    }
+    if (values.empty())
+    {
+        throw std::invalid_argument("Empty sweep list: " + arg);
+    }
+    return values;
+}
+
+static PackedOrderBatch<TraceOrderLayout> generateTrace(std::size_t count, std::uint64_t seed)
+{
+    SimulationParamaters params{3, 3, 3};
+    OrderFlowModel orderFlow(params, 100.0, seed);
+    PackedOrderBatch<TraceOrderLayout> trace;
+    trace.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        trace.push(orderFlow.next(), TICK_SIZE);
+    }
+    return trace;
+}
+
+int main(int argc, char **argv)
+{
+    std::size_t orders = 1000000;
+    std::uint64_t seed = 1;
+    std::string capture;
+    std::string saveTrace;
+    std::vector<std::size_t> l1Sizes{4, 8, 16, 32};
+    std::vector<std::size_t> l2Sizes{56, 120, 248, 504};
+    std::vector<std::size_t> priceBits{12, 16, 20};
+    std::vector<std::size_t> qtyBits{8, 16};
+    std::vector<std::size_t> idBits{16, 24, 32};
+    unsigned cpuCycles = HybridMemoryConfig{}.cpuAccessCycles;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (i + 1 >= argc)
+            {
+                throw std::invalid_argument("Missing value for " + arg);
+            }
+            std::string value = argv[++i];
+
+            if (arg == "--orders")
+                orders = std::stoull(value);
+            else if (arg == "--capture")
+                capture = value;
+            else if (arg == "--save-trace")
+                saveTrace = value;
+            else if (arg == "--seed")
+                seed = std::stoull(value);
+            else if (arg == "--l1")
+                l1Sizes = parseList(value);
+            else if (arg == "--l2")
+                l2Sizes = parseList(value);
+            else if (arg == "--price-bits")
+                priceBits = parseList(value);
+            else if (arg == "--qty-bits")
+                qtyBits = parseList(value);
+            else if (arg == "--id-bits")
+                idBits = parseList(value);
+            else if (arg == "--cpu-cycles")
+                cpuCycles = static_cast<unsigned>(std::stoul(value));
+            else if (arg == "--threads")
+                threads = std::max(1u, static_cast<unsigned>(std::stoul(value)));
+            else
+                throw std::invalid_argument("Unknown option " + arg);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    PackedOrderBatch<TraceOrderLayout> trace;
+    try
+    {
+        trace = capture.empty() ? generateTrace(orders, seed) : readPackedCapture<TraceOrderLayout>(capture);
+        if (!saveTrace.empty())
+        {
+            writePackedCapture(saveTrace, trace);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    // Every combination shares the same trace
+    std::vector<SweepPoint> points;
+    for (std::size_t l1 : l1Sizes)
+        for (std::size_t l2 : l2Sizes)
+            for (std::size_t price : priceBits)
+                for (std::size_t qty : qtyBits)
+                    for (std::size_t id : idBits)
+                    {
+                        SweepPoint point;
+                        point.config.l1Capacity = l1;
+                        point.config.l2Capacity = l2;
+                        point.config.priceBits = static_cast<unsigned>(price);
+                        point.config.qtyBits = static_cast<unsigned>(qty);
+                        point.config.orderIdBits = static_cast<unsigned>(id);
+                        point.config.cpuAccessCycles = cpuCycles;
+                        point.config.tickSize = TICK_SIZE;
+                        points.push_back(point);
+                    }
+
+    std::atomic<std::size_t> nextPoint{0};
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < std::min<std::size_t>(threads, points.size()); ++t)
+    {
+        workers.emplace_back([&]()
+                             {
+            for (std::size_t idx = nextPoint++; idx < points.size(); idx = nextPoint++)
+            {
+                HybridMemoryModel model(points[idx].config);
+                model.run(trace);
+                points[idx].stats = model.getStats();
+            } });
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    std::cout << "l1_capacity,l2_capacity,price_bits,qty_bits,orderID_bits,orders,top_hit_rate,spill_rate,cpu_spills,cpu_refills,"
+                 "price_overflows,qty_overflows,orderID_overflows,cycles,cycles_per_order\n";
+    for (const SweepPoint &point : points)
+    {
+        const HybridMemoryConfig &c = point.config;
+        const HybridMemoryStats &s = point.stats;
+        std::cout << c.l1Capacity << "," << c.l2Capacity << "," << c.priceBits << "," << c.qtyBits << "," << c.orderIdBits << ","
+                  << s.orders << "," << s.topHitRate() << "," << s.spillRate() << "," << s.cpuSpills << "," << s.cpuRefills << ","
+                  << s.priceOverflows << "," << s.qtyOverflows << "," << s.orderIdOverflows << ","
+                  << s.cycles << "," << s.cyclesPerOrder() << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,306 @@
+#include "hybrid_memory_model.hpp"
+
+HybridMemoryModel::HybridMemoryModel(const HybridMemoryConfig &config)
+    : config_{config}
+{
+    index_.reserve(1 << 16);
+}
+
+void HybridMemoryModel::reset()
+{
+    stats_ = HybridMemoryStats{};
+    bids_.clear();
+    asks_.clear();
+    bidCount_ = 0;
+    askCount_ = 0;
+    index_.clear();
+}
+
+HybridMemoryModel::Tier HybridMemoryModel::tierOf(std::size_t rank) const
+{
+    if (rank < config_.l1Capacity)
+        return Tier::L1;
+    if (rank < config_.l1Capacity + config_.l2Capacity)
+        return Tier::L2;
+    return Tier::CPU;
+}
+
+// Orders resting at better prices than key, only counted as far as the end of L2
+std::size_t HybridMemoryModel::ordersAhead(const SideBook &book, std::uint64_t key) const
+{
+    std::size_t limit = config_.l1Capacity + config_.l2Capacity;
+    std::size_t rank = 0;
+    for (auto it = book.begin(); it != book.end() && it->first < key; ++it)
+    {
+        rank += it->second.size();
+        if (rank >= limit)
+            return limit;
+    }
+    return rank;
+}
+
+void HybridMemoryModel::checkWidths(OrderId id, std::uint64_t priceTicks, Quantity qty, Timestamp timestamp)
+{
+    if (priceTicks > RtlOrderLayout::maxValue(config_.priceBits))
+        stats_.priceOverflows++;
+    if (qty > RtlOrderLayout::maxValue(config_.qtyBits))
+        stats_.qtyOverflows++;
+    if (id > RtlOrderLayout::maxValue(config_.orderIdBits))
+        stats_.orderIdOverflows++;
+    if (timestamp > RtlOrderLayout::maxValue(config_.timestampBits))
+        stats_.timestampOverflows++;
+}
+
+// Cost of inserting at a rank, including the cascade of evictions down the hierarchy
+void HybridMemoryModel::chargeInsert(std::size_t rank, std::size_t countBefore)
+{
+    std::size_t l1 = config_.l1Capacity;
+    std::size_t l2 = config_.l1Capacity + config_.l2Capacity;
+
+    switch (tierOf(rank))
+    {
+    case Tier::L1:
+        stats_.l1Accesses++;
+        stats_.cycles += config_.l1OpCycles;
+        if (countBefore >= l1)
+        {
+            // Tail of L1 goes through the holding buffer into L2
+            stats_.l1Evictions++;
+            stats_.cycles += config_.l2OpCycles;
+        }
+        break;
+    case Tier::L2:
+        stats_.l2Accesses++;
+        stats_.cycles += config_.l2OpCycles;
+        break;
+    case Tier::CPU:
+        stats_.cpuAccesses++;
+        stats_.cpuSpills++;
+        stats_.cycles += config_.cpuAccessCycles;
+        return;
+    }
+
+    if (countBefore >= l2)
+    {
+        stats_.cpuSpills++;
+        stats_.cycles += config_.cpuAccessCycles;
+    }
+}
+
+// Cost of removing at a rank, including the refills that pull orders back up
+void HybridMemoryModel::chargeRemove(std::size_t rank, std::size_t countBefore)
+{
+    std::size_t l1 = config_.l1Capacity;
+    std::size_t l2 = config_.l1Capacity + config_.l2Capacity;
+
+    switch (tierOf(rank))
+    {
+    case Tier::L1:
+        stats_.l1Accesses++;
+        stats_.cycles += config_.l1OpCycles;
+        if (countBefore > l1)
+        {
+            stats_.l2Refills++;
+            stats_.cycles += config_.l2OpCycles;
+        }
+        break;
+    case Tier::L2:
+        stats_.l2Accesses++;
+        stats_.cycles += config_.l2OpCycles;
+        break;
+    case Tier::CPU:
+        stats_.cpuAccesses++;
+        stats_.cycles += config_.cpuAccessCycles;
+        return;
+    }
+
+    if (countBefore > l2)
+    {
+        stats_.cpuRefills++;
+        stats_.cycles += config_.cpuAccessCycles;
+    }
+}
+
+bool HybridMemoryModel::crosses(Side side, OrderType type, std::uint64_t priceTicks) const
+{
+    if (side == Side::Buy)
+    {
+        if (asks_.empty())
+            return false;
+        return type == OrderType::Market || priceTicks >= asks_.begin()->first;
+    }
+    else
+    {
+        if (bids_.empty())
+            return false;
+        return type == OrderType::Market || priceTicks <= ~bids_.begin()->first;
+    }
+}
+
+bool HybridMemoryModel::canFillFully(Side side, OrderType type, std::uint64_t priceTicks, Quantity qty) const
+{
+    const SideBook &opposite = side == Side::Buy ? asks_ : bids_;
+    Side oppositeSide = side == Side::Buy ? Side::Sell : Side::Buy;
+    std::uint64_t limitKey = toKey(oppositeSide, priceTicks);
+    Quantity available = 0;
+
+    for (const auto &level : opposite)
+    {
+        if (type != OrderType::Market && level.first > limitKey)
+            break;
+        for (const Resting &resting : level.second)
+        {
+            available += resting.qty;
+            if (available >= qty)
+                return true;
+        }
+    }
+    return false;
+}
+
+// Matching engine handles one incoming order against one resting order per pass
+Quantity HybridMemoryModel::match(Side side, OrderType type, std::uint64_t priceTicks, Quantity qty)
+{
+    Side oppositeSide = side == Side::Buy ? Side::Sell : Side::Buy;
+    SideBook &opposite = getBook(oppositeSide);
+    std::size_t &oppositeCount = getCount(oppositeSide);
+    std::uint64_t passCycles = config_.engineLoadCycles + config_.engineMatchCycles + config_.engineDrainCycles;
+    bool passed = false;
+
+    while (qty > 0 && crosses(side, type, priceTicks))
+    {
+        passed = true;
+        stats_.enginePasses++;
+        stats_.cycles += passCycles;
+
+        auto levelIt = opposite.begin();
+        Resting &resting = levelIt->second.front();
+        Quantity matchQty = std::min(qty, resting.qty);
+        qty -= matchQty;
+        resting.qty -= matchQty;
+
+        if (resting.qty == 0)
+        {
+            index_.erase(resting.id);
+            levelIt->second.pop_front();
+            if (levelIt->second.empty())
+            {
+                opposite.erase(levelIt);
+            }
+            chargeRemove(0, oppositeCount);
+            oppositeCount--;
+            stats_.fills++;
+        }
+        else
+        {
+            // Partial fill is written back in place at the top of L1
+            stats_.l1Accesses++;
+            stats_.cycles += config_.l1OpCycles;
+        }
+    }
+
+    // Orders that never cross still take one trip through the engine
+    if (!passed)
+    {
+        stats_.enginePasses++;
+        stats_.cycles += passCycles;
+    }
+    return qty;
+}
+
+void HybridMemoryModel::add(OrderId id, Side side, OrderType type, std::uint64_t priceTicks, Quantity qty)
+{
+    if (type == OrderType::FillOrKill && !canFillFully(side, type, priceTicks, qty))
+    {
+        stats_.enginePasses++;
+        stats_.cycles += config_.engineLoadCycles + config_.engineMatchCycles + config_.engineDrainCycles;
+        return;
+    }
+
+    Quantity remaining = match(side, type, priceTicks, qty);
+    if (remaining == 0 || (type != OrderType::GoodTillCancel && type != OrderType::GoodForDay))
+        return;
+
+    // Ids are only unique per live order, a reused id replaces the old entry
+    remove(id);
+
+    SideBook &book = getBook(side);
+    std::size_t &count = getCount(side);
+    std::uint64_t key = toKey(side, priceTicks);
+    Level &level = book[key];
+
+    chargeInsert(ordersAhead(book, key) + level.size(), count);
+    level.push_back(Resting{id, remaining});
+    count++;
+    index_[id] = Location{side, key, std::prev(level.end())};
+}
+
+bool HybridMemoryModel::remove(OrderId id)
+{
+    auto indexIt = index_.find(id);
+    if (indexIt == index_.end())
+        return false;
+
+    Location location = indexIt->second;
+    index_.erase(indexIt);
+
+    SideBook &book = getBook(location.side);
+    std::size_t &count = getCount(location.side);
+    auto levelIt = book.find(location.key);
+    Level &level = levelIt->second;
+
+    // Walk into the level only while the order could still be inside L1/L2
+    std::size_t limit = config_.l1Capacity + config_.l2Capacity;
+    std::size_t rank = ordersAhead(book, location.key);
+    for (auto it = level.begin(); rank < limit && it != location.resting; ++it)
+    {
+        rank++;
+    }
+
+    chargeRemove(rank, count);
+    level.erase(location.resting);
+    if (level.empty())
+    {
+        book.erase(levelIt);
+    }
+    count--;
+    return true;
+}
+
+void HybridMemoryModel::process(OrderId id, Side side, OrderType type, Action action, std::uint64_t priceTicks, Quantity qty, Timestamp timestamp)
+{
+    stats_.orders++;
+    checkWidths(id, priceTicks, qty, timestamp);
+
+    switch (action)
+    {
+    case Action::Cancel:
+    case Action::Modify:
+        if (action == Action::Cancel)
+            stats_.cancels++;
+        else
+            stats_.modifies++;
+
+        if (!remove(id))
+        {
+            // Miss in every tier, the CPU still has to be asked
+            stats_.cpuAccesses++;
+            stats_.cycles += config_.cpuAccessCycles;
+        }
+        else if (action == Action::Modify)
+        {
+            add(id, side, type, priceTicks, qty);
+        }
+        break;
+    default:
+        stats_.adds++;
+        add(id, side, type, priceTicks, qty);
+        break;
+    }
+}
+
+void HybridMemoryModel::process(const Order &order)
+{
+    std::uint64_t priceTicks = order.getType() == OrderType::Market ? 0 : PackedOrder<RtlOrderLayout>::toTicks(order.getPrice(), config_.tickSize);
+    process(order.getId(), order.getSide(), order.getType(), order.getAction(), priceTicks, order.getRemainingQuantity(), order.getTimestamp());
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "packed_order.hpp"
+
+/**
+ * Cycle-approximate software model of the Hybrid_Memory matching engine
+ * Each side of the book is one price-time ordered list of resting orders. The first
+ * L1_capacity entries live in L1, the next L2_capacity in L2 and the rest spill to the CPU.
+ * Every operation is charged the FSM states it would walk through in L1.sv, L2.sv and
+ * Matching_Engine.sv, so cycles per order and spill rates can be estimated on real traffic
+ * without an RTL simulation
+ */
+
+struct HybridMemoryConfig
+{
+    std::size_t l1Capacity = 8;
+    std::size_t l2Capacity = 120;
+    unsigned timestampBits = 32;
+    unsigned orderIdBits = 16;
+    unsigned priceBits = 16;
+    unsigned qtyBits = 16;
+
+    // Cycle costs, see the state machines in the RTL
+    unsigned engineLoadCycles = 4;  // LOAD1 - LOAD4
+    unsigned engineMatchCycles = 1; // MATCH, one stage per incoming order
+    unsigned engineDrainCycles = 3; // MATCH_DONE, SEND1, SEND2
+    unsigned l1OpCycles = 1;        // CANCEL / REMOVE / ADD
+    unsigned l2OpCycles = 1;        // SERVICE_L1 / CANCEL / ADD
+    unsigned cpuAccessCycles = 100; // Round trip to the CPU side of the book
+
+    Price tickSize = 0.01;
+};
+
+struct HybridMemoryStats
+{
+    std::uint64_t orders{0};
+    std::uint64_t adds{0};
+    std::uint64_t cancels{0};
+    std::uint64_t modifies{0};
+    std::uint64_t enginePasses{0}; // Trips through the matching engine FSM
+    std::uint64_t fills{0};        // Resting orders fully consumed by matching
+
+    std::uint64_t l1Accesses{0};
+    std::uint64_t l2Accesses{0};
+    std::uint64_t cpuAccesses{0};
+    std::uint64_t l1Evictions{0}; // L1 -> L2
+    std::uint64_t l2Refills{0};   // L2 -> L1
+    std::uint64_t cpuSpills{0};   // L2 (or new order) -> CPU
+    std::uint64_t cpuRefills{0};  // CPU -> L2
+
+    std::uint64_t priceOverflows{0};
+    std::uint64_t qtyOverflows{0};
+    std::uint64_t orderIdOverflows{0};
+    std::uint64_t timestampOverflows{0};
+
+    std::uint64_t cycles{0};
+
+    double cyclesPerOrder() const { return orders ? static_cast<double>(cycles) / orders : 0.0; }
+    double spillRate() const { return orders ? static_cast<double>(cpuSpills) / orders : 0.0; }
+
+    // Fraction of book accesses served directly from L1
+    double topHitRate() const
+    {
+        std::uint64_t accesses = l1Accesses + l2Accesses + cpuAccesses;
+        return accesses ? static_cast<double>(l1Accesses) / accesses : 0.0;
+    }
+
+    std::uint64_t overflows() const { return priceOverflows + qtyOverflows + orderIdOverflows + timestampOverflows; }
+};
+
+class HybridMemoryModel
+{
+private:
+    enum class Tier
+    {
+        L1,
+        L2,
+        CPU
+    };
+
+    struct Resting
+    {
+        OrderId id;
+        Quantity qty;
+    };
+
+    // Both sides are keyed so that begin() is the best price: asks by ticks, bids by ~ticks
+    using Level = std::list<Resting>;
+    using SideBook = std::map<std::uint64_t, Level>;
+
+    struct Location
+    {
+        Side side;
+        std::uint64_t key;
+        Level::iterator resting;
+    };
+
+    HybridMemoryConfig config_;
+    HybridMemoryStats stats_;
+    SideBook bids_;
+    SideBook asks_;
+    std::size_t bidCount_{0};
+    std::size_t askCount_{0};
+    std::unordered_map<OrderId, Location> index_;
+
+    SideBook &getBook(Side side) { return side == Side::Buy ? bids_ : asks_; }
+    std::size_t &getCount(Side side) { return side == Side::Buy ? bidCount_ : askCount_; }
+    static std::uint64_t toKey(Side side, std::uint64_t ticks) { return side == Side::Buy ? ~ticks : ticks; }
+
+    Tier tierOf(std::size_t rank) const;
+    std::size_t ordersAhead(const SideBook &book, std::uint64_t key) const;
+    void checkWidths(OrderId id, std::uint64_t priceTicks, Quantity qty, Timestamp timestamp);
+
+    void chargeInsert(std::size_t rank, std::size_t countBefore);
+    void chargeRemove(std::size_t rank, std::size_t countBefore);
+
+    bool crosses(Side side, OrderType type, std::uint64_t priceTicks) const;
+    bool canFillFully(Side side, OrderType type, std::uint64_t priceTicks, Quantity qty) const;
+    Quantity match(Side side, OrderType type, std::uint64_t priceTicks, Quantity qty);
+    void add(OrderId id, Side side, OrderType type, std::uint64_t priceTicks, Quantity qty);
+    bool remove(OrderId id);
+
+public:
+    explicit HybridMemoryModel(const HybridMemoryConfig &config = HybridMemoryConfig{});
+
+    void process(OrderId id, Side side, OrderType type, Action action, std::uint64_t priceTicks, Quantity qty, Timestamp timestamp);
+    void process(const Order &order);
+
+    template <typename Layout>
+    void run(const PackedOrderBatch<Layout> &batch)
+    {
+        const auto &ids = batch.getIds();
+        const auto &prices = batch.getPrices();
+        const auto &quantities = batch.getQuantities();
+        const auto &timestamps = batch.getTimestamps();
+        for (std::size_t i = 0; i < batch.size(); ++i)
+        {
+            process(ids[i], batch.getSide(i), batch.getType(i), batch.getAction(i), prices[i], quantities[i], timestamps[i]);
+        }
+    }
+
+    void reset();
+    const HybridMemoryStats &getStats() const { return stats_; }
+    const HybridMemoryConfig &getConfig() const { return config_; }
+    std::size_t getRestingOrders(Side side) const { return side == Side::Buy ? bidCount_ : askCount_; }
+};
@@ -0,0 +1,661 @@
+#pragma once
+
+#include "orderbook.hpp"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Market-data fan-out to local processes through POSIX shared memory
+ * One publisher owns a named segment holding a broadcast ring of fixed 64-byte slots, every
+ * consumer process maps it read-only and follows the ring with a cursor of its own, so the
+ * publisher never sees, or waits for, its readers. Slots are seqlocks whose version names the
+ * ring position they hold, a reader that falls a full ring behind gets an overrun instead of
+ * a stale or torn message
+ *
+ * Messages are depth deltas (see depth_feed.hpp), trades, and depth snapshots. A consumer that
+ * attaches late or overruns asks for a snapshot through the one counter readers write, the
+ * publisher answers it in-band with a SnapshotBegin followed by one Insert per level. Consumers
+ * that are already in sync skip those levels. When the publisher itself loses deltas, because
+ * its cursor on the book's ring was overrun, the snapshot it sends is flagged Reset and every
+ * consumer has to load it
+ *
+ *   page 0    MarketDataShmHeader, read-only to readers
+ *   page 1    MarketDataShmRequests, the only page readers map writable
+ *   page 2..  slot 0 | slot 1 | ... | slot capacity - 1
+ *
+ * The header names the publisher's pid and carries its heartbeat, so readers can tell a
+ * publisher that died from one that is quiet, and a new publisher only takes over a name
+ * whose previous owner has closed or died
+ */
+
+enum class MarketDataType : std::uint8_t
+{
+    Depth,        // depth holds a level delta
+    Trade,        // trade holds one execution
+    SnapshotBegin // snapshot, the depth at that change follows as Depth inserts, bids then asks
+};
+
+struct MarketSnapshotBegin
+{
+    static constexpr std::uint32_t Reset = 1; // Deltas before it were lost, every consumer must load it
+
+    std::uint64_t sequence;
+    std::uint32_t bidLevels;
+    std::uint32_t askLevels;
+    std::uint32_t flags;
+};
+
+struct MarketTrade
+{
+    OrderId incomingId;
+    OrderId restingId;
+    Price price;
+    Quantity quantity;
+    Side aggressorSide;
+};
+
+struct MarketDataMessage
+{
+    MarketDataType type;
+    std::uint8_t pad[7];
+    union
+    {
+        DepthDelta depth;
+        MarketTrade trade;
+        MarketSnapshotBegin snapshot;
+    };
+};
+
+static_assert(std::is_trivially_copyable_v<MarketDataMessage> && sizeof(MarketDataMessage) == 40, "Messages fill five words of a slot");
+
+struct alignas(64) MarketDataSlot
+{
+    std::atomic<std::uint64_t> version; // 2 * position + 2 once written, odd while being written
+    std::atomic<std::uint64_t> words[sizeof(MarketDataMessage) / sizeof(std::uint64_t)];
+};
+
+struct alignas(64) MarketDataShmHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t slotBytes;
+    std::uint64_t capacity;                      // Slots, a power of two
+    std::uint64_t pageBytes;                     // Requests and slots start this far apart, see marketDataShmBytes
+    std::int64_t publisherPid;
+    std::atomic<std::uint32_t> state;            // MarketDataShmState
+    alignas(64) std::atomic<std::uint64_t> head; // Messages ever published
+    std::atomic<std::uint64_t> heartbeat;        // Publisher's steady_clock, in nanoseconds
+};
+
+struct MarketDataShmRequests
+{
+    std::atomic<std::uint64_t> snapshotRequests; // The only field readers write
+};
+
+static_assert(sizeof(MarketDataShmHeader) <= 4096, "The header must fit the smallest page");
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free && std::atomic<std::uint32_t>::is_always_lock_free,
+              "Shared-memory atomics must be lock-free to work across processes");
+
+enum class MarketDataShmState : std::uint32_t
+{
+    Initialising,
+    Live,
+    Closed // The publisher has gone, nothing more will arrive
+};
+
+constexpr char MarketDataShmMagic[8] = {'M', 'D', 'R', 'I', 'N', 'G', '0', '3'};
+constexpr std::uint32_t MarketDataShmVersion = 3;
+// The publisher beats at least this often while forward() is being called, or when asked to
+constexpr std::chrono::milliseconds MarketDataHeartbeatInterval{100};
+
+inline std::size_t marketDataShmBytes(std::uint64_t capacity, std::size_t pageBytes)
+{
+    return 2 * pageBytes + capacity * sizeof(MarketDataSlot);
+}
+
+inline std::uint64_t marketDataClock()
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                          std::chrono::steady_clock::now().time_since_epoch())
+                                          .count());
+}
+
+inline bool marketDataProcessAlive(std::int64_t pid)
+{
+    return pid > 0 && (::kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM);
+}
+
+/**
+ * Producer side, creates the segment and owns it until destroyed
+ */
+class MarketDataPublisher
+{
+private:
+    std::string name_;
+    MarketDataShmHeader *header_{nullptr};
+    MarketDataShmRequests *requests_{nullptr};
+    MarketDataSlot *slots_{nullptr};
+    std::size_t size_{0};
+    std::uint64_t mask_{0};
+    std::uint64_t head_{0};
+    std::uint64_t snapshotsServed_{0};
+    std::uint64_t resets_{0};
+    std::uint64_t nextBeat_{0};
+    std::uint32_t forwardCalls_{0};
+
+    // True if name holds a market-data segment whose publisher closed it or died, and it was removed
+    static bool removeAbandoned(const std::string &name)
+    {
+        int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+        {
+            return errno == ENOENT; // Gone in the meantime
+        }
+        struct stat info;
+        bool abandoned = false;
+        if (::fstat(fd, &info) == 0 && static_cast<std::size_t>(info.st_size) >= sizeof(MarketDataShmHeader))
+        {
+            void *mapped = ::mmap(nullptr, sizeof(MarketDataShmHeader), PROT_READ, MAP_SHARED, fd, 0);
+            if (mapped != MAP_FAILED)
+            {
+                const auto *header = static_cast<const MarketDataShmHeader *>(mapped);
+                abandoned = std::memcmp(header->magic, MarketDataShmMagic, sizeof(MarketDataShmMagic)) == 0 &&
+                            (header->state.load(std::memory_order_acquire) == static_cast<std::uint32_t>(MarketDataShmState::Closed) ||
+                             !marketDataProcessAlive(header->publisherPid));
+                ::munmap(mapped, sizeof(MarketDataShmHeader));
+            }
+        }
+        ::close(fd);
+        return abandoned && ::shm_unlink(name.c_str()) == 0;
+    }
+
+public:
+    // name follows shm_open, e.g. "/orderbook.md". Throws if another live publisher holds it
+    MarketDataPublisher(const std::string &name, std::size_t capacity)
+        : name_{name}
+    {
+        std::uint64_t rounded = 1;
+        while (rounded < capacity)
+        {
+            rounded <<= 1;
+        }
+        mask_ = rounded - 1;
+        std::size_t pageBytes = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        size_ = marketDataShmBytes(rounded, pageBytes);
+
+        int fd = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0 && errno == EEXIST && removeAbandoned(name_))
+        {
+            fd = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        }
+        if (fd < 0)
+        {
+            throw std::runtime_error(errno == EEXIST ? "Market-data segment already has a live publisher: " + name_
+                                                     : "Cannot create market-data segment: " + name_);
+        }
+        if (::ftruncate(fd, static_cast<off_t>(size_)) != 0)
+        {
+            ::close(fd);
+            ::shm_unlink(name_.c_str());
+            throw std::runtime_error("Cannot size market-data segment: " + name_);
+        }
+        void *mapped = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+        {
+            ::shm_unlink(name_.c_str());
+            throw std::runtime_error("Cannot map market-data segment: " + name_);
+        }
+
+        // The segment starts zeroed, which is every atomic at 0 and every slot unwritten
+        header_ = static_cast<MarketDataShmHeader *>(mapped);
+        requests_ = reinterpret_cast<MarketDataShmRequests *>(static_cast<std::uint8_t *>(mapped) + pageBytes);
+        slots_ = reinterpret_cast<MarketDataSlot *>(static_cast<std::uint8_t *>(mapped) + 2 * pageBytes);
+        std::memcpy(header_->magic, MarketDataShmMagic, sizeof(MarketDataShmMagic));
+        header_->version = MarketDataShmVersion;
+        header_->slotBytes = sizeof(MarketDataSlot);
+        header_->capacity = rounded;
+        header_->pageBytes = pageBytes;
+        header_->publisherPid = ::getpid();
+        heartbeat();
+        header_->state.store(static_cast<std::uint32_t>(MarketDataShmState::Live), std::memory_order_release);
+    }
+
+    ~MarketDataPublisher()
+    {
+        header_->state.store(static_cast<std::uint32_t>(MarketDataShmState::Closed), std::memory_order_release);
+        ::munmap(header_, size_);
+        ::shm_unlink(name_.c_str()); // Attached readers keep their mapping until they detach
+    }
+
+    MarketDataPublisher(const MarketDataPublisher &) = delete;
+    MarketDataPublisher &operator=(const MarketDataPublisher &) = delete;
+
+    void publish(const MarketDataMessage &message) noexcept
+    {
+        constexpr std::size_t Words = sizeof(MarketDataMessage) / sizeof(std::uint64_t);
+        std::uint64_t raw[Words];
+        std::memcpy(raw, &message, sizeof(MarketDataMessage));
+
+        MarketDataSlot &slot = slots_[head_ & mask_];
+        slot.version.store(2 * head_ + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (std::size_t i = 0; i < Words; ++i)
+        {
+            slot.words[i].store(raw[i], std::memory_order_relaxed);
+        }
+        slot.version.store(2 * head_ + 2, std::memory_order_release);
+        head_++;
+        header_->head.store(head_, std::memory_order_release);
+    }
+
+    void publishDepth(const DepthDelta &delta) noexcept
+    {
+        MarketDataMessage message{};
+        message.type = MarketDataType::Depth;
+        message.depth = delta;
+        publish(message);
+    }
+
+    // Called by the book for every fill once attached, see OrderBook::setMarketData
+    void publishTrade(const Order &incoming, const Order &resting, Quantity quantity, Price price) noexcept
+    {
+        MarketDataMessage message{};
+        message.type = MarketDataType::Trade;
+        message.trade = MarketTrade{incoming.getId(), resting.getId(), price, quantity, incoming.getSide()};
+        publish(message);
+    }
+
+    // reset tells consumers that are in sync to load it too, the deltas before it are incomplete
+    void publishSnapshot(const DepthSnapshot &snapshot, bool reset = false) noexcept
+    {
+        MarketDataMessage message{};
+        message.type = MarketDataType::SnapshotBegin;
+        message.snapshot = MarketSnapshotBegin{snapshot.sequence, static_cast<std::uint32_t>(snapshot.bids.size()),
+                                               static_cast<std::uint32_t>(snapshot.asks.size()), reset ? MarketSnapshotBegin::Reset : 0};
+        publish(message);
+
+        auto publishLevels = [&](Side side, const std::vector<DepthLevel> &levels)
+        {
+            for (std::size_t i = 0; i < levels.size(); ++i)
+            {
+                publishDepth(DepthDelta{snapshot.sequence, levels[i].price, levels[i].quantity, levels[i].orders, side,
+                                        static_cast<std::uint16_t>(i), DepthAction::Insert, 0});
+            }
+        };
+        publishLevels(Side::Buy, snapshot.bids);
+        publishLevels(Side::Sell, snapshot.asks);
+    }
+
+    // Tells readers the publisher is alive, call it from an idle loop when forward() is not running
+    void heartbeat() noexcept
+    {
+        std::uint64_t now = marketDataClock();
+        header_->heartbeat.store(now, std::memory_order_release);
+        nextBeat_ = now + std::chrono::duration_cast<std::chrono::nanoseconds>(MarketDataHeartbeatInterval).count() / 2;
+    }
+
+    // True once per reader request made since the last call, answer with publishSnapshot
+    bool snapshotRequested() noexcept
+    {
+        std::uint64_t requests = requests_->snapshotRequests.load(std::memory_order_acquire);
+        if (requests == snapshotsServed_)
+        {
+            return false;
+        }
+        snapshotsServed_ = requests;
+        return true;
+    }
+
+    /**
+     * Forward the book's new depth deltas and answer snapshot requests, call it from the
+     * matching thread after processOrder. Returns the deltas forwarded
+     * If the in-process ring overran the cursor, consumers get a Reset snapshot instead
+     */
+    std::size_t forward(const OrderBook &book, DepthCursor &cursor)
+    {
+        std::size_t forwarded = 0;
+        bool requested = snapshotRequested();
+        bool reset = false;
+        if ((++forwardCalls_ & 255) == 0 && marketDataClock() >= nextBeat_)
+        {
+            heartbeat(); // Reading the clock every call would cost more than the forward itself
+        }
+        DepthDelta delta;
+        DepthReadStatus status;
+        while ((status = cursor.next(delta)) == DepthReadStatus::Ok)
+        {
+            publishDepth(delta);
+            forwarded++;
+        }
+        if (status == DepthReadStatus::Overrun)
+        {
+            cursor.skipToHead();
+            reset = true;
+            resets_++;
+        }
+
+        DepthSnapshot snapshot;
+        if ((requested || reset) && book.getDepthSnapshot(snapshot))
+        {
+            publishSnapshot(snapshot, reset);
+        }
+        return forwarded;
+    }
+
+    // Publish every fill the book makes from now on
+    void attach(OrderBook &book) noexcept { book.setMarketData(this); }
+
+    std::uint64_t getHead() const noexcept { return head_; }
+    // Times the cursor on the book's ring was overrun and consumers were sent a Reset snapshot
+    std::uint64_t getResetCount() const noexcept { return resets_; }
+};
+
+enum class MarketDataReadStatus
+{
+    Ok,
+    Empty,   // Nothing newer yet
+    Overrun, // The ring wrapped past the cursor, anything peeked must be discarded
+    Closed   // The publisher closed or died and everything it published has been read
+};
+
+/**
+ * Consumer side, attaches read-only to a publisher's segment
+ * Messages can be copied out with read, or used in place with peek and then confirmed with
+ * advance, which fails if the slot was overwritten while it was being used
+ */
+class MarketDataReader
+{
+private:
+    // Empty polls between liveness checks, the heartbeat is only read this often
+    static constexpr std::uint32_t LivenessPolls = 4096;
+
+    const MarketDataShmHeader *header_{nullptr};
+    MarketDataShmRequests *requests_{nullptr}; // The one page this reader maps writable
+    const MarketDataSlot *slots_{nullptr};
+    std::size_t size_{0};
+    std::size_t pageBytes_{0};
+    std::uint64_t mask_{0};
+    std::uint64_t next_{0};
+    std::uint64_t peekedVersion_{0};
+    std::uint64_t staleAfter_;
+    std::uint32_t emptyPolls_{0};
+    bool publisherGone_{false};
+
+    // Closed or died: a stale heartbeat is confirmed against the publisher's pid
+    bool publisherGone() noexcept
+    {
+        if (!publisherGone_)
+        {
+            bool closed = header_->state.load(std::memory_order_acquire) == static_cast<std::uint32_t>(MarketDataShmState::Closed);
+            publisherGone_ = closed || (getHeartbeatAge() > staleAfter_ && !marketDataProcessAlive(header_->publisherPid));
+        }
+        return publisherGone_;
+    }
+
+    MarketDataReadStatus check(const MarketDataSlot &slot, std::uint64_t &version) noexcept
+    {
+        std::uint64_t expected = 2 * next_ + 2;
+        version = slot.version.load(std::memory_order_acquire);
+        if (version == expected)
+        {
+            return MarketDataReadStatus::Ok;
+        }
+        if (version > expected)
+        {
+            return MarketDataReadStatus::Overrun;
+        }
+        if (++emptyPolls_ < LivenessPolls && !publisherGone_)
+        {
+            return MarketDataReadStatus::Empty;
+        }
+        emptyPolls_ = 0;
+        return publisherGone() && header_->head.load(std::memory_order_acquire) <= next_ ? MarketDataReadStatus::Closed : MarketDataReadStatus::Empty;
+    }
+
+public:
+    // Starts at the newest message, use requestSnapshot for the depth before it
+    // A publisher whose heartbeat is older than staleAfter and whose pid is gone counts as closed
+    explicit MarketDataReader(const std::string &name, std::chrono::milliseconds staleAfter = 10 * MarketDataHeartbeatInterval)
+        : staleAfter_{static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(staleAfter).count())}
+    {
+        int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0)
+        {
+            throw std::runtime_error("No market-data segment: " + name);
+        }
+        pageBytes_ = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        struct stat info;
+        if (::fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < 2 * pageBytes_)
+        {
+            ::close(fd);
+            throw std::runtime_error("Market-data segment not ready: " + name);
+        }
+        size_ = static_cast<std::size_t>(info.st_size);
+
+        void *mapped = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            ::close(fd);
+            throw std::runtime_error("Cannot map market-data segment: " + name);
+        }
+        header_ = static_cast<const MarketDataShmHeader *>(mapped);
+        if (header_->state.load(std::memory_order_acquire) == static_cast<std::uint32_t>(MarketDataShmState::Initialising) ||
+            std::memcmp(header_->magic, MarketDataShmMagic, sizeof(MarketDataShmMagic)) != 0 || header_->version != MarketDataShmVersion ||
+            header_->slotBytes != sizeof(MarketDataSlot) || header_->pageBytes != pageBytes_ ||
+            size_ < marketDataShmBytes(header_->capacity, pageBytes_))
+        {
+            ::munmap(mapped, size_);
+            ::close(fd);
+            throw std::runtime_error("Not a market-data segment: " + name);
+        }
+
+        // Only the requests page is writable, the header and every slot stay read-only
+        void *requests = ::mmap(nullptr, pageBytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, static_cast<off_t>(pageBytes_));
+        ::close(fd);
+        if (requests == MAP_FAILED)
+        {
+            ::munmap(mapped, size_);
+            throw std::runtime_error("Cannot map market-data requests: " + name);
+        }
+        requests_ = static_cast<MarketDataShmRequests *>(requests);
+        slots_ = reinterpret_cast<const MarketDataSlot *>(static_cast<const std::uint8_t *>(mapped) + 2 * pageBytes_);
+        mask_ = header_->capacity - 1;
+        next_ = header_->head.load(std::memory_order_acquire);
+    }
+
+    ~MarketDataReader()
+    {
+        ::munmap(const_cast<MarketDataShmHeader *>(header_), size_);
+        ::munmap(requests_, pageBytes_);
+    }
+
+    MarketDataReader(const MarketDataReader &) = delete;
+    MarketDataReader &operator=(const MarketDataReader &) = delete;
+
+    // Zero-copy, the message stays in the ring and is only valid if advance() then succeeds
+    MarketDataReadStatus peek(const MarketDataMessage *&message) noexcept
+    {
+        const MarketDataSlot &slot = slots_[next_ & mask_];
+        MarketDataReadStatus status = check(slot, peekedVersion_);
+        message = status == MarketDataReadStatus::Ok ? reinterpret_cast<const MarketDataMessage *>(slot.words) : nullptr;
+        return status;
+    }
+
+    // Confirms the peeked message was not overwritten while in use and moves past it
+    MarketDataReadStatus advance() noexcept
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slots_[next_ & mask_].version.load(std::memory_order_relaxed) != peekedVersion_)
+        {
+            return MarketDataReadStatus::Overrun;
+        }
+        next_++;
+        return MarketDataReadStatus::Ok;
+    }
+
+    // Copies the next message out
+    MarketDataReadStatus read(MarketDataMessage &out) noexcept
+    {
+        const MarketDataSlot &slot = slots_[next_ & mask_];
+        std::uint64_t version;
+        MarketDataReadStatus status = check(slot, version);
+        if (status != MarketDataReadStatus::Ok)
+        {
+            return status;
+        }
+        std::uint64_t raw[sizeof(MarketDataMessage) / sizeof(std::uint64_t)];
+        for (std::size_t i = 0; i < std::size(raw); ++i)
+        {
+            raw[i] = slot.words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.version.load(std::memory_order_relaxed) != version)
+        {
+            return MarketDataReadStatus::Overrun;
+        }
+        std::memcpy(&out, raw, sizeof(MarketDataMessage));
+        next_++;
+        return MarketDataReadStatus::Ok;
+    }
+
+    // After an overrun, skip to the newest message and ask for a snapshot
+    void skipToHead() noexcept { next_ = header_->head.load(std::memory_order_acquire); }
+
+    void requestSnapshot() noexcept { requests_->snapshotRequests.fetch_add(1, std::memory_order_release); }
+
+    // Messages published but not read yet, how far behind this reader is
+    std::uint64_t getLag() const noexcept { return header_->head.load(std::memory_order_acquire) - next_; }
+
+    // Nanoseconds since the publisher last beat, it beats while forwarding or when asked to
+    std::uint64_t getHeartbeatAge() const noexcept
+    {
+        std::uint64_t beat = header_->heartbeat.load(std::memory_order_acquire);
+        std::uint64_t now = marketDataClock();
+        return now > beat ? now - beat : 0;
+    }
+
+    std::int64_t getPublisherPid() const noexcept { return header_->publisherPid; }
+};
+
+/**
+ * Client library: keeps a depth replica current and hands trades to the caller
+ * Resynchronises by itself, after attaching, an overrun or a lost change it requests a
+ * snapshot and ignores depth deltas until one arrives. A Reset snapshot is always loaded
+ */
+class MarketDataClient
+{
+private:
+    MarketDataReader reader_;
+    DepthReplica replica_;
+    DepthSnapshot pending_; // Snapshot being received
+    std::size_t pendingLevels_{0};
+    std::size_t skipLevels_{0}; // Levels of a snapshot this client did not need
+    bool synced_{false};
+    bool receiving_{false};
+    std::uint64_t resyncs_{0};
+
+    void resync() noexcept
+    {
+        reader_.skipToHead();
+        reader_.requestSnapshot();
+        synced_ = false;
+        receiving_ = false;
+        skipLevels_ = 0;
+        resyncs_++;
+    }
+
+    void finishSnapshot()
+    {
+        if (receiving_ && pendingLevels_ == 0)
+        {
+            replica_.reset(pending_);
+            receiving_ = false;
+            synced_ = true;
+        }
+    }
+
+public:
+    explicit MarketDataClient(const std::string &name, std::chrono::milliseconds staleAfter = 10 * MarketDataHeartbeatInterval)
+        : reader_{name, staleAfter}
+    {
+        resync();
+        resyncs_ = 0;
+    }
+
+    /**
+     * Handle every message available now, onTrade(const MarketTrade &) is called in place
+     * Returns false once the publisher has closed or died and everything has been read
+     */
+    template <typename TradeHandler>
+    bool poll(TradeHandler &&onTrade)
+    {
+        while (true)
+        {
+            MarketDataMessage message;
+            MarketDataReadStatus status = reader_.read(message);
+            if (status == MarketDataReadStatus::Empty)
+                return true;
+            if (status == MarketDataReadStatus::Closed)
+                return false;
+            if (status == MarketDataReadStatus::Overrun)
+            {
+                resync();
+                continue;
+            }
+
+            switch (message.type)
+            {
+            case MarketDataType::Trade:
+                onTrade(message.trade);
+                break;
+            case MarketDataType::SnapshotBegin:
+                if (!synced_ || (message.snapshot.flags & MarketSnapshotBegin::Reset))
+                {
+                    pending_.sequence = message.snapshot.sequence;
+                    pending_.bids.clear();
+                    pending_.asks.clear();
+                    pendingLevels_ = message.snapshot.bidLevels + message.snapshot.askLevels;
+                    synced_ = false;
+                    receiving_ = true;
+                    finishSnapshot();
+                }
+                else
+                {
+                    skipLevels_ = message.snapshot.bidLevels + message.snapshot.askLevels;
+                }
+                break;
+            case MarketDataType::Depth:
+                if (receiving_)
+                {
+                    const DepthDelta &level = message.depth;
+                    (level.side == Side::Buy ? pending_.bids : pending_.asks).push_back(DepthLevel{level.price, level.quantity, level.orders});
+                    pendingLevels_--;
+                    finishSnapshot();
+                }
+                else if (skipLevels_ > 0)
+                {
+                    skipLevels_--; // Another consumer's snapshot, the replica already has it
+                }
+                else if (synced_ && !replica_.apply(message.depth))
+                {
+                    resync();
+                }
+                break;
+            }
+        }
+    }
+
+    bool isSynced() const noexcept { return synced_; }
+    std::uint64_t getResyncCount() const noexcept { return resyncs_; }
+    const DepthReplica &getDepth() const noexcept { return replica_; }
+    MarketDataReader &getReader() noexcept { return reader_; }
+};
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "helper.hpp"
+
+#define TICK_SIZE 0.01
+
+struct SimulationParamaters{  // Ranges 1 - 5
+    int OrderFrequency;
+    int OrderVolume;
+    int PriceVolatility;
+};
+
+/**
+ * Order generation model shared by the MarketSimulator and the offline tools
+ * Prices are normally distributed around a base price, quantities are uniform and scaled
+ * down by price, and modifies/cancels are drawn from the orders this model has added
+ * Every draw comes from one seeded engine so traces are reproducible
+ */
+class OrderFlowModel
+{
+private:
+    static constexpr std::size_t MaxLiveOrders = 4096;
+
+    SimulationParamaters simParameters_;
+    std::mt19937_64 generator_;
+    OrderId nextId_{1};
+    Price referencePrice_;
+    std::vector<Order> liveOrders_; // Recently added resting orders, targets for modify/cancel
+
+    void trackLive(const Order &order)
+    {
+        if (liveOrders_.size() < MaxLiveOrders)
+        {
+            liveOrders_.push_back(order);
+        }
+        else
+        {
+            liveOrders_[generator_() % MaxLiveOrders] = order;
+        }
+    }
+
+public:
+    OrderFlowModel(SimulationParamaters simParameters, Price initialPrice, std::uint64_t seed)
+        : simParameters_{simParameters}, generator_{seed}, referencePrice_{initialPrice}
+    {
+        liveOrders_.reserve(MaxLiveOrders);
+    }
+
+    Price nextPrice(Price basePrice)
+    {
+        std::normal_distribution<double> distribution(0.0, TICK_SIZE * simParameters_.PriceVolatility);
+        double priceFluctuation = distribution(generator_);
+        return static_cast<Price>(basePrice + priceFluctuation);
+    }
+
+    Quantity nextQuantity(Price basePrice)
+    {
+        std::uniform_int_distribution<int> distribution(1, simParameters_.OrderVolume * 100); // Max volume scaled
+        Quantity quantity = static_cast<Quantity>(distribution(generator_) / basePrice); // High price usually correlates to lower quantity
+        return std::max<Quantity>(quantity, 1);
+    }
+
+    Order nextAdd(Price basePrice)
+    {
+        Side side = (generator_() % 2 == 0) ? Side::Buy : Side::Sell;
+        OrderId orderId = nextId_++;
+        Quantity quantity = nextQuantity(basePrice);
+        if (generator_() % 2 == 0)
+        {
+            return Order(orderId, side, quantity, OrderType::Market);
+        }
+
+        OrderType type = OrderType::GoodTillCancel;
+        switch (generator_() % 4)
+        {
+        case 0:
+            type = OrderType::GoodTillCancel;
+            break;
+        case 1:
+            type = OrderType::FillAndKill;
+            break;
+        case 2:
+            type = OrderType::FillOrKill;
+            break;
+        case 3:
+            type = OrderType::GoodForDay;
+            break;
+        }
+        Order order(orderId, side, nextPrice(basePrice), quantity, type, Action::Add);
+        if (type == OrderType::GoodTillCancel || type == OrderType::GoodForDay)
+        {
+            trackLive(order);
+        }
+        return order;
+    }
+
+    bool hasLiveOrders() const { return !liveOrders_.empty(); }
+
+    // Requires hasLiveOrders()
+    Order nextModify(Price basePrice)
+    {
+        std::size_t idx = generator_() % liveOrders_.size();
+        const Order &existingOrder = liveOrders_[idx];
+        Order modifiedOrder(existingOrder.getId(), existingOrder.getSide(), nextPrice(basePrice), nextQuantity(basePrice), existingOrder.getType(), Action::Modify);
+        liveOrders_[idx] = modifiedOrder;
+        return modifiedOrder;
+    }
+
+    // Requires hasLiveOrders()
+    Order nextCancel()
+    {
+        std::size_t idx = generator_() % liveOrders_.size();
+        Order existingOrder = liveOrders_[idx];
+        liveOrders_[idx] = liveOrders_.back();
+        liveOrders_.pop_back();
+        return Order(existingOrder.getId(), existingOrder.getSide(), existingOrder.getPrice(), existingOrder.getRemainingQuantity(), existingOrder.getType(), Action::Cancel);
+    }
+
+    // Requires hasLiveOrders()
+    Order nextModifyOrCancel(Price basePrice)
+    {
+        return (generator_() % 2 == 0) ? nextModify(basePrice) : nextCancel();
+    }
+
+    // Same mix as the simulator's Normal mode: half adds, half modify/cancel
+    Order next(Price basePrice)
+    {
+        if (generator_() % 2 && hasLiveOrders())
+        {
+            return nextModifyOrCancel(basePrice);
+        }
+        return nextAdd(basePrice);
+    }
+
+    // Stand-alone traces have no book to take a price from, the reference walks by one volatility step
+    Price stepReferencePrice()
+    {
+        referencePrice_ = std::max<Price>(nextPrice(referencePrice_), TICK_SIZE);
+        return referencePrice_;
+    }
+
+    Order next()
+    {
+        Order order = next(referencePrice_);
+        stepReferencePrice();
+        return order;
+    }
+
+    Price getReferencePrice() const { return referencePrice_; }
+
+    // Lets independent generators hand out disjoint id ranges
+    void setNextOrderId(OrderId id) { nextId_ = id; }
+
+    // Uniform draw in [0, 1) from the model's engine, for callers layering their own mix on top
+    double nextUniform() { return std::uniform_real_distribution<double>(0.0, 1.0)(generator_); }
+};
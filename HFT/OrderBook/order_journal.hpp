@@ -0,0 +1,390 @@
+#pragma once
+
+#include "orderbook.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Write-ahead journal of inbound orders and the executions they cause
+ * The matching thread only copies fixed-width records into a single-producer ring, a writer
+ * thread drains it into one large buffer and commits the group with a single write and fsync
+ * once the oldest record has waited latencyBudget (or the batch is full). The durable
+ * sequence tells the caller how far acknowledgements may go
+ *
+ * The file is a plain array of JournalRecord, each carrying a checksum, so a torn tail left
+ * by a crash is detected and cut off. Recovery loads the latest snapshot and replays every
+ * inbound record after its sequence, executions are regenerated by matching
+ */
+
+enum class JournalRecordKind : std::uint8_t
+{
+    Inbound,  // Order as it reached processOrder
+    Execution // One fill, id is the incoming order and restingId the book order it hit
+};
+
+struct JournalRecord
+{
+    std::uint64_t sequence; // Inbound orders count from 1, executions carry their order's sequence
+    std::uint64_t id;
+    std::uint64_t restingId;
+    std::uint64_t timestamp;
+    double price; // Limit price, or the level price of an execution
+    std::uint32_t quantity;
+    JournalRecordKind kind;
+    std::uint8_t side;
+    std::uint8_t type;
+    std::uint8_t action;
+    std::uint8_t reserved[12];
+    std::uint32_t checksum; // FNV-1a of everything above, filled in by the writer thread
+};
+
+static_assert(sizeof(JournalRecord) == 64, "Journal records are one cache line");
+
+inline std::uint32_t journalChecksum(const JournalRecord &record)
+{
+    const auto *bytes = reinterpret_cast<const std::uint8_t *>(&record);
+    std::uint32_t hash = 2166136261u;
+    for (std::size_t i = 0; i < offsetof(JournalRecord, checksum); ++i)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Read-only, memory-mapped view of a journal, stops at the first torn or corrupt record
+ */
+class OrderJournalReader
+{
+private:
+    int fd_{-1};
+    const JournalRecord *records_{nullptr};
+    std::size_t size_{0};
+    std::size_t valid_{0}; // Leading records that passed their checksum
+
+public:
+    explicit OrderJournalReader(const std::string &path)
+    {
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0)
+        {
+            throw std::runtime_error("Cannot open journal: " + path);
+        }
+
+        struct stat info;
+        if (::fstat(fd_, &info) != 0)
+        {
+            ::close(fd_);
+            throw std::runtime_error("Cannot stat journal: " + path);
+        }
+        size_ = static_cast<std::size_t>(info.st_size);
+        if (size_ < sizeof(JournalRecord))
+        {
+            return; // Empty, or only a torn first record
+        }
+
+        void *mapped = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (mapped == MAP_FAILED)
+        {
+            ::close(fd_);
+            throw std::runtime_error("Cannot map journal: " + path);
+        }
+        ::madvise(mapped, size_, MADV_SEQUENTIAL);
+        records_ = static_cast<const JournalRecord *>(mapped);
+
+        std::size_t count = size_ / sizeof(JournalRecord);
+        while (valid_ < count && records_[valid_].checksum == journalChecksum(records_[valid_]))
+        {
+            valid_++;
+        }
+    }
+
+    ~OrderJournalReader()
+    {
+        if (records_)
+        {
+            ::munmap(const_cast<JournalRecord *>(records_), size_);
+        }
+        if (fd_ >= 0)
+        {
+            ::close(fd_);
+        }
+    }
+
+    OrderJournalReader(const OrderJournalReader &) = delete;
+    OrderJournalReader &operator=(const OrderJournalReader &) = delete;
+
+    std::span<const JournalRecord> getRecords() const { return {records_, valid_}; }
+    std::size_t getValidBytes() const { return valid_ * sizeof(JournalRecord); }
+    bool hasTornTail() const { return getValidBytes() != size_; }
+
+    std::uint64_t getLastSequence() const { return valid_ ? records_[valid_ - 1].sequence : 0; }
+
+    static Order toOrder(const JournalRecord &record)
+    {
+        return Order(record.id, static_cast<Side>(record.side), record.price, record.quantity,
+                     static_cast<OrderType>(record.type), static_cast<Action>(record.action), record.timestamp);
+    }
+};
+
+struct OrderJournalOptions
+{
+    std::chrono::microseconds latencyBudget{1000}; // Longest a record waits for its fsync
+    std::size_t ringRecords{1 << 16};              // Rounded up to a power of two
+    std::size_t maxBatchRecords{1 << 14};          // Commit early once this many are pending
+};
+
+/**
+ * The append side, one producer (the matching thread) and the writer thread it owns
+ * Opening an existing journal cuts any torn tail and continues its sequence numbers
+ */
+class OrderJournal
+{
+private:
+    OrderJournalOptions options_;
+    int fd_{-1};
+    std::vector<JournalRecord> ring_;
+    std::size_t mask_;
+
+    alignas(64) std::atomic<std::uint64_t> head_{0}; // Next slot the producer fills
+    alignas(64) std::atomic<std::uint64_t> tail_{0}; // Next slot the writer drains
+    alignas(64) std::atomic<std::uint64_t> durableSequence_{0};
+    std::atomic<std::uint64_t> commits_{0};
+    std::atomic<std::uint64_t> producerStalls_{0};
+    std::atomic<bool> failed_{false};
+    std::atomic<bool> running_{true};
+
+    // Producer side only
+    std::uint64_t nextSequence_{1};
+    std::uint64_t cachedTail_{0};
+
+    std::thread writer_;
+
+    void push(const JournalRecord &record)
+    {
+        std::uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head - cachedTail_ == ring_.size())
+        {
+            // Ring full, the writer is behind on its disk. Only this overflow path ever yields,
+            // a spinning producer would starve a writer sharing its core
+            producerStalls_.fetch_add(1, std::memory_order_relaxed);
+            for (unsigned spins = 0; head - (cachedTail_ = tail_.load(std::memory_order_acquire)) == ring_.size(); ++spins)
+            {
+                if (spins >= 1024)
+                    std::this_thread::yield();
+            }
+        }
+        ring_[head & mask_] = record;
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    bool writeAll(const JournalRecord *records, std::size_t count)
+    {
+        const auto *bytes = reinterpret_cast<const std::uint8_t *>(records);
+        std::size_t remaining = count * sizeof(JournalRecord);
+        while (remaining > 0)
+        {
+            ssize_t n = ::write(fd_, bytes, remaining);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            bytes += n;
+            remaining -= static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    void writerLoop()
+    {
+        std::vector<JournalRecord> batch;
+        batch.reserve(options_.maxBatchRecords);
+        auto oldest = std::chrono::steady_clock::now();
+
+        while (true)
+        {
+            bool stopping = !running_.load(std::memory_order_acquire);
+            std::uint64_t tail = tail_.load(std::memory_order_relaxed);
+            std::uint64_t head = head_.load(std::memory_order_acquire);
+            if (batch.empty() && head != tail)
+            {
+                oldest = std::chrono::steady_clock::now();
+            }
+            for (; tail != head && batch.size() < options_.maxBatchRecords; ++tail)
+            {
+                batch.push_back(ring_[tail & mask_]);
+                batch.back().checksum = journalChecksum(batch.back());
+            }
+            tail_.store(tail, std::memory_order_release);
+
+            bool due = !batch.empty() && (stopping || batch.size() >= options_.maxBatchRecords ||
+                                          std::chrono::steady_clock::now() - oldest >= options_.latencyBudget);
+            if (due)
+            {
+                // One sequential write and one fsync for the whole group
+                if (!failed_.load(std::memory_order_relaxed) && writeAll(batch.data(), batch.size()) && ::fdatasync(fd_) == 0)
+                {
+                    durableSequence_.store(batch.back().sequence, std::memory_order_release);
+                    commits_.fetch_add(1, std::memory_order_relaxed);
+                }
+                else
+                {
+                    failed_.store(true, std::memory_order_release);
+                }
+                batch.clear();
+                continue;
+            }
+
+            if (stopping && batch.empty() && tail == head_.load(std::memory_order_acquire))
+            {
+                break;
+            }
+            if (head == tail)
+            {
+                std::this_thread::sleep_for(options_.latencyBudget / 8);
+            }
+        }
+    }
+
+public:
+    explicit OrderJournal(const std::string &path, OrderJournalOptions options = {})
+        : options_{options}
+    {
+        std::size_t capacity = 1;
+        while (capacity < options_.ringRecords)
+        {
+            capacity <<= 1;
+        }
+        ring_.resize(capacity);
+        mask_ = capacity - 1;
+        options_.maxBatchRecords = std::max<std::size_t>(1, options_.maxBatchRecords);
+
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+        if (fd_ < 0)
+        {
+            throw std::runtime_error("Cannot open journal: " + path);
+        }
+
+        // Continue after the last intact record, anything torn behind it is dropped
+        std::size_t validBytes = 0;
+        {
+            OrderJournalReader existing(path);
+            validBytes = existing.getValidBytes();
+            nextSequence_ = existing.getLastSequence() + 1;
+        }
+        if (::ftruncate(fd_, static_cast<off_t>(validBytes)) != 0 || ::lseek(fd_, static_cast<off_t>(validBytes), SEEK_SET) < 0)
+        {
+            ::close(fd_);
+            throw std::runtime_error("Cannot reopen journal: " + path);
+        }
+        durableSequence_.store(nextSequence_ - 1);
+
+        writer_ = std::thread(&OrderJournal::writerLoop, this);
+    }
+
+    // Commits everything appended so far before returning
+    ~OrderJournal()
+    {
+        running_.store(false, std::memory_order_release);
+        writer_.join();
+        ::close(fd_);
+    }
+
+    OrderJournal(const OrderJournal &) = delete;
+    OrderJournal &operator=(const OrderJournal &) = delete;
+
+    // Log an order before processOrder sees it, returns its sequence number to pass to
+    // processOrder, e.g. book.processOrder(order, journal.appendInbound(order))
+    std::uint64_t appendInbound(const Order &order)
+    {
+        JournalRecord record{};
+        record.sequence = nextSequence_++;
+        record.id = order.getId();
+        record.timestamp = order.getTimestamp();
+        record.price = order.getPrice();
+        record.quantity = order.getRemainingQuantity();
+        record.kind = JournalRecordKind::Inbound;
+        record.side = static_cast<std::uint8_t>(order.getSide());
+        record.type = static_cast<std::uint8_t>(order.getType());
+        record.action = static_cast<std::uint8_t>(order.getAction());
+        push(record);
+        return record.sequence;
+    }
+
+    // inboundSequence is the one appendInbound returned for the incoming order
+    void appendExecution(std::uint64_t inboundSequence, const Order &incoming, const Order &resting, Quantity quantity, Price price)
+    {
+        JournalRecord record{};
+        record.sequence = inboundSequence;
+        record.id = incoming.getId();
+        record.restingId = resting.getId();
+        record.timestamp = incoming.getTimestamp();
+        record.price = price;
+        record.quantity = quantity;
+        record.kind = JournalRecordKind::Execution;
+        record.side = static_cast<std::uint8_t>(incoming.getSide());
+        record.type = static_cast<std::uint8_t>(incoming.getType());
+        record.action = static_cast<std::uint8_t>(Action::Execute);
+        push(record);
+    }
+
+    // Journal every execution the book reports
+    void attach(OrderBook &book) { book.setJournal(this); }
+
+    // Last inbound sequence handed to the journal, the one to store in a snapshot
+    std::uint64_t getLastSequence() const { return nextSequence_ - 1; }
+    // Everything up to here has been fsynced
+    std::uint64_t getDurableSequence() const { return durableSequence_.load(std::memory_order_acquire); }
+    std::uint64_t getCommitCount() const { return commits_.load(std::memory_order_relaxed); }
+    std::uint64_t getProducerStalls() const { return producerStalls_.load(std::memory_order_relaxed); }
+    // A write or fsync failed, nothing after getDurableSequence() is safe
+    bool hasFailed() const { return failed_.load(std::memory_order_acquire); }
+};
+
+/**
+ * Latest snapshot plus the journal tail behind it, either file may be missing
+ * Inbound records after the snapshot's sequence are replayed through processOrder, lastSequence
+ * receives the last one applied
+ */
+inline std::unique_ptr<OrderBook> recoverOrderBook(const std::string &snapshotPath, const std::string &journalPath,
+                                                   Price initialPrice, std::uint64_t *lastSequence = nullptr)
+{
+    std::unique_ptr<OrderBook> book;
+    std::uint64_t applied = 0;
+    if (::access(snapshotPath.c_str(), F_OK) == 0)
+    {
+        OrderSnapshotReader snapshot(snapshotPath);
+        book = std::make_unique<OrderBook>(snapshot);
+        applied = snapshot.getHeader().sequence;
+    }
+    else
+    {
+        book = std::make_unique<OrderBook>(initialPrice);
+    }
+
+    if (::access(journalPath.c_str(), F_OK) == 0)
+    {
+        OrderJournalReader journal(journalPath);
+        for (const JournalRecord &record : journal.getRecords())
+        {
+            if (record.kind != JournalRecordKind::Inbound || record.sequence <= applied)
+                continue;
+            Order order = OrderJournalReader::toOrder(record);
+            book->processOrder(order, record.sequence);
+            applied = record.sequence;
+        }
+    }
+
+    if (lastSequence)
+    {
+        *lastSequence = applied;
+    }
+    return book;
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "helper.hpp"
+#include <cerrno>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * On-disk format for OrderBook snapshots
+ * Fixed-width sections, each 8-byte aligned, so a restarted process maps the file and walks
+ * it in place instead of replaying the session that built the book
+ *
+ *   OrderSnapshotHeader | levels, bids then asks, best first | orders, level by level in
+ *   priority order | id index sorted by id
+ *
+ * Snapshots are written to a temporary file and renamed, so a reader never sees a partial one
+ */
+
+struct OrderSnapshotHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t sequence; // Last input applied before the snapshot, replay resumes after it
+    double currentPrice;
+    std::uint64_t bidLevels;
+    std::uint64_t askLevels;
+    std::uint64_t orderCount;
+};
+
+struct OrderSnapshotLevel
+{
+    double price;
+    std::uint32_t totalQuantity;
+    std::uint32_t orders; // Records that follow the previous level's in the orders section
+};
+
+struct OrderSnapshotOrder
+{
+    std::uint64_t id;
+    std::uint64_t timestamp;
+    std::uint32_t initialQuantity;
+    std::uint32_t remainingQuantity;
+    std::uint8_t type;
+    std::uint8_t action;
+    std::uint8_t pad[6];
+};
+
+struct OrderSnapshotIndexEntry
+{
+    std::uint64_t id;
+    std::uint32_t level; // Into the levels section, bids first
+    std::uint32_t order; // Into the orders section
+};
+
+static_assert(sizeof(OrderSnapshotHeader) % 8 == 0 && sizeof(OrderSnapshotLevel) == 16 &&
+                  sizeof(OrderSnapshotOrder) == 32 && sizeof(OrderSnapshotIndexEntry) == 16,
+              "Snapshot records must keep every section 8-byte aligned");
+
+constexpr char OrderSnapshotMagic[8] = {'O', 'B', 'S', 'N', 'A', 'P', 'S', 'H'};
+constexpr std::uint32_t OrderSnapshotVersion = 1;
+
+inline std::size_t orderSnapshotBytes(std::uint64_t levels, std::uint64_t orders)
+{
+    return sizeof(OrderSnapshotHeader) + levels * sizeof(OrderSnapshotLevel) +
+           orders * (sizeof(OrderSnapshotOrder) + sizeof(OrderSnapshotIndexEntry));
+}
+
+/**
+ * Read-only, memory-mapped view of a snapshot file
+ * Lookups by id can be served straight from the mapping before, or instead of, rebuilding a book
+ */
+class OrderSnapshotReader
+{
+private:
+    int fd_{-1};
+    const std::uint8_t *data_{nullptr};
+    std::size_t size_{0};
+    OrderSnapshotHeader header_{};
+    std::span<const OrderSnapshotLevel> levels_;
+    std::span<const OrderSnapshotOrder> orders_;
+    std::span<const OrderSnapshotIndexEntry> index_;
+
+public:
+    explicit OrderSnapshotReader(const std::string &path)
+    {
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0)
+        {
+            throw std::runtime_error("Cannot open snapshot: " + path);
+        }
+
+        struct stat info;
+        if (::fstat(fd_, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(OrderSnapshotHeader))
+        {
+            ::close(fd_);
+            throw std::runtime_error("Snapshot too small: " + path);
+        }
+        size_ = static_cast<std::size_t>(info.st_size);
+
+        void *mapped = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd_, 0);
+        if (mapped == MAP_FAILED)
+        {
+            ::close(fd_);
+            throw std::runtime_error("Cannot map snapshot: " + path);
+        }
+        data_ = static_cast<const std::uint8_t *>(mapped);
+
+        std::memcpy(&header_, data_, sizeof(header_));
+        if (std::memcmp(header_.magic, OrderSnapshotMagic, sizeof(OrderSnapshotMagic)) != 0 || header_.version != OrderSnapshotVersion ||
+            size_ != orderSnapshotBytes(header_.bidLevels + header_.askLevels, header_.orderCount))
+        {
+            ::munmap(mapped, size_);
+            ::close(fd_);
+            throw std::runtime_error("Not a complete snapshot: " + path);
+        }
+
+        const std::uint8_t *section = data_ + sizeof(OrderSnapshotHeader);
+        levels_ = {reinterpret_cast<const OrderSnapshotLevel *>(section), header_.bidLevels + header_.askLevels};
+        section += levels_.size_bytes();
+        orders_ = {reinterpret_cast<const OrderSnapshotOrder *>(section), header_.orderCount};
+        section += orders_.size_bytes();
+        index_ = {reinterpret_cast<const OrderSnapshotIndexEntry *>(section), header_.orderCount};
+    }
+
+    ~OrderSnapshotReader()
+    {
+        if (data_)
+        {
+            ::munmap(const_cast<std::uint8_t *>(data_), size_);
+        }
+        if (fd_ >= 0)
+        {
+            ::close(fd_);
+        }
+    }
+
+    OrderSnapshotReader(const OrderSnapshotReader &) = delete;
+    OrderSnapshotReader &operator=(const OrderSnapshotReader &) = delete;
+
+    const OrderSnapshotHeader &getHeader() const { return header_; }
+    std::span<const OrderSnapshotLevel> getLevels() const { return levels_; }
+    std::span<const OrderSnapshotOrder> getOrders() const { return orders_; }
+    std::span<const OrderSnapshotIndexEntry> getIndex() const { return index_; }
+
+    Side getLevelSide(std::uint32_t level) const { return level < header_.bidLevels ? Side::Buy : Side::Sell; }
+
+    // Binary search of the id index, nullptr if the order was not resting
+    const OrderSnapshotIndexEntry *find(OrderId id) const
+    {
+        auto it = std::lower_bound(index_.begin(), index_.end(), id,
+                                   [](const OrderSnapshotIndexEntry &entry, OrderId key) { return entry.id < key; });
+        return (it != index_.end() && it->id == id) ? &*it : nullptr;
+    }
+};
+
+/**
+ * Waits for a snapshot started by OrderBook::writeSnapshotInBackground, true if it was written
+ */
+inline bool waitForSnapshot(pid_t writer)
+{
+    int status = 0;
+    while (::waitpid(writer, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+            return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
@@ -1,21 +1,23 @@
 #include "orderbook.hpp"
+#include "order_journal.hpp"
+#include "market_data_shm.hpp"
 
 void OrderBook::calcPrice()
 {
     // Simple price calculation: midpoint of best bid and ask
     if (!bidLevels_.empty() && !askLevels_.empty())
     {
-        Price bestBid = bidLevels_.begin()->first;
-        Price bestAsk = askLevels_.begin()->first;
+        Price bestBid = bidLevels_.bestPrice();
+        Price bestAsk = askLevels_.bestPrice();
         currentPrice_ = (bestBid + bestAsk) / 2;
     }
     else if (!bidLevels_.empty())
     {
-        currentPrice_ = bidLevels_.begin()->first;
+        currentPrice_ = bidLevels_.bestPrice();
     }
     else if (!askLevels_.empty())
     {
-        currentPrice_ = askLevels_.begin()->first;
+        currentPrice_ = askLevels_.bestPrice();
     }
     else
     {
@@ -35,7 +37,7 @@ bool OrderBook::canMatch(const Order &incomingOrder) const
         // Buy order can match if there's at least one ask level at or below the order price
         if (askLevels_.empty())
             return false;
-        Price bestAsk = askLevels_.begin()->first;
+        Price bestAsk = askLevels_.bestPrice();
         return incomingOrder.getType() == OrderType::Market || incomingOrder.getPrice() >= bestAsk;
     }
     else
@@ -43,7 +45,7 @@ bool OrderBook::canMatch(const Order &incomingOrder) const
         // Sell order can match if there's at least one bid level at or above the order price
         if (bidLevels_.empty())
             return false;
-        Price bestBid = bidLevels_.begin()->first;
+        Price bestBid = bidLevels_.bestPrice();
         return incomingOrder.getType() == OrderType::Market || incomingOrder.getPrice() <= bestBid;
     }
 }
@@ -53,22 +55,22 @@ bool OrderBook::canMatchFully(const Order &incomingOrder) const
     Quantity totalAvailable = 0;
     if (incomingOrder.getSide() == Side::Buy)
     {
-        for (const auto &askLevel : askLevels_)
+        for (const PriceLevel &askLevel : askLevels_)
         {
-            if (incomingOrder.getType() != OrderType::Market && askLevel.first > incomingOrder.getPrice())
+            if (incomingOrder.getType() != OrderType::Market && askLevel.getPrice() > incomingOrder.getPrice())
                 break;
-            totalAvailable += askLevel.second.getTotalQuantity();
+            totalAvailable += askLevel.getTotalQuantity();
             if (totalAvailable >= incomingOrder.getRemainingQuantity())
                 return true;
         }
     }
     else
     {
-        for (const auto &bidLevel : bidLevels_)
+        for (const PriceLevel &bidLevel : bidLevels_)
         {
-            if (incomingOrder.getType() != OrderType::Market && bidLevel.first < incomingOrder.getPrice())
+            if (incomingOrder.getType() != OrderType::Market && bidLevel.getPrice() < incomingOrder.getPrice())
                 break;
-            totalAvailable += bidLevel.second.getTotalQuantity();
+            totalAvailable += bidLevel.getTotalQuantity();
             if (totalAvailable >= incomingOrder.getRemainingQuantity())
                 return true;
         }
@@ -76,15 +78,28 @@ bool OrderBook::canMatchFully(const Order &incomingOrder) const
     return false;
 }
 
-void OrderBook::Match(Order &incomingOrder)
+// Direct calls into whichever sinks are attached, nothing type-erased on the matching path
+inline void OrderBook::reportFill(std::uint64_t sequence, const Order &incomingOrder, const Order &bookOrder, Quantity quantity, Price price)
+{
+    if (journal_)
+    {
+        journal_->appendExecution(sequence, incomingOrder, bookOrder, quantity, price);
+    }
+    if (marketData_)
+    {
+        marketData_->publishTrade(incomingOrder, bookOrder, quantity, price);
+    }
+}
+
+void OrderBook::Match(Order &incomingOrder, std::uint64_t sequence)
 {
     if (incomingOrder.getSide() == Side::Buy)
     {
         // Match against ask levels
-        auto askIt = askLevels_.begin();
-        while (askIt != askLevels_.end() && !incomingOrder.isFilled())
+        // Best level is always in the hot tier, emptied levels pull the next one up
+        while (!askLevels_.empty() && !incomingOrder.isFilled())
         {
-            PriceLevel &level = askIt->second;
+            PriceLevel &level = askLevels_.best();
             std::map<OrderId, Order> &orders = level.getOrders();
             for (auto orderIt = orders.begin(); orderIt != orders.end() && !incomingOrder.isFilled();)
             {
@@ -92,11 +107,14 @@ void OrderBook::Match(Order &incomingOrder)
                 Quantity matchQty = std::min(incomingOrder.getRemainingQuantity(), bookOrder.getRemainingQuantity());
                 incomingOrder.fillOrder(matchQty);
                 bookOrder.fillOrder(matchQty);
+                level.reduceQuantity(matchQty);
+                askQuantity_ -= matchQty;
+                reportFill(sequence, incomingOrder, bookOrder, matchQty, level.getPrice());
 
                 if (bookOrder.isFilled())
                 {
+                    orderIndex_.erase(bookOrder.getId());
                     orderIt = orders.erase(orderIt);
-                    level.removeOrder(bookOrder);
                 }
                 else
                 {
@@ -104,23 +122,20 @@ void OrderBook::Match(Order &incomingOrder)
                 }
             }
 
-            if (level.getTotalQuantity() == 0)
+            if (level.getTotalQuantity() != 0)
             {
-                askIt = askLevels_.erase(askIt);
-            }
-            else
-            {
-                ++askIt;
+                break;
             }
+            askLevels_.popBest();
         }
     }
     else
     {
         // Match against bid levels
-        auto bidIt = bidLevels_.begin();
-        while (bidIt != bidLevels_.end() && !incomingOrder.isFilled())
+        // Best level is always in the hot tier, emptied levels pull the next one up
+        while (!bidLevels_.empty() && !incomingOrder.isFilled())
         {
-            PriceLevel &level = bidIt->second;
+            PriceLevel &level = bidLevels_.best();
             std::map<OrderId, Order> &orders = level.getOrders();
             for (auto orderIt = orders.begin(); orderIt != orders.end() && !incomingOrder.isFilled();)
             {
@@ -128,11 +143,14 @@ void OrderBook::Match(Order &incomingOrder)
                 Quantity matchQty = std::min(incomingOrder.getRemainingQuantity(), bookOrder.getRemainingQuantity());
                 incomingOrder.fillOrder(matchQty);
                 bookOrder.fillOrder(matchQty);
+                level.reduceQuantity(matchQty);
+                bidQuantity_ -= matchQty;
+                reportFill(sequence, incomingOrder, bookOrder, matchQty, level.getPrice());
 
                 if (bookOrder.isFilled())
                 {
+                    orderIndex_.erase(bookOrder.getId());
                     orderIt = orders.erase(orderIt);
-                    level.removeOrder(bookOrder);
                 }
                 else
                 {
@@ -140,14 +158,11 @@ void OrderBook::Match(Order &incomingOrder)
                 }
             }
 
-            if (level.getTotalQuantity() == 0)
+            if (level.getTotalQuantity() != 0)
             {
-                bidIt = bidLevels_.erase(bidIt);
-            }
-            else
-            {
-                ++bidIt;
+                break;
             }
+            bidLevels_.popBest();
         }
     }
 
@@ -155,56 +170,58 @@ void OrderBook::Match(Order &incomingOrder)
     calcPrice();
 }
 
-// Process order based on type
 void OrderBook::processOrder(Order &order)
 {
+    processOrder(order, 0);
+}
+
+// Process order based on type
+void OrderBook::processOrder(Order &order, std::uint64_t sequence)
+{
+    // One resting order per id: a cancel takes it out, anything else replaces it and
+    // joins the back of its new level like a fresh order
+    bool removed = removeRestingOrder(order.getId());
+    if (order.getAction() == Action::Cancel)
+    {
+        if (removed)
+        {
+            publishTopOfBook();
+            publishDepth();
+        }
+        return;
+    }
 
     switch (order.getType())
     {
     case OrderType::Market:
         if (canMatch(order))
         {
-            Match(order);
+            Match(order, sequence);
         }
         break;
     case OrderType::GoodTillCancel:
     case OrderType::GoodForDay:
         if (canMatch(order))
         {
-            Match(order);
+            Match(order, sequence);
         }
         if (!order.isFilled())
         {
 
+            // New levels near the touch land in the hot tier and may demote the worst hot level
             PriceLevel *levelPtr = nullptr;
             if (order.getSide() == Side::Buy)
             {
-                auto it = bidLevels_.find(order.getPrice());
-                if (it == bidLevels_.end())
-                {
-                    auto res = bidLevels_.emplace(order.getPrice(), PriceLevel(order.getPrice()));
-                    levelPtr = &(res.first->second);
-                }
-                else
-                {
-                    levelPtr = &(it->second);
-                }
+                levelPtr = &bidLevels_.getOrCreate(order.getPrice());
             }
             else
             {
-                auto it = askLevels_.find(order.getPrice());
-                if (it == askLevels_.end())
-                {
-                    auto res = askLevels_.emplace(order.getPrice(), PriceLevel(order.getPrice()));
-                    levelPtr = &(res.first->second);
-                }
-                else
-                {
-                    levelPtr = &(it->second);
-                }
+                levelPtr = &askLevels_.getOrCreate(order.getPrice());
             }
 
             levelPtr->addOrder(order);
+            orderIndex_[order.getId()] = OrderLocation{order.getSide(), order.getPrice()};
+            (order.getSide() == Side::Buy ? bidQuantity_ : askQuantity_) += order.getRemainingQuantity();
             // Recalculate price after adding order
             calcPrice();
         }
@@ -212,7 +229,7 @@ void OrderBook::processOrder(Order &order)
     case OrderType::FillAndKill:
         if (canMatch(order))
         {
-            Match(order);
+            Match(order, sequence);
         }
         // Any unfilled portion is canceled (do nothing)
         break;
@@ -220,11 +237,106 @@ void OrderBook::processOrder(Order &order)
 
         if (canMatchFully(order))
         {
-            Match(order);
+            Match(order, sequence);
         }
         // If not fully filled, entire order is canceled (do nothing)
         break;
     }
+
+    publishTopOfBook();
+    publishDepth();
+}
+
+bool OrderBook::removeRestingOrder(OrderId id)
+{
+    auto location = orderIndex_.find(id);
+    if (location == orderIndex_.end())
+    {
+        return false;
+    }
+    Side side = location->second.side;
+    Price price = location->second.price;
+    orderIndex_.erase(location);
+
+    PriceLevel *level = side == Side::Buy ? bidLevels_.find(price) : askLevels_.find(price);
+    if (!level)
+    {
+        return false;
+    }
+    auto it = level->getOrders().find(id);
+    if (it == level->getOrders().end())
+    {
+        return false;
+    }
+    (side == Side::Buy ? bidQuantity_ : askQuantity_) -= it->second.getRemainingQuantity();
+    level->removeOrder(it->second);
+    if (level->getOrders().empty())
+    {
+        side == Side::Buy ? bidLevels_.erase(price) : askLevels_.erase(price);
+    }
+    calcPrice();
+    return true;
+}
+
+void OrderBook::publishTopOfBook() noexcept
+{
+    TopOfBook record{};
+    record.hasBid = !bidLevels_.empty();
+    record.hasAsk = !askLevels_.empty();
+    if (record.hasBid)
+    {
+        record.bestBid = bidLevels_.bestPrice();
+        record.bestBidQuantity = bidLevels_.best().getTotalQuantity();
+    }
+    if (record.hasAsk)
+    {
+        record.bestAsk = askLevels_.bestPrice();
+        record.bestAskQuantity = askLevels_.best().getTotalQuantity();
+    }
+    if (record.hasBid && record.hasAsk)
+    {
+        record.mid = (record.bestBid + record.bestAsk) / 2;
+        record.spread = record.bestAsk - record.bestBid;
+    }
+    record.lastPrice = currentPrice_;
+    record.totalBidQuantity = bidQuantity_;
+    record.totalAskQuantity = askQuantity_;
+    topOfBook_.publish(record);
+}
+
+void OrderBook::publishDepth()
+{
+    if (depthFeed_)
+    {
+        depthFeed_->refresh(Side::Buy, bidLevels_);
+        depthFeed_->refresh(Side::Sell, askLevels_);
+        depthFeed_->commit();
+    }
+}
+
+void OrderBook::enableDepth(std::size_t levels, std::size_t ringCapacity)
+{
+    if (levels == 0 || levels > std::numeric_limits<std::uint16_t>::max())
+    {
+        throw std::invalid_argument("Depth must be between 1 and 65535 levels");
+    }
+    if (ringCapacity < 4 * levels)
+    {
+        // One change can delete and replace every level on both sides
+        throw std::invalid_argument("Depth ring must hold at least 4 deltas per level");
+    }
+    depthFeed_ = std::make_unique<DepthFeed>(levels, ringCapacity);
+    publishDepth();
+}
+
+bool OrderBook::getDepthSnapshot(DepthSnapshot &out) const
+{
+    if (!depthFeed_)
+    {
+        return false;
+    }
+    depthFeed_->snapshot(out);
+    return true;
 }
 
 void OrderBook::cancelGFDOrders(bool isBids)
@@ -245,17 +357,18 @@ void OrderBook::cancelGFDOrders(bool isBids)
             if (now_tm.tm_hour == 16 && now_tm.tm_min == 0 && now_tm.tm_sec == 0)
             {
 
-                for (auto &bidLevelPair : bidLevels_)
+                for (PriceLevel &level : bidLevels_)
                 {
-                    PriceLevel &level = bidLevelPair.second;
                     std::map<OrderId, Order> &orders = level.getOrders();
                     for (auto it = orders.begin(); it != orders.end();)
                     {
                         if (it->second.getType() == OrderType::GoodTillCancel)
                         {
                             // Lock mutex while modifying shared data
-                            it = orders.erase(it);
-                            level.removeOrder(it->second);
+                            const Order &order = (it++)->second;
+                            orderIndex_.erase(order.getId());
+                            bidQuantity_ -= order.getRemainingQuantity();
+                            level.removeOrder(order);
                         }
                         else
                         {
@@ -263,6 +376,8 @@ void OrderBook::cancelGFDOrders(bool isBids)
                         }
                     }
                 }
+                publishTopOfBook();
+                publishDepth();
             }
         }
     }
@@ -281,17 +396,18 @@ void OrderBook::cancelGFDOrders(bool isBids)
             if (now_tm.tm_hour == 16 && now_tm.tm_min == 0 && now_tm.tm_sec == 0)
             {
 
-                for (auto &askLevelPair : askLevels_)
+                for (PriceLevel &level : askLevels_)
                 {
-                    PriceLevel &level = askLevelPair.second;
                     std::map<OrderId, Order> &orders = level.getOrders();
                     for (auto it = orders.begin(); it != orders.end();)
                     {
                         if (it->second.getType() == OrderType::GoodTillCancel)
                         {
                             // Lock mutex while modifying shared data
-                            it = orders.erase(it);
-                            level.removeOrder(it->second);
+                            const Order &order = (it++)->second;
+                            orderIndex_.erase(order.getId());
+                            askQuantity_ -= order.getRemainingQuantity();
+                            level.removeOrder(order);
                         }
                         else
                         {
@@ -299,6 +415,8 @@ void OrderBook::cancelGFDOrders(bool isBids)
                         }
                     }
                 }
+                publishTopOfBook();
+                publishDepth();
             }
         }
     }
@@ -315,106 +433,255 @@ bool OrderBook::isEmpty() const
     return bidLevels_.empty() && askLevels_.empty();
 }
 
-Order OrderBook::getOrder(OrderId id) const
+const Order *OrderBook::findOrder(OrderId id) const noexcept
 {
-
-    // Search in bid levels
-    for (const auto &bidLevelPair : bidLevels_)
+    // The index names the one level that can hold the order
+    auto location = orderIndex_.find(id);
+    if (location == orderIndex_.end())
     {
-        const PriceLevel &level = bidLevelPair.second;
-        const auto &orders = level.getOrders();
-        auto it = orders.find(id);
-        if (it != orders.end())
-        {
-            return it->second;
-        }
+        return nullptr;
     }
 
-    // Search in ask levels
-    for (const auto &askLevelPair : askLevels_)
+    const PriceLevel *level = location->second.side == Side::Buy ? bidLevels_.find(location->second.price)
+                                                                 : askLevels_.find(location->second.price);
+    if (!level)
     {
-        const PriceLevel &level = askLevelPair.second;
-        const auto &orders = level.getOrders();
-        auto it = orders.find(id);
-        if (it != orders.end())
-        {
-            return it->second;
-        }
+        return nullptr;
     }
+    const auto &orders = level->getOrders();
+    auto it = orders.find(id);
+    return it != orders.end() ? &it->second : nullptr;
+}
 
+Order OrderBook::getOrder(OrderId id) const
+{
+    if (const Order *order = findOrder(id))
+    {
+        return *order;
+    }
     throw std::invalid_argument("Order ID not found");
 }
 
+std::size_t OrderBook::getOrderCount() const
+{
+    return orderIndex_.size();
+}
+
+Quantity OrderBook::findLevelQuantity(Side side, Price price) const noexcept
+{
+    const PriceLevel *level = side == Side::Buy ? bidLevels_.find(price) : askLevels_.find(price);
+    return level ? level->getTotalQuantity() : 0; // 0 when there is no such level
+}
+
 int OrderBook::getLevelQuantity(Side side, Price price) const
 {
-    if (side == Side::Buy)
+    return static_cast<int>(findLevelQuantity(side, price));
+}
+
+std::optional<double> OrderBook::tryGetSpread() const noexcept
+{
+    if (bidLevels_.empty() || askLevels_.empty())
     {
-        auto it = bidLevels_.find(price);
-        if (it != bidLevels_.end())
-        {
-            return it->second.getTotalQuantity();
-        }
+        return std::nullopt;
     }
-    else
+    return static_cast<double>(askLevels_.bestPrice() - bidLevels_.bestPrice());
+}
+
+double OrderBook::getSpread() const
+{
+    if (std::optional<double> spread = tryGetSpread())
     {
-        auto it = askLevels_.find(price);
-        if (it != askLevels_.end())
-        {
-            return it->second.getTotalQuantity();
-        }
+        return *spread;
     }
-    return 0; // Level not found
+    throw std::runtime_error("Cannot calculate spread: one side of the order book is empty");
 }
 
-double OrderBook::getSpread() const
+std::optional<Price> OrderBook::tryGetBestSidePrice(Side side) const noexcept
 {
-    if (bidLevels_.empty() || askLevels_.empty())
+    if (side == Side::Buy)
     {
-        throw std::runtime_error("Cannot calculate spread: one side of the order book is empty");
+        return bidLevels_.empty() ? std::nullopt : std::optional<Price>{bidLevels_.bestPrice()};
     }
+    return askLevels_.empty() ? std::nullopt : std::optional<Price>{askLevels_.bestPrice()};
+}
 
-    Price bestBid = bidLevels_.begin()->first;
-    Price bestAsk = askLevels_.begin()->first;
+Price OrderBook::getBestSidePrice(Side side) const
+{
+    if (std::optional<Price> best = tryGetBestSidePrice(side))
+    {
+        return *best;
+    }
+    throw std::runtime_error(side == Side::Buy ? "No bid levels available" : "No ask levels available");
+}
 
-    return static_cast<double>(bestAsk - bestBid);
+Quantity OrderBook::getSideQuantity(Side side) const
+{
+    // Running totals, no walk over the levels
+    return static_cast<Quantity>(side == Side::Buy ? bidQuantity_ : askQuantity_);
 }
 
-Price OrderBook::getBestSidePrice(Side side) const
+std::vector<std::uint8_t> OrderBook::encodeSnapshot(std::uint64_t sequence) const
 {
-    if (side == Side::Buy)
+    OrderSnapshotHeader header{};
+    std::memcpy(header.magic, OrderSnapshotMagic, sizeof(OrderSnapshotMagic));
+    header.version = OrderSnapshotVersion;
+    header.sequence = sequence;
+    header.currentPrice = currentPrice_;
+    header.bidLevels = bidLevels_.size();
+    header.askLevels = askLevels_.size();
+    header.orderCount = 0;
+    for (const PriceLevel &level : bidLevels_)
     {
-        if (bidLevels_.empty())
+        header.orderCount += level.getOrders().size();
+    }
+    for (const PriceLevel &level : askLevels_)
+    {
+        header.orderCount += level.getOrders().size();
+    }
+
+    std::vector<std::uint8_t> image(orderSnapshotBytes(header.bidLevels + header.askLevels, header.orderCount));
+    std::memcpy(image.data(), &header, sizeof(header));
+    auto *levels = reinterpret_cast<OrderSnapshotLevel *>(image.data() + sizeof(header));
+    auto *orders = reinterpret_cast<OrderSnapshotOrder *>(levels + header.bidLevels + header.askLevels);
+    auto *index = reinterpret_cast<OrderSnapshotIndexEntry *>(orders + header.orderCount);
+
+    // Levels best first and orders in the sequence Match consumes them
+    std::uint32_t levelIdx = 0;
+    std::uint32_t orderIdx = 0;
+    auto encodeLevel = [&](const PriceLevel &level)
+    {
+        levels[levelIdx] = OrderSnapshotLevel{level.getPrice(), level.getTotalQuantity(), static_cast<std::uint32_t>(level.getOrders().size())};
+        for (const auto &[id, order] : level.getOrders())
         {
-            throw std::runtime_error("No bid levels available");
+            OrderSnapshotOrder &record = orders[orderIdx];
+            record = OrderSnapshotOrder{};
+            record.id = id;
+            record.timestamp = order.getTimestamp();
+            record.initialQuantity = order.getInitialQuantity();
+            record.remainingQuantity = order.getRemainingQuantity();
+            record.type = static_cast<std::uint8_t>(order.getType());
+            record.action = static_cast<std::uint8_t>(order.getAction());
+            index[orderIdx] = OrderSnapshotIndexEntry{id, levelIdx, orderIdx};
+            orderIdx++;
         }
-        return bidLevels_.begin()->first;
+        levelIdx++;
+    };
+    for (const PriceLevel &level : bidLevels_)
+    {
+        encodeLevel(level);
     }
-    else
+    for (const PriceLevel &level : askLevels_)
     {
-        if (askLevels_.empty())
+        encodeLevel(level);
+    }
+
+    std::sort(index, index + header.orderCount,
+              [](const OrderSnapshotIndexEntry &a, const OrderSnapshotIndexEntry &b) { return a.id < b.id; });
+    return image;
+}
+
+void OrderBook::writeSnapshot(const std::string &path, std::uint64_t sequence) const
+{
+    std::vector<std::uint8_t> image = encodeSnapshot(sequence);
+
+    // Write beside the target and rename over it, a crash leaves the previous snapshot intact
+    std::string partial = path + ".partial";
+    int fd = ::open(partial.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Cannot create snapshot: " + partial);
+    }
+    std::size_t written = 0;
+    while (written < image.size())
+    {
+        ssize_t n = ::write(fd, image.data() + written, image.size() - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        written += static_cast<std::size_t>(n);
+    }
+    bool ok = written == image.size() && ::fsync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+    if (!ok || ::rename(partial.c_str(), path.c_str()) != 0)
+    {
+        ::unlink(partial.c_str());
+        throw std::runtime_error("Cannot write snapshot: " + path);
+    }
+}
+
+pid_t OrderBook::writeSnapshotInBackground(const std::string &path, std::uint64_t sequence) const
+{
+    // The child sees the book frozen at the fork while the parent keeps matching,
+    // pages are only copied as the parent writes to them
+    pid_t writer = ::fork();
+    if (writer < 0)
+    {
+        throw std::runtime_error("Cannot fork snapshot writer");
+    }
+    if (writer == 0)
+    {
+        int status = 0;
+        try
+        {
+            writeSnapshot(path, sequence);
+        }
+        catch (...)
         {
-            throw std::runtime_error("No ask levels available");
+            status = 1;
         }
-        return askLevels_.begin()->first;
+        ::_exit(status);
     }
+    return writer;
 }
 
-Quantity OrderBook::getSideQuantity(Side side) const
+OrderBook::OrderBook(const OrderSnapshotReader &snapshot)
+    : currentPrice_{snapshot.getHeader().currentPrice}
 {
-    Quantity totalQuantity = 0;
-    if (side == Side::Buy)
+    std::span<const OrderSnapshotLevel> levels = snapshot.getLevels();
+    std::span<const OrderSnapshotOrder> orders = snapshot.getOrders();
+
+    // Levels arrive best first, so each one lands at the back of its tier
+    std::size_t orderIdx = 0;
+    for (std::uint32_t levelIdx = 0; levelIdx < levels.size(); ++levelIdx)
     {
-        for (const auto &bidLevelPair : bidLevels_)
+        const OrderSnapshotLevel &record = levels[levelIdx];
+        Side side = snapshot.getLevelSide(levelIdx);
+        PriceLevel &level = side == Side::Buy ? bidLevels_.getOrCreate(record.price) : askLevels_.getOrCreate(record.price);
+        if (record.orders > orders.size() - orderIdx)
+        {
+            throw std::runtime_error("Corrupt snapshot: level holds more orders than the file");
+        }
+
+        for (std::uint32_t i = 0; i < record.orders; ++i, ++orderIdx)
         {
-            totalQuantity += bidLevelPair.second.getTotalQuantity();
+            const OrderSnapshotOrder &stored = orders[orderIdx];
+            Order order(stored.id, side, record.price, stored.initialQuantity, static_cast<OrderType>(stored.type),
+                        static_cast<Action>(stored.action), stored.timestamp);
+            order.fillOrder(stored.initialQuantity - stored.remainingQuantity);
+            level.appendOrder(order);
         }
+        if (level.getTotalQuantity() != record.totalQuantity)
+        {
+            throw std::runtime_error("Corrupt snapshot: level quantity does not match its orders");
+        }
+        (side == Side::Buy ? bidQuantity_ : askQuantity_) += record.totalQuantity;
     }
-    else
+    if (orderIdx != orders.size())
     {
-        for (const auto &askLevelPair : askLevels_)
+        throw std::runtime_error("Corrupt snapshot: orders not claimed by any level");
+    }
+
+    orderIndex_.reserve(snapshot.getIndex().size());
+    for (const OrderSnapshotIndexEntry &entry : snapshot.getIndex())
+    {
+        if (entry.level >= levels.size())
         {
-            totalQuantity += askLevelPair.second.getTotalQuantity();
+            throw std::runtime_error("Corrupt snapshot: index entry past the last level");
         }
+        orderIndex_.emplace(entry.id, OrderLocation{snapshot.getLevelSide(entry.level), levels[entry.level].price});
     }
-    return totalQuantity;
-}
\ No newline at end of file
+
+    publishTopOfBook();
+    publishDepth();
+}
@@ -1,24 +1,62 @@
+#pragma once
+
 #include "helper.hpp"
+#include "price_levels.hpp"
+#include "order_snapshot.hpp"
+#include "top_of_book.hpp"
+#include "depth_feed.hpp"
+#include <functional>
+
+class OrderJournal;
+class MarketDataPublisher;
 
 class OrderBook
 {
 private:
-    std::map<Price, PriceLevel, std::greater<Price>> bidLevels_;
-    std::map<Price, PriceLevel, std::less<Price>> askLevels_;
+    static constexpr std::size_t HotLevels = 8; // Same as L1_capacity in Hybrid_Memory
+
+    TieredPriceLevels<std::greater<Price>, HotLevels> bidLevels_;
+    TieredPriceLevels<std::less<Price>, HotLevels> askLevels_;
     Price currentPrice_;           
 
+    // Where each resting order lives, so lookups by id don't scan every level
+    struct OrderLocation
+    {
+        Side side;
+        Price price;
+    };
+    std::unordered_map<OrderId, OrderLocation> orderIndex_;
+    OrderJournal *journal_{nullptr};           // Gets every fill, called directly from Match
+    MarketDataPublisher *marketData_{nullptr}; // Same, for the shared-memory feed
+
+    // Resting quantity per side, kept as orders rest, fill and cancel
+    std::uint64_t bidQuantity_{0};
+    std::uint64_t askQuantity_{0};
+    TopOfBookPublisher topOfBook_;
+    std::unique_ptr<DepthFeed> depthFeed_; // Only once enableDepth is called
+
     void calcPrice();
     bool canMatch(const Order &incomingOrder) const;
     bool canMatchFully(const Order &incomingOrder) const;
-    void Match(Order &incomingOrder);
+    void Match(Order &incomingOrder, std::uint64_t sequence);
+    void reportFill(std::uint64_t sequence, const Order &incomingOrder, const Order &bookOrder, Quantity quantity, Price price);
     void cancelGFDOrders(bool isBids);
+    bool removeRestingOrder(OrderId id);
+    std::vector<std::uint8_t> encodeSnapshot(std::uint64_t sequence) const;
+    void publishTopOfBook() noexcept;
+    void publishDepth();
 
 public:
     OrderBook(Price initial_price) : currentPrice_{initial_price} {
         // Instaniate threads for canceling GFD orders at end of day
+        publishTopOfBook();
     }
+    // Warm restart, rebuilds the book a snapshot was taken of without replaying its session
+    explicit OrderBook(const OrderSnapshotReader &snapshot);
     ~OrderBook();
     void processOrder(Order &order);
+    // sequence is the order's journal sequence, from OrderJournal::appendInbound, its fills carry it
+    void processOrder(Order &order, std::uint64_t sequence);
     Price getPrice() const;
     int getLevelQuantity(Side side, Price price) const;
     Price getBestSidePrice(Side side) const;
@@ -26,5 +64,33 @@ public:
     bool isEmpty() const;
     Order getOrder(OrderId id) const;
     double getSpread() const;
+    std::size_t getOrderCount() const;
+
+    // Hot-path queries, never throw and never copy, for callers that expect misses
+    // The pointer is invalidated by the next processOrder
+    const Order *findOrder(OrderId id) const noexcept;
+    std::optional<Price> tryGetBestSidePrice(Side side) const noexcept;
+    std::optional<double> tryGetSpread() const noexcept;
+    Quantity findLevelQuantity(Side side, Price price) const noexcept;
+
+    // Safe to read from any thread while another one matches
+    const TopOfBookPublisher &getTopOfBook() const noexcept { return topOfBook_; }
+
+    // Keep a top-levels view per side and publish its deltas, see depth_feed.hpp
+    // The ring needs room for the 4 * levels deltas one change can produce
+    void enableDepth(std::size_t levels, std::size_t ringCapacity = 1 << 16);
+    const DepthFeed *getDepthFeed() const noexcept { return depthFeed_.get(); }
+    // Matching thread only, the sequence says which deltas the snapshot already includes
+    bool getDepthSnapshot(DepthSnapshot &out) const;
+    // Journal every fill from now on, nullptr stops it. The journal must outlive the book
+    void setJournal(OrderJournal *journal) noexcept { journal_ = journal; }
+    // Publish every fill as a trade, see market_data_shm.hpp. The publisher must outlive the book
+    void setMarketData(MarketDataPublisher *marketData) noexcept { marketData_ = marketData; }
+
+    // sequence is stored in the header, e.g. the last journal entry the book reflects
+    void writeSnapshot(const std::string &path, std::uint64_t sequence = 0) const;
+    // Copy-on-write snapshot from a forked child, matching only pauses for the fork itself
+    // Returns the child's pid for waitForSnapshot
+    pid_t writeSnapshotInBackground(const std::string &path, std::uint64_t sequence = 0) const;
 
 };
\ No newline at end of file
@@ -0,0 +1,309 @@
+#pragma once
+
+#include "helper.hpp"
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+/**
+ * Packed, fixed-width order records shared by the CPU and hardware paths
+ * Field widths mirror the parameters of L1.sv, L2.sv and Matching_Engine.sv, so a
+ * record packed here is bit-for-bit what the RTL sees (minus the location/FoB header)
+ * Prices are stored as integer ticks, market orders use price 0 like the Matching_Core
+ */
+
+// Smallest unsigned integer able to hold a field of the given width
+template <unsigned Bits>
+using PackedUint = std::conditional_t<(Bits <= 8), std::uint8_t,
+                   std::conditional_t<(Bits <= 16), std::uint16_t,
+                   std::conditional_t<(Bits <= 32), std::uint32_t, std::uint64_t>>>;
+
+template <unsigned TimestampBits, unsigned OrderIdBits, unsigned PriceBits, unsigned QtyBits>
+struct PackedOrderLayout
+{
+    static_assert(TimestampBits <= 64 && OrderIdBits <= 64 && PriceBits <= 64 && QtyBits <= 64, "Field wider than 64 bits");
+
+    static constexpr unsigned timestampBits = TimestampBits;
+    static constexpr unsigned orderIdBits = OrderIdBits;
+    static constexpr unsigned priceBits = PriceBits;
+    static constexpr unsigned qtyBits = QtyBits;
+    static constexpr unsigned sideBits = 1;
+    static constexpr unsigned typeBits = 3;
+    static constexpr unsigned actionBits = 3;
+
+    // Bit offsets, least significant field first
+    static constexpr unsigned qtyShift = 0;
+    static constexpr unsigned priceShift = qtyShift + QtyBits;
+    static constexpr unsigned orderIdShift = priceShift + PriceBits;
+    static constexpr unsigned timestampShift = orderIdShift + OrderIdBits;
+    static constexpr unsigned sideShift = timestampShift + TimestampBits;
+    static constexpr unsigned typeShift = sideShift + sideBits;
+    static constexpr unsigned actionShift = typeShift + typeBits;
+    static constexpr unsigned totalBits = actionShift + actionBits;
+    static constexpr unsigned words = (totalBits + 63) / 64;
+
+    static_assert(words <= 2, "Packed order must fit in 16 bytes");
+
+    static constexpr std::uint64_t maxValue(unsigned bits)
+    {
+        return bits >= 64 ? ~std::uint64_t{0} : ((std::uint64_t{1} << bits) - 1);
+    }
+};
+
+// Same widths as the defaults of L1.sv / L2.sv / Matching_Engine.sv
+using RtlOrderLayout = PackedOrderLayout<32, 16, 16, 16>;
+// Widest layout that still fits in 16 bytes, used for traces and captures
+using TraceOrderLayout = PackedOrderLayout<32, 32, 32, 24>;
+
+template <typename Layout>
+class PackedOrder
+{
+public:
+    using Words = std::array<std::uint64_t, Layout::words>;
+
+    PackedOrder() : bits_{} {}
+    explicit PackedOrder(const Words &bits) : bits_{bits} {}
+
+    // Convert a price into ticks, market orders and non-positive prices map to 0
+    static std::uint64_t toTicks(Price price, Price tickSize)
+    {
+        if (price <= 0)
+            return 0;
+        return static_cast<std::uint64_t>(std::llround(price / tickSize));
+    }
+
+    // True if every field of the order fits in the layout without truncation
+    static bool fits(const Order &order, Price tickSize = 0.01)
+    {
+        return order.getId() <= Layout::maxValue(Layout::orderIdBits) &&
+               order.getRemainingQuantity() <= Layout::maxValue(Layout::qtyBits) &&
+               order.getTimestamp() <= Layout::maxValue(Layout::timestampBits) &&
+               toTicks(order.getPrice(), tickSize) <= Layout::maxValue(Layout::priceBits);
+    }
+
+    // Fields wider than the layout are truncated to their low bits, same as the RTL
+    static PackedOrder fromFields(OrderId id, Side side, std::uint64_t priceTicks, Quantity qty, OrderType type, Action action, Timestamp timestamp)
+    {
+        PackedOrder packed;
+        packed.setField(Layout::qtyShift, Layout::qtyBits, qty);
+        packed.setField(Layout::priceShift, Layout::priceBits, type == OrderType::Market ? 0 : priceTicks);
+        packed.setField(Layout::orderIdShift, Layout::orderIdBits, id);
+        packed.setField(Layout::timestampShift, Layout::timestampBits, timestamp);
+        packed.setField(Layout::sideShift, Layout::sideBits, static_cast<std::uint64_t>(side));
+        packed.setField(Layout::typeShift, Layout::typeBits, static_cast<std::uint64_t>(type));
+        packed.setField(Layout::actionShift, Layout::actionBits, static_cast<std::uint64_t>(action));
+        return packed;
+    }
+
+    static PackedOrder pack(const Order &order, Price tickSize = 0.01)
+    {
+        return fromFields(order.getId(), order.getSide(), toTicks(order.getPrice(), tickSize), order.getRemainingQuantity(),
+                          order.getType(), order.getAction(), order.getTimestamp());
+    }
+
+    Order unpack(Price tickSize = 0.01) const
+    {
+        OrderType type = getType();
+        Price price = type == OrderType::Market ? -1 : static_cast<Price>(getPriceTicks()) * tickSize;
+        return Order(getId(), getSide(), price, getQuantity(), type, getAction(), getTimestamp());
+    }
+
+    OrderId getId() const { return getField(Layout::orderIdShift, Layout::orderIdBits); }
+    std::uint64_t getPriceTicks() const { return getField(Layout::priceShift, Layout::priceBits); }
+    Quantity getQuantity() const { return static_cast<Quantity>(getField(Layout::qtyShift, Layout::qtyBits)); }
+    Timestamp getTimestamp() const { return getField(Layout::timestampShift, Layout::timestampBits); }
+    Side getSide() const { return static_cast<Side>(getField(Layout::sideShift, Layout::sideBits)); }
+    OrderType getType() const { return static_cast<OrderType>(getField(Layout::typeShift, Layout::typeBits)); }
+    Action getAction() const { return static_cast<Action>(getField(Layout::actionShift, Layout::actionBits)); }
+
+    void setQuantity(Quantity qty) { setField(Layout::qtyShift, Layout::qtyBits, qty); }
+
+    const Words &getWords() const { return bits_; }
+
+private:
+    Words bits_;
+
+    std::uint64_t getField(unsigned shift, unsigned width) const
+    {
+        unsigned word = shift / 64;
+        unsigned offset = shift % 64;
+        std::uint64_t value = bits_[word] >> offset;
+        // Field straddles the word boundary
+        if (offset != 0 && offset + width > 64)
+        {
+            value |= bits_[word + 1] << (64 - offset);
+        }
+        return value & Layout::maxValue(width);
+    }
+
+    void setField(unsigned shift, unsigned width, std::uint64_t value)
+    {
+        unsigned word = shift / 64;
+        unsigned offset = shift % 64;
+        std::uint64_t mask = Layout::maxValue(width);
+        value &= mask;
+        bits_[word] = (bits_[word] & ~(mask << offset)) | (value << offset);
+        if (offset != 0 && offset + width > 64)
+        {
+            unsigned spill = 64 - offset;
+            bits_[word + 1] = (bits_[word + 1] & ~(mask >> spill)) | (value >> spill);
+        }
+    }
+};
+
+static_assert(sizeof(PackedOrder<RtlOrderLayout>) == 16);
+static_assert(sizeof(PackedOrder<TraceOrderLayout>) == 16);
+static_assert(sizeof(PackedOrder<PackedOrderLayout<16, 16, 16, 16>>) == 16);
+static_assert(sizeof(PackedOrder<PackedOrderLayout<8, 16, 16, 16>>) == 8);
+
+/**
+ * Structure-of-arrays batch of packed orders
+ * Each field lives in its own contiguous array so hot loops (price scans, quantity sums)
+ * only pull in the bytes they touch
+ */
+template <typename Layout>
+class PackedOrderBatch
+{
+public:
+    using TimestampField = PackedUint<Layout::timestampBits>;
+    using OrderIdField = PackedUint<Layout::orderIdBits>;
+    using PriceField = PackedUint<Layout::priceBits>;
+    using QtyField = PackedUint<Layout::qtyBits>;
+
+    void reserve(std::size_t count)
+    {
+        timestamps_.reserve(count);
+        ids_.reserve(count);
+        prices_.reserve(count);
+        quantities_.reserve(count);
+        flags_.reserve(count);
+    }
+
+    void clear()
+    {
+        timestamps_.clear();
+        ids_.clear();
+        prices_.clear();
+        quantities_.clear();
+        flags_.clear();
+    }
+
+    std::size_t size() const { return ids_.size(); }
+    bool empty() const { return ids_.empty(); }
+
+    void push(const PackedOrder<Layout> &order)
+    {
+        timestamps_.push_back(static_cast<TimestampField>(order.getTimestamp()));
+        ids_.push_back(static_cast<OrderIdField>(order.getId()));
+        prices_.push_back(static_cast<PriceField>(order.getPriceTicks()));
+        quantities_.push_back(static_cast<QtyField>(order.getQuantity()));
+        flags_.push_back(static_cast<std::uint8_t>(static_cast<unsigned>(order.getSide()) |
+                                                   (static_cast<unsigned>(order.getType()) << 1) |
+                                                   (static_cast<unsigned>(order.getAction()) << 4)));
+    }
+
+    void push(const Order &order, Price tickSize = 0.01)
+    {
+        push(PackedOrder<Layout>::pack(order, tickSize));
+    }
+
+    PackedOrder<Layout> get(std::size_t idx) const
+    {
+        return PackedOrder<Layout>::fromFields(ids_[idx], getSide(idx), prices_[idx], quantities_[idx],
+                                               getType(idx), getAction(idx), timestamps_[idx]);
+    }
+
+    Order unpack(std::size_t idx, Price tickSize = 0.01) const
+    {
+        OrderType type = getType(idx);
+        Price price = type == OrderType::Market ? -1 : static_cast<Price>(prices_[idx]) * tickSize;
+        return Order(ids_[idx], getSide(idx), price, quantities_[idx], type, getAction(idx), timestamps_[idx]);
+    }
+
+    Side getSide(std::size_t idx) const { return static_cast<Side>(flags_[idx] & 0x1); }
+    OrderType getType(std::size_t idx) const { return static_cast<OrderType>((flags_[idx] >> 1) & 0x7); }
+    Action getAction(std::size_t idx) const { return static_cast<Action>((flags_[idx] >> 4) & 0x7); }
+
+    const std::vector<TimestampField> &getTimestamps() const { return timestamps_; }
+    const std::vector<OrderIdField> &getIds() const { return ids_; }
+    const std::vector<PriceField> &getPrices() const { return prices_; }
+    const std::vector<QtyField> &getQuantities() const { return quantities_; }
+
+private:
+    std::vector<TimestampField> timestamps_;
+    std::vector<OrderIdField> ids_;
+    std::vector<PriceField> prices_; // Ticks, 0 for market orders
+    std::vector<QtyField> quantities_;
+    std::vector<std::uint8_t> flags_; // Side | Type << 1 | Action << 4
+};
+
+/**
+ * Capture files: a small header followed by raw packed records
+ * The header carries the layout widths so a capture is never read with the wrong layout
+ */
+struct PackedCaptureHeader
+{
+    char magic[4];
+    std::uint8_t timestampBits;
+    std::uint8_t orderIdBits;
+    std::uint8_t priceBits;
+    std::uint8_t qtyBits;
+    std::uint64_t count;
+};
+
+template <typename Layout>
+void writePackedCapture(const std::string &path, const PackedOrderBatch<Layout> &batch)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+    {
+        throw std::runtime_error("Cannot open capture file for writing: " + path);
+    }
+
+    PackedCaptureHeader header{{'P', 'K', 'O', 'R'},
+                               static_cast<std::uint8_t>(Layout::timestampBits),
+                               static_cast<std::uint8_t>(Layout::orderIdBits),
+                               static_cast<std::uint8_t>(Layout::priceBits),
+                               static_cast<std::uint8_t>(Layout::qtyBits),
+                               batch.size()};
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (std::size_t i = 0; i < batch.size(); ++i)
+    {
+        PackedOrder<Layout> record = batch.get(i);
+        const auto &words = record.getWords();
+        out.write(reinterpret_cast<const char *>(words.data()), sizeof(words));
+    }
+}
+
+template <typename Layout>
+PackedOrderBatch<Layout> readPackedCapture(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open())
+    {
+        throw std::runtime_error("Cannot open capture file for reading: " + path);
+    }
+
+    PackedCaptureHeader header{};
+    in.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!in || std::memcmp(header.magic, "PKOR", 4) != 0)
+    {
+        throw std::runtime_error("Not a packed order capture: " + path);
+    }
+    if (header.timestampBits != Layout::timestampBits || header.orderIdBits != Layout::orderIdBits ||
+        header.priceBits != Layout::priceBits || header.qtyBits != Layout::qtyBits)
+    {
+        throw std::runtime_error("Capture layout does not match requested layout: " + path);
+    }
+
+    PackedOrderBatch<Layout> batch;
+    batch.reserve(header.count);
+    typename PackedOrder<Layout>::Words words{};
+    for (std::uint64_t i = 0; i < header.count && in.read(reinterpret_cast<char *>(words.data()), sizeof(words)); ++i)
+    {
+        batch.push(PackedOrder<Layout>(words));
+    }
+    return batch;
+}
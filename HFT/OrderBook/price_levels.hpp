@@ -0,0 +1,194 @@
+#pragma once
+
+#include "helper.hpp"
+#include <array>
+
+/**
+ * Two-tier storage for one side of the book, modelled on the L1/L2 split in Hybrid_Memory
+ * The HotLevels levels nearest the touch live in a small fixed array whose prices share one
+ * cache line, everything deeper lives in a std::map. Levels are promoted and demoted as the
+ * touch moves, so best-price, canMatch and Match only ever look at the hot array
+ *
+ * Invariants: hot prices are sorted best first, every hot price is better than every cold
+ * price, and the cold tier is only used once the hot tier is full
+ * References to hot levels are invalidated by any insert or erase
+ */
+template <typename Compare, std::size_t HotLevels = 8>
+class TieredPriceLevels
+{
+private:
+    using ColdLevels = std::map<Price, PriceLevel, Compare>;
+
+    alignas(64) std::array<Price, HotLevels> hotPrices_{};
+    std::size_t hotCount_{0};
+    alignas(64) std::array<std::optional<PriceLevel>, HotLevels> hotLevels_;
+    ColdLevels coldLevels_;
+    Compare compare_;
+
+    void insertHot(std::size_t idx, Price price)
+    {
+        if (hotCount_ == HotLevels)
+        {
+            // Worst hot level drops to the cold tier
+            coldLevels_.emplace(hotPrices_[HotLevels - 1], std::move(*hotLevels_[HotLevels - 1]));
+            hotLevels_[HotLevels - 1].reset();
+            hotCount_--;
+        }
+
+        for (std::size_t i = hotCount_; i > idx; --i)
+        {
+            hotPrices_[i] = hotPrices_[i - 1];
+            hotLevels_[i].emplace(std::move(*hotLevels_[i - 1]));
+        }
+        hotPrices_[idx] = price;
+        hotLevels_[idx].emplace(price);
+        hotCount_++;
+    }
+
+    void eraseHot(std::size_t idx)
+    {
+        for (std::size_t i = idx; i + 1 < hotCount_; ++i)
+        {
+            hotPrices_[i] = hotPrices_[i + 1];
+            hotLevels_[i].emplace(std::move(*hotLevels_[i + 1]));
+        }
+        hotCount_--;
+        hotLevels_[hotCount_].reset();
+
+        // Best cold level moves up to refill the hot tier
+        if (!coldLevels_.empty())
+        {
+            auto it = coldLevels_.begin();
+            hotPrices_[hotCount_] = it->first;
+            hotLevels_[hotCount_].emplace(std::move(it->second));
+            hotCount_++;
+            coldLevels_.erase(it);
+        }
+    }
+
+    std::size_t findHot(Price price) const
+    {
+        for (std::size_t i = 0; i < hotCount_; ++i)
+        {
+            if (hotPrices_[i] == price)
+                return i;
+        }
+        return HotLevels;
+    }
+
+    // Only a full hot tier can have anything behind it
+    bool mayBeCold(Price price) const
+    {
+        return hotCount_ == HotLevels && compare_(hotPrices_[HotLevels - 1], price);
+    }
+
+    template <bool IsConst>
+    class Iterator
+    {
+    private:
+        using Owner = std::conditional_t<IsConst, const TieredPriceLevels, TieredPriceLevels>;
+        using ColdIterator = std::conditional_t<IsConst, typename ColdLevels::const_iterator, typename ColdLevels::iterator>;
+
+        Owner *owner_;
+        std::size_t hotIdx_;
+        ColdIterator coldIt_;
+
+    public:
+        using value_type = PriceLevel;
+        using reference = std::conditional_t<IsConst, const PriceLevel &, PriceLevel &>;
+
+        Iterator(Owner *owner, std::size_t hotIdx, ColdIterator coldIt)
+            : owner_{owner}, hotIdx_{hotIdx}, coldIt_{coldIt}
+        {
+        }
+
+        reference operator*() const
+        {
+            return hotIdx_ < owner_->hotCount_ ? *owner_->hotLevels_[hotIdx_] : coldIt_->second;
+        }
+
+        Iterator &operator++()
+        {
+            if (hotIdx_ < owner_->hotCount_)
+                ++hotIdx_;
+            else
+                ++coldIt_;
+            return *this;
+        }
+
+        bool operator==(const Iterator &other) const { return hotIdx_ == other.hotIdx_ && coldIt_ == other.coldIt_; }
+        bool operator!=(const Iterator &other) const { return !(*this == other); }
+    };
+
+public:
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    bool empty() const { return hotCount_ == 0; }
+    std::size_t size() const { return hotCount_ + coldLevels_.size(); }
+    std::size_t hotSize() const { return hotCount_; }
+
+    // Requires !empty()
+    Price bestPrice() const { return hotPrices_[0]; }
+    PriceLevel &best() { return *hotLevels_[0]; }
+    const PriceLevel &best() const { return *hotLevels_[0]; }
+    void popBest() { eraseHot(0); }
+
+    PriceLevel *find(Price price) noexcept
+    {
+        std::size_t idx = findHot(price);
+        if (idx != HotLevels)
+            return &*hotLevels_[idx];
+        if (mayBeCold(price))
+        {
+            auto it = coldLevels_.find(price);
+            if (it != coldLevels_.end())
+                return &it->second;
+        }
+        return nullptr;
+    }
+
+    const PriceLevel *find(Price price) const noexcept
+    {
+        return const_cast<TieredPriceLevels *>(this)->find(price);
+    }
+
+    PriceLevel &getOrCreate(Price price)
+    {
+        for (std::size_t i = 0; i < hotCount_; ++i)
+        {
+            if (hotPrices_[i] == price)
+                return *hotLevels_[i];
+            if (compare_(price, hotPrices_[i]))
+            {
+                insertHot(i, price);
+                return *hotLevels_[i];
+            }
+        }
+
+        if (hotCount_ < HotLevels)
+        {
+            insertHot(hotCount_, price);
+            return *hotLevels_[hotCount_ - 1];
+        }
+        return coldLevels_.try_emplace(price, price).first->second;
+    }
+
+    void erase(Price price)
+    {
+        std::size_t idx = findHot(price);
+        if (idx != HotLevels)
+        {
+            eraseHot(idx);
+        }
+        else
+        {
+            coldLevels_.erase(price);
+        }
+    }
+
+    iterator begin() { return iterator(this, 0, coldLevels_.begin()); }
+    iterator end() { return iterator(this, hotCount_, coldLevels_.end()); }
+    const_iterator begin() const { return const_iterator(this, 0, coldLevels_.begin()); }
+    const_iterator end() const { return const_iterator(this, hotCount_, coldLevels_.end()); }
+};
@@ -1,7 +1,8 @@
 #include "simulator.hpp"
 
 MarketSimulator::MarketSimulator(Price initialPrice, SimulationMode simMode, SimulationParamaters simParameters, std::string reportFile)
-    : orderBook_(initialPrice), simMode_(simMode), simParameters_(simParameters), reportFile_(reportFile)
+    : orderBook_(initialPrice), simMode_(simMode), simParameters_(simParameters),
+      orderFlow_(simParameters, initialPrice, static_cast<std::uint64_t>(time(nullptr))), reportFile_(reportFile)
 {
 
     // Initialize simulation
@@ -112,42 +113,18 @@ time_t MarketSimulator::PoissonNextArrival()
 
 void MarketSimulator::createAdd()
 {
-    Side side = (rand() % 2 == 0) ? Side::Buy : Side::Sell;
-    OrderType type = (rand() % 2 == 0) ? OrderType::Market : OrderType::GoodTillCancel;
-    OrderId orderId = static_cast<std::uint64_t>(rand());
-    Quantity quantity = calcOrderQuantity();
-    if (type == OrderType::GoodTillCancel)
-    {
-        Price price = calcOrderPrice();
-        switch (rand() % 4)
-        {
-        case 0:
-            type = OrderType::GoodTillCancel;
-            break;
-        case 1:
-            type = OrderType::FillAndKill;
-            break;
-        case 2:
-            type = OrderType::FillOrKill;
-            break;
-        case 3:
-            type = OrderType::GoodForDay;
-            break;
-        }
-        Order order(orderId, side, price, quantity, type, Action::Add);
-        outgoingOrders_.push(order);
-    }
-    else
-    {
-        Order order(orderId, side, quantity, type);
-        outgoingOrders_.push(order);
-    }
+    outgoingOrders_.push(orderFlow_.nextAdd(orderBook_.getPrice()));
 }
 
 void MarketSimulator::createModifyOrCancel()
 {
     OrderId existingOrderId = static_cast<std::uint64_t>(rand());
-    Order existingOrder = orderBook_.getOrder(existingOrderId);
+    const Order *found = orderBook_.findOrder(existingOrderId);
+    if (!found)
+    {
+        return; // Random id that isn't resting, most of them
+    }
+    const Order &existingOrder = *found;
 
     if (rand() % 2 == 0)
     {
@@ -167,28 +144,23 @@ void MarketSimulator::createModifyOrCancel()
 
 Price MarketSimulator::calcOrderPrice()
 {
-    Price basePrice = orderBook_.getPrice();
-    std::default_random_engine generator(static_cast<unsigned>(time(0)));
-    std::normal_distribution<double> distribution(0.0, TICK_SIZE * simParameters_.PriceVolatility);
-
-    double priceFluctuation = distribution(generator);
-    return static_cast<Price>(basePrice + priceFluctuation);
+    return orderFlow_.nextPrice(orderBook_.getPrice());
 }
 
 Quantity MarketSimulator::calcOrderQuantity()
 {
-    std::default_random_engine generator(static_cast<unsigned>(time(0)));
-    std::uniform_int_distribution<int> distribution(1, simParameters_.OrderVolume * 100); // Max volume scaled
-
-    return static_cast<Quantity>(distribution(generator)) / orderBook_.getPrice(); // High price usually correlates to lower quantity
+    return orderFlow_.nextQuantity(orderBook_.getPrice());
 }
 
 void MarketSimulator::updateReport()
 {
     marketReport_.currentPrice = orderBook_.getPrice();
-    marketReport_.spread = orderBook_.getSpread();
-    marketReport_.bestBidQuantity = orderBook_.getLevelQuantity(Side::Buy, orderBook_.getBestSidePrice(Side::Buy));
-    marketReport_.bestAskQuantity = orderBook_.getLevelQuantity(Side::Sell, orderBook_.getBestSidePrice(Side::Sell));
+    // A one-sided book reports no spread and nothing at the missing touch
+    std::optional<Price> bestBid = orderBook_.tryGetBestSidePrice(Side::Buy);
+    std::optional<Price> bestAsk = orderBook_.tryGetBestSidePrice(Side::Sell);
+    marketReport_.spread = orderBook_.tryGetSpread().value_or(0.0);
+    marketReport_.bestBidQuantity = bestBid ? orderBook_.findLevelQuantity(Side::Buy, *bestBid) : 0;
+    marketReport_.bestAskQuantity = bestAsk ? orderBook_.findLevelQuantity(Side::Sell, *bestAsk) : 0;
     marketReport_.totalBidQuantity = orderBook_.getSideQuantity(Side::Buy);
     marketReport_.totalAskQuantity = orderBook_.getSideQuantity(Side::Sell);
 }
@@ -1,12 +1,5 @@
 #include "orderbook.hpp"
-
-#define TICK_SIZE 0.01
-
-struct SimulationParamaters{  // Ranges 1 - 5
-    int OrderFrequency;    
-    int OrderVolume;    
-    int PriceVolatility;    
-};
+#include "order_flow.hpp"
 
 enum class SimulationMode{
     Normal,
@@ -42,6 +35,7 @@ private:
     SimulationMode simMode_;
     MarketState marketState_;
     SimulationParamaters simParameters_;
+    OrderFlowModel orderFlow_;
     std::string reportFile_;
     Report marketReport_;
 
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "helper.hpp"
+#include <array>
+#include <atomic>
+#include <cstring>
+
+/**
+ * Top-of-book record the matching thread publishes after every change
+ * Readers on other threads never look at the book itself, only at this record, which sits on
+ * cache lines of its own. Publication is a seqlock: the writer makes the sequence odd, stores
+ * the record and makes it even again, a reader copies the record between two reads of the
+ * sequence and keeps the copy only if they match and are even. The writer never waits for
+ * readers and a single read attempt never waits for the writer
+ * Record words are relaxed atomics so a torn copy is a retry, never a data race
+ */
+
+struct TopOfBook
+{
+    std::uint64_t sequence; // Publications so far, 0 before the first
+    Price bestBid;          // Only meaningful when hasBid
+    Price bestAsk;          // Only meaningful when hasAsk
+    Price mid;              // Only meaningful when both sides are present
+    double spread;          // Only meaningful when both sides are present
+    Price lastPrice;        // The book's current price, see OrderBook::getPrice
+    Quantity bestBidQuantity;
+    Quantity bestAskQuantity;
+    std::uint64_t totalBidQuantity;
+    std::uint64_t totalAskQuantity;
+    bool hasBid;
+    bool hasAsk;
+};
+
+static_assert(std::is_trivially_copyable_v<TopOfBook>, "TopOfBook is copied word by word");
+
+class TopOfBookPublisher
+{
+private:
+    static constexpr std::size_t Words = (sizeof(TopOfBook) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+    alignas(64) std::atomic<std::uint64_t> version_{0}; // Odd while a publication is in progress
+    std::array<std::atomic<std::uint64_t>, Words> words_{};
+    // Keeps the writer's next fields off the readers' lines
+    alignas(64) TopOfBook last_{};
+
+public:
+    TopOfBookPublisher() = default;
+    TopOfBookPublisher(const TopOfBookPublisher &) = delete;
+    TopOfBookPublisher &operator=(const TopOfBookPublisher &) = delete;
+
+    // Writer only, skips the publication when nothing a reader can see has changed
+    void publish(TopOfBook record) noexcept
+    {
+        record.sequence = last_.sequence;
+        if (last_.sequence != 0 && std::memcmp(&record, &last_, sizeof(TopOfBook)) == 0)
+        {
+            return;
+        }
+        record.sequence = last_.sequence + 1;
+        last_ = record;
+
+        std::array<std::uint64_t, Words> raw{};
+        std::memcpy(raw.data(), &record, sizeof(TopOfBook));
+
+        std::uint64_t version = version_.load(std::memory_order_relaxed);
+        version_.store(version + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (std::size_t i = 0; i < Words; ++i)
+        {
+            words_[i].store(raw[i], std::memory_order_relaxed);
+        }
+        version_.store(version + 2, std::memory_order_release);
+    }
+
+    // One wait-free attempt, false if it overlapped a publication
+    bool tryRead(TopOfBook &out) const noexcept
+    {
+        std::uint64_t before = version_.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+            return false;
+        }
+        std::array<std::uint64_t, Words> raw;
+        for (std::size_t i = 0; i < Words; ++i)
+        {
+            raw[i] = words_[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (version_.load(std::memory_order_relaxed) != before)
+        {
+            return false;
+        }
+        std::memcpy(&out, raw.data(), sizeof(TopOfBook));
+        return true;
+    }
+
+    // Retries until a consistent copy is taken, publications are a few stores so this is brief
+    TopOfBook read() const noexcept
+    {
+        TopOfBook record;
+        while (!tryRead(record))
+        {
+        }
+        return record;
+    }
+};
@@ -0,0 +1,182 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * Bump arena for the Strassen buffers
+ * One block is reserved up front, sized by the caller from the dimensions, depth and cutoff,
+ * and every matrix, scratch level and packing buffer is carved out of it. Freeing the most
+ * recent allocation rolls the offset back, anything else is reclaimed when the arena is reset
+ * or released to an earlier mark, so a multiply leaves the arena as it found it and the next
+ * one reuses the same, already faulted in, pages
+ * The offset is atomic so the workers of the parallel path can share one arena. A request
+ * that does not fit falls back to the heap and is counted, it never fails
+ */
+
+#define ARENA_ALIGN 64 // Bytes, one cache line
+
+typedef struct
+{
+    char *base;
+    size_t capacity;           // Bytes reserved up front
+    atomic_size_t used;        // Bump offset
+    atomic_size_t peak;        // Highest offset since init or the last arena_reset
+    atomic_size_t allocations; // Requests served from the arena
+    atomic_size_t overflows;   // Requests that did not fit and went to the heap
+
+} Strassen_arena;
+
+// Arena the Strassen allocations come from, NULL for the plain heap
+Strassen_arena *strassen_arena = NULL;
+
+size_t arena_round(size_t bytes)
+{
+    return (bytes + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+}
+
+void arena_init(Strassen_arena *arena, size_t bytes)
+{
+    arena->capacity = arena_round(bytes);
+    arena->base = (arena->capacity > 0) ? (char *)aligned_alloc(ARENA_ALIGN, arena->capacity) : NULL;
+    if (arena->base == NULL)
+    {
+        arena->capacity = 0; // Everything goes to the heap
+    }
+    atomic_init(&arena->used, 0);
+    atomic_init(&arena->peak, 0);
+    atomic_init(&arena->allocations, 0);
+    atomic_init(&arena->overflows, 0);
+}
+
+void arena_destroy(Strassen_arena *arena)
+{
+    if (strassen_arena == arena)
+    {
+        strassen_arena = NULL;
+    }
+    free(arena->base);
+    arena->base = NULL;
+    arena->capacity = 0;
+}
+
+/**
+ * Make arena the source of Strassen allocations, returns the previous one
+ * Bind before the workers of a parallel multiply start, not while they run
+ */
+Strassen_arena *arena_bind(Strassen_arena *arena)
+{
+    Strassen_arena *previous = strassen_arena;
+    strassen_arena = arena;
+    return previous;
+}
+
+int arena_owns(const Strassen_arena *arena, const void *ptr)
+{
+    return arena != NULL && (const char *)ptr >= arena->base && (const char *)ptr < arena->base + arena->capacity;
+}
+
+/**
+ * NULL when the request does not fit
+ */
+void *arena_alloc(Strassen_arena *arena, size_t bytes)
+{
+    bytes = arena_round(bytes);
+    size_t used = atomic_load(&arena->used);
+    do
+    {
+        if (bytes > arena->capacity - used)
+        {
+            atomic_fetch_add(&arena->overflows, 1);
+            return NULL;
+        }
+    } while (!atomic_compare_exchange_weak(&arena->used, &used, used + bytes));
+
+    size_t peak = atomic_load(&arena->peak);
+    while (used + bytes > peak && !atomic_compare_exchange_weak(&arena->peak, &peak, used + bytes))
+    {
+    }
+    atomic_fetch_add(&arena->allocations, 1);
+    return arena->base + used;
+}
+
+/**
+ * Only the most recent allocation is given back, the rest waits for a reset
+ */
+void arena_free(Strassen_arena *arena, void *ptr, size_t bytes)
+{
+    size_t offset = (size_t)((char *)ptr - arena->base);
+    size_t end = offset + arena_round(bytes);
+    atomic_compare_exchange_strong(&arena->used, &end, offset);
+}
+
+size_t arena_mark(Strassen_arena *arena)
+{
+    return (arena != NULL) ? atomic_load(&arena->used) : 0;
+}
+
+/**
+ * Drop everything allocated since mark, no other thread may be allocating
+ */
+void arena_release(Strassen_arena *arena, size_t mark)
+{
+    if (arena != NULL)
+    {
+        atomic_store(&arena->used, mark);
+    }
+}
+
+/**
+ * Empty the arena between multiplications, peak and counters start over
+ */
+void arena_reset(Strassen_arena *arena)
+{
+    atomic_store(&arena->used, 0);
+    atomic_store(&arena->peak, 0);
+    atomic_store(&arena->allocations, 0);
+    atomic_store(&arena->overflows, 0);
+}
+
+size_t arena_peak(const Strassen_arena *arena)
+{
+    return atomic_load(&arena->peak);
+}
+
+void arena_report(const Strassen_arena *arena, FILE *out)
+{
+    fprintf(out, "Arena: peak %zu of %zu bytes, %zu allocations, %zu from the heap\n",
+            atomic_load(&arena->peak), arena->capacity, atomic_load(&arena->allocations), atomic_load(&arena->overflows));
+}
+
+/**
+ * Aligned allocation from the bound arena, or the heap if there is none or it is full
+ */
+void *strassen_alloc(size_t bytes)
+{
+    if (bytes == 0)
+    {
+        return NULL;
+    }
+    void *ptr = (strassen_arena != NULL) ? arena_alloc(strassen_arena, bytes) : NULL;
+    return (ptr != NULL) ? ptr : aligned_alloc(ARENA_ALIGN, arena_round(bytes));
+}
+
+void strassen_free(void *ptr, size_t bytes)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+    if (arena_owns(strassen_arena, ptr))
+    {
+        arena_free(strassen_arena, ptr, bytes);
+    }
+    else
+    {
+        free(ptr);
+    }
+}
+
+#endif
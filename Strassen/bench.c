@@ -0,0 +1,421 @@
+#define _XOPEN_SOURCE 700 // getrusage
+
+#include "main.h"
+
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/**
+ * Benchmark sweep: naive and packed classical against the Strassen variants
+ * Every (shape, method) case runs in a forked child, so the peak RSS it reports is that
+ * case's own, and sends its result back over a pipe. Each multiply gets a fresh arena sized
+ * for it, whose counters give the allocations made per multiply. Output is CSV on stdout
+ *
+ * Usage: bench [-t threads] [-c cutoff] [-r repeats] [-m method,method,...] [n | mxkxn ...]
+ */
+
+#define BENCH_REPEATS 3                   // Best of this many runs per case
+#define BENCH_NAIVE_LIMIT 1024            // Naive is skipped when any dimension is larger
+#define BENCH_REFERENCE_LIMIT (1LL << 31) // Above this many multiply-adds, check by projection
+
+typedef enum
+{
+    BENCH_NAIVE,
+    BENCH_GEMM,
+    BENCH_STRASSEN,
+    BENCH_WINOGRAD,
+    BENCH_PARALLEL,
+    BENCH_PAR_WINOGRAD,
+    BENCH_METHODS
+
+} Bench_method;
+
+static const char *bench_names[BENCH_METHODS] = {"naive", "gemm", "strassen", "winograd", "parallel", "par-winograd"};
+
+// Sizes swept when none are given, non-powers of two on either side of the powers
+static const int bench_sizes[] = {64, 100, 128, 255, 256, 384, 500, 512, 513, 768, 1000, 1024, 1500, 2048};
+
+typedef struct
+{
+    double seconds;          // Best of the repeats
+    long peak_rss_kb;        // Of the child running the case, inputs included
+    size_t allocations;      // Per multiply, served by the arena
+    size_t heap_allocations; // Per multiply, did not fit the arena
+    size_t arena_peak;       // Bytes
+    int matched;             // 1 if the result matched the reference
+
+} Bench_result;
+
+typedef struct
+{
+    int m, k, n;
+    int cutoff;
+    int threads;
+    int repeats;
+
+} Bench_config;
+
+int bench_parallel(Bench_method method)
+{
+    return method == BENCH_PARALLEL || method == BENCH_PAR_WINOGRAD;
+}
+
+size_t bench_arena_size(Bench_method method, const Bench_config *config)
+{
+    switch (method)
+    {
+    case BENCH_GEMM:
+        return arena_round(gemm_pack_size(config->n) * sizeof(int));
+    case BENCH_STRASSEN:
+    case BENCH_PARALLEL:
+        return strassen_arena_size(config->m, config->k, config->n, config->cutoff, STRASSEN_CLASSIC, bench_parallel(method) ? config->threads : 1);
+    case BENCH_WINOGRAD:
+    case BENCH_PAR_WINOGRAD:
+        return strassen_arena_size(config->m, config->k, config->n, config->cutoff, STRASSEN_WINOGRAD, bench_parallel(method) ? config->threads : 1);
+    default:
+        return 0;
+    }
+}
+
+void bench_multiply(Bench_method method, Matrix A, Matrix B, Matrix C, const Bench_config *config)
+{
+    switch (method)
+    {
+    case BENCH_NAIVE:
+        matrix_mult_base(A, B, C);
+        break;
+    case BENCH_GEMM:
+    {
+        size_t pack_bytes = gemm_pack_size(C.cols) * sizeof(int);
+        int *pack = (int *)strassen_alloc(pack_bytes);
+        gemm_packed(A.data, A.stride, B.data, B.stride, C.data, C.stride, C.rows, A.cols, C.cols, pack);
+        strassen_free(pack, pack_bytes);
+        break;
+    }
+    case BENCH_STRASSEN:
+        strassen_multiply(A, B, C, config->cutoff, STRASSEN_CLASSIC);
+        break;
+    case BENCH_WINOGRAD:
+        strassen_multiply(A, B, C, config->cutoff, STRASSEN_WINOGRAD);
+        break;
+    case BENCH_PARALLEL:
+        strassen_parallel_multiply(A, B, C, config->cutoff, STRASSEN_CLASSIC, config->threads);
+        break;
+    case BENCH_PAR_WINOGRAD:
+        strassen_parallel_multiply(A, B, C, config->cutoff, STRASSEN_WINOGRAD, config->threads);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * Freivalds' check, C x == A (B x) for a couple of random x, in wrapping 64-bit arithmetic
+ * O(n^2) instead of a full reference multiply for the largest shapes
+ */
+int bench_project(Matrix A, Matrix B, Matrix C)
+{
+    int m = C.rows, k = A.cols, n = C.cols;
+    uint64_t *x = (uint64_t *)malloc((size_t)n * sizeof(uint64_t));
+    uint64_t *bx = (uint64_t *)malloc((size_t)k * sizeof(uint64_t));
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    int matched = (x != NULL && bx != NULL);
+
+    for (int round = 0; matched && round < 2; round++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            x[j] = state;
+        }
+        for (int p = 0; p < k; p++)
+        {
+            uint64_t sum = 0;
+            for (int j = 0; j < n; j++)
+            {
+                sum += (uint64_t)(int64_t)MAT(B, p, j) * x[j];
+            }
+            bx[p] = sum;
+        }
+        for (int i = 0; matched && i < m; i++)
+        {
+            uint64_t lhs = 0, rhs = 0;
+            for (int j = 0; j < n; j++)
+            {
+                lhs += (uint64_t)(int64_t)MAT(C, i, j) * x[j];
+            }
+            for (int p = 0; p < k; p++)
+            {
+                rhs += (uint64_t)(int64_t)MAT(A, i, p) * bx[p];
+            }
+            matched = (lhs == rhs);
+        }
+    }
+
+    free(x);
+    free(bx);
+    return matched;
+}
+
+int bench_matches(Matrix C, Matrix reference)
+{
+    for (int i = 0; i < C.rows; i++)
+    {
+        if (memcmp(MAT_ROW(C, i), MAT_ROW(reference, i), C.cols * sizeof(int)) != 0)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Body of the child process for one case, reference is NULL above the reference limit
+ */
+Bench_result bench_case(Bench_method method, Matrix A, Matrix B, const Matrix *reference, const Bench_config *config)
+{
+    Bench_result result = {0};
+    Matrix C;
+    matrix_init(&C, config->m, config->n, 1);
+
+    Strassen_arena arena;
+    arena_init(&arena, bench_arena_size(method, config));
+    arena_bind(&arena);
+    for (int r = 0; r < config->repeats; r++)
+    {
+        arena_reset(&arena); // Counters cover the last multiply only
+        double start = seconds_now();
+        bench_multiply(method, A, B, C, config);
+        double elapsed = seconds_now() - start;
+        if (r == 0 || elapsed < result.seconds)
+        {
+            result.seconds = elapsed;
+        }
+    }
+    result.allocations = atomic_load(&arena.allocations);
+    result.heap_allocations = atomic_load(&arena.overflows);
+    result.arena_peak = arena_peak(&arena);
+    arena_destroy(&arena);
+
+    result.matched = (reference != NULL) ? bench_matches(C, *reference) : bench_project(A, B, C);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    result.peak_rss_kb = usage.ru_maxrss;
+    matrix_free(&C);
+    return result;
+}
+
+/**
+ * Run one case in a child process, returns 0, or -1 if the child died before reporting
+ */
+int bench_fork(Bench_method method, Matrix A, Matrix B, const Matrix *reference, const Bench_config *config, Bench_result *result)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        return -1;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        close(fds[0]);
+        Bench_result child = bench_case(method, A, B, reference, config);
+        ssize_t written = write(fds[1], &child, sizeof(child));
+        _exit(written == (ssize_t)sizeof(child) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    ssize_t got = read(fds[0], result, sizeof(*result));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return (got == (ssize_t)sizeof(*result) && WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : -1;
+}
+
+/**
+ * "n" for a cube, or "mxkxn"
+ */
+int bench_parse_shape(const char *text, Bench_config *config)
+{
+    int m, k, n;
+    int fields = sscanf(text, "%dx%dx%d", &m, &k, &n);
+    if (fields == 1)
+    {
+        k = n = m;
+    }
+    else if (fields != 3)
+    {
+        return -1;
+    }
+    if (m <= 0 || k <= 0 || n <= 0)
+    {
+        return -1;
+    }
+    config->m = m;
+    config->k = k;
+    config->n = n;
+    return 0;
+}
+
+/**
+ * Comma separated method names into a mask, -1 for an unknown one
+ */
+int bench_parse_methods(char *list)
+{
+    int mask = 0;
+    for (char *name = strtok(list, ","); name != NULL; name = strtok(NULL, ","))
+    {
+        int found = 0;
+        for (int method = 0; method < BENCH_METHODS; method++)
+        {
+            if (strcmp(name, bench_names[method]) == 0)
+            {
+                mask |= 1 << method;
+                found = 1;
+            }
+        }
+        if (!found)
+        {
+            return -1;
+        }
+    }
+    return mask;
+}
+
+void bench_shape(Bench_config config, int methods)
+{
+    Matrix A, B, reference;
+    matrix_init(&A, config.m, config.k, 1);
+    matrix_init(&B, config.k, config.n, 1);
+
+    // Small signed values, no product of any size swept here overflows an int
+    srand(1);
+    for (int i = 0; i < config.m; i++)
+    {
+        for (int j = 0; j < config.k; j++)
+        {
+            MAT(A, i, j) = rand() % 101 - 50;
+        }
+    }
+    for (int i = 0; i < config.k; i++)
+    {
+        for (int j = 0; j < config.n; j++)
+        {
+            MAT(B, i, j) = rand() % 101 - 50;
+        }
+    }
+
+    long long ops = (long long)config.m * config.k * config.n;
+    int exact = ops <= BENCH_REFERENCE_LIMIT;
+    if (exact)
+    {
+        matrix_init(&reference, config.m, config.n, 1);
+        matrix_mult_base(A, B, reference);
+    }
+
+    int largest = (config.m > config.k) ? config.m : config.k;
+    largest = (largest > config.n) ? largest : config.n;
+    for (int method = 0; method < BENCH_METHODS; method++)
+    {
+        if (!(methods & (1 << method)) || (method == BENCH_NAIVE && largest > BENCH_NAIVE_LIMIT))
+        {
+            continue;
+        }
+
+        Bench_result result;
+        int threads = bench_parallel(method) ? config.threads : 1;
+        printf("%d,%d,%d,%s,%d,%d,", config.m, config.k, config.n, bench_names[method], threads, config.cutoff);
+        if (bench_fork(method, A, B, exact ? &reference : NULL, &config, &result) != 0)
+        {
+            printf(",,,,,,%s,crashed\n", exact ? "naive" : "projection");
+            fflush(stdout);
+            continue;
+        }
+        printf("%.6f,%.3f,%ld,%zu,%zu,%zu,%s,%s\n", result.seconds, 2.0 * ops / result.seconds * 1e-9, result.peak_rss_kb,
+               result.allocations, result.heap_allocations, result.arena_peak, exact ? "naive" : "projection", result.matched ? "ok" : "mismatch");
+        fflush(stdout);
+    }
+
+    if (exact)
+    {
+        matrix_free(&reference);
+    }
+    matrix_free(&A);
+    matrix_free(&B);
+}
+
+int main(int argc, char **argv)
+{
+    Bench_config config;
+    config.cutoff = strassen_load_cutoff(STRASSEN_TUNE_FILE, STRASSEN_DEFAULT_CUTOFF);
+    config.threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    config.repeats = BENCH_REPEATS;
+    int methods = (1 << BENCH_METHODS) - 1;
+
+    int first_shape = 1;
+    while (first_shape + 1 < argc && argv[first_shape][0] == '-')
+    {
+        const char *flag = argv[first_shape];
+        char *value = argv[first_shape + 1];
+        if (strcmp(flag, "-t") == 0)
+        {
+            config.threads = atoi(value);
+        }
+        else if (strcmp(flag, "-c") == 0)
+        {
+            config.cutoff = atoi(value);
+        }
+        else if (strcmp(flag, "-r") == 0)
+        {
+            config.repeats = atoi(value);
+        }
+        else if (strcmp(flag, "-m") == 0)
+        {
+            methods = bench_parse_methods(value);
+        }
+        else
+        {
+            break;
+        }
+        first_shape += 2;
+    }
+
+    if (config.threads <= 0 || config.cutoff <= 0 || config.repeats <= 0 || methods <= 0 || (first_shape < argc && argv[first_shape][0] == '-'))
+    {
+        fprintf(stderr, "Usage: %s [-t threads] [-c cutoff] [-r repeats] [-m method,...] [n | mxkxn ...]\n", argv[0]);
+        fprintf(stderr, "Methods: naive, gemm, strassen, winograd, parallel, par-winograd\n");
+        return 1;
+    }
+
+    printf("m,k,n,method,threads,cutoff,seconds,gops,peak_rss_kb,allocations,heap_allocations,arena_peak_bytes,reference,check\n");
+    if (first_shape == argc)
+    {
+        for (size_t s = 0; s < sizeof(bench_sizes) / sizeof(bench_sizes[0]); s++)
+        {
+            config.m = config.k = config.n = bench_sizes[s];
+            bench_shape(config, methods);
+        }
+        return 0;
+    }
+
+    for (int a = first_shape; a < argc; a++)
+    {
+        if (bench_parse_shape(argv[a], &config) != 0)
+        {
+            fprintf(stderr, "Error: %s is not a size or an mxkxn shape.\n", argv[a]);
+            return 1;
+        }
+        bench_shape(config, methods);
+    }
+    return 0;
+}
@@ -0,0 +1,572 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define GEMM_X86 1
+#include <immintrin.h>
+#else
+#define GEMM_X86 0
+#endif
+
+/**
+ * int32 GEMM for the leaves of the Strassen recursion, C = A * B on strided row-major data
+ * B is packed KC rows at a time into column panels NR wide, so the micro-kernel streams one
+ * contiguous, aligned panel while broadcasting MR elements of A, and keeps an MR x NR tile of
+ * C in registers for the whole KC loop. The widest kernel the CPU supports is picked at
+ * runtime, the environment variable STRASSEN_KERNEL=scalar|avx2|avx512 overrides it
+ *
+ *   scalar   4 x 8   plain C, left to the compiler
+ *   avx2     6 x 16  12 ymm accumulators
+ *   avx512   8 x 32  16 zmm accumulators
+ */
+
+#define GEMM_KC 256    // Rows of B per packed block
+#define GEMM_NC 512    // Columns of B per packed block
+#define GEMM_NR_MAX 32 // Widest panel of any kernel
+#define GEMM_MR_MAX 8  // Tallest tile of any kernel
+
+// C[0..mr) x [0..nr) += A[0..mr) x [0..kc) * packed panel
+typedef void (*Gemm_micro)(const int *A, int lda, const int *Bp, int kc, int *C, int ldc, int mr, int nr);
+
+typedef struct
+{
+    const char *name;
+    int mr;
+    int nr;
+    Gemm_micro micro;
+
+} Gemm_kernel;
+
+/**
+ * Row kernels for the O(n^2) side of Strassen: operand sums, quadrant combinations and
+ * packing. Each one makes a single pass over contiguous rows with no per-element branches,
+ * signs are decided once per call. AVX2 versions are used when the CPU has it, unless
+ * STRASSEN_KERNEL=scalar. out may alias any input, elements are independent
+ */
+int row_simd_level = 0;
+pthread_once_t row_simd_once = PTHREAD_ONCE_INIT;
+
+void row_simd_resolve(void)
+{
+#if GEMM_X86
+    const char *force = getenv("STRASSEN_KERNEL");
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && (force == NULL || strcmp(force, "scalar") != 0))
+    {
+        row_simd_level = 1;
+    }
+#endif
+}
+
+int row_simd(void)
+{
+    pthread_once(&row_simd_once, row_simd_resolve);
+    return row_simd_level;
+}
+
+void row_add_scalar(int *out, const int *x, const int *y, int n)
+{
+    for (int j = 0; j < n; j++)
+    {
+        out[j] = x[j] + y[j];
+    }
+}
+
+void row_sub_scalar(int *out, const int *x, const int *y, int n)
+{
+    for (int j = 0; j < n; j++)
+    {
+        out[j] = x[j] - y[j];
+    }
+}
+
+// Negation by mask: (v ^ m) - m is -v when m is all ones and v when it is zero
+void row_sum4_scalar(int *out, const int *x0, const int *x1, int m1, const int *x2, int m2, const int *x3, int m3, int n)
+{
+    for (int j = 0; j < n; j++)
+    {
+        out[j] = x0[j] + ((x1[j] ^ m1) - m1) + ((x2[j] ^ m2) - m2) + ((x3[j] ^ m3) - m3);
+    }
+}
+
+void row_axpy_scalar(int *out, const int *x, int a, int n)
+{
+    for (int j = 0; j < n; j++)
+    {
+        out[j] += a * x[j];
+    }
+}
+
+#if GEMM_X86
+
+__attribute__((target("avx2"))) void row_axpy_avx2(int *out, const int *x, int a, int n)
+{
+    __m256i av = _mm256_set1_epi32(a);
+    int j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        __m256i o = _mm256_loadu_si256((const __m256i *)(out + j));
+        o = _mm256_add_epi32(o, _mm256_mullo_epi32(av, _mm256_loadu_si256((const __m256i *)(x + j))));
+        _mm256_storeu_si256((__m256i *)(out + j), o);
+    }
+    row_axpy_scalar(out + j, x + j, a, n - j);
+}
+
+__attribute__((target("avx2"))) void row_add_avx2(int *out, const int *x, const int *y, int n)
+{
+    int j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        __m256i v = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(x + j)), _mm256_loadu_si256((const __m256i *)(y + j)));
+        _mm256_storeu_si256((__m256i *)(out + j), v);
+    }
+    row_add_scalar(out + j, x + j, y + j, n - j);
+}
+
+__attribute__((target("avx2"))) void row_sub_avx2(int *out, const int *x, const int *y, int n)
+{
+    int j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        __m256i v = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(x + j)), _mm256_loadu_si256((const __m256i *)(y + j)));
+        _mm256_storeu_si256((__m256i *)(out + j), v);
+    }
+    row_sub_scalar(out + j, x + j, y + j, n - j);
+}
+
+__attribute__((target("avx2"))) void row_sum4_avx2(int *out, const int *x0, const int *x1, int m1, const int *x2, int m2, const int *x3, int m3, int n)
+{
+    __m256i v1 = _mm256_set1_epi32(m1), v2 = _mm256_set1_epi32(m2), v3 = _mm256_set1_epi32(m3);
+    int j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        __m256i t1 = _mm256_sub_epi32(_mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(x1 + j)), v1), v1);
+        __m256i t2 = _mm256_sub_epi32(_mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(x2 + j)), v2), v2);
+        __m256i t3 = _mm256_sub_epi32(_mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(x3 + j)), v3), v3);
+        __m256i v = _mm256_add_epi32(_mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(x0 + j)), t1), _mm256_add_epi32(t2, t3));
+        _mm256_storeu_si256((__m256i *)(out + j), v);
+    }
+    row_sum4_scalar(out + j, x0 + j, x1 + j, m1, x2 + j, m2, x3 + j, m3, n - j);
+}
+
+#endif
+
+/**
+ * out = x + sign * y, a sign of 0 copies x and leaves y unread
+ */
+void row_combine(int *out, const int *x, const int *y, int sign, int n)
+{
+    if (sign == 0)
+    {
+        if (out != x)
+        {
+            memmove(out, x, n * sizeof(int));
+        }
+        return;
+    }
+
+#if GEMM_X86
+    if (row_simd())
+    {
+        if (sign > 0)
+        {
+            row_add_avx2(out, x, y, n);
+        }
+        else
+        {
+            row_sub_avx2(out, x, y, n);
+        }
+        return;
+    }
+#endif
+    if (sign > 0)
+    {
+        row_add_scalar(out, x, y, n);
+    }
+    else
+    {
+        row_sub_scalar(out, x, y, n);
+    }
+}
+
+/**
+ * out = x0 + s1 * x1 + s2 * x2 + s3 * x3, signs are +1 or -1
+ * One pass for the four-term quadrants, e.g. C11 = M1 + M4 - M5 + M7
+ */
+void row_combine4(int *out, const int *x0, const int *x1, int s1, const int *x2, int s2, const int *x3, int s3, int n)
+{
+    int m1 = -(s1 < 0), m2 = -(s2 < 0), m3 = -(s3 < 0);
+#if GEMM_X86
+    if (row_simd())
+    {
+        row_sum4_avx2(out, x0, x1, m1, x2, m2, x3, m3, n);
+        return;
+    }
+#endif
+    row_sum4_scalar(out, x0, x1, m1, x2, m2, x3, m3, n);
+}
+
+/**
+ * out += a * x, the rank-1 updates left over by odd dimensions
+ */
+void row_axpy(int *out, const int *x, int a, int n)
+{
+#if GEMM_X86
+    if (row_simd())
+    {
+        row_axpy_avx2(out, x, a, n);
+        return;
+    }
+#endif
+    row_axpy_scalar(out, x, a, n);
+}
+
+/**
+ * Ints of packing buffer needed for a product with n columns
+ */
+size_t gemm_pack_size(int n)
+{
+    int nc = (n < GEMM_NC) ? n : GEMM_NC;
+    int panels = (nc + GEMM_NR_MAX - 1) / GEMM_NR_MAX;
+    return (size_t)GEMM_KC * panels * GEMM_NR_MAX;
+}
+
+/**
+ * Copy a kc x nc block of B + sign * B2 into panels of nr columns, zero padding the last one
+ * With a sign of 0 B2 is ignored, otherwise the operand sum is formed while packing and never
+ * stored as a matrix of its own
+ */
+void gemm_pack_b(const int *B, int ldb, const int *B2, int ldb2, int sign, int kc, int nc, int nr, int *pack)
+{
+    for (int j0 = 0; j0 < nc; j0 += nr)
+    {
+        int width = (nc - j0 < nr) ? nc - j0 : nr;
+        for (int p = 0; p < kc; p++)
+        {
+            const int *b = B + (size_t)p * ldb + j0;
+            const int *b2 = (sign != 0) ? B2 + (size_t)p * ldb2 + j0 : NULL;
+            row_combine(pack, b, b2, sign, width);
+            if (width < nr)
+            {
+                memset(pack + width, 0, (nr - width) * sizeof(int));
+            }
+            pack += nr;
+        }
+    }
+}
+
+/**
+ * Add a full register tile held in tile (MR x NR, row-major) into the valid mr x nr part of C
+ */
+void gemm_store_edge(const int *tile, int tile_nr, int *C, int ldc, int mr, int nr)
+{
+    for (int r = 0; r < mr; r++)
+    {
+        for (int j = 0; j < nr; j++)
+        {
+            C[(size_t)r * ldc + j] += tile[r * tile_nr + j];
+        }
+    }
+}
+
+void gemm_micro_scalar(const int *A, int lda, const int *Bp, int kc, int *C, int ldc, int mr, int nr)
+{
+    int tile[4][8] = {{0}};
+    const int *a[4];
+    for (int r = 0; r < 4; r++)
+    {
+        a[r] = A + (size_t)((r < mr) ? r : 0) * lda; // Missing rows repeat row 0 and are dropped on store
+    }
+
+    for (int p = 0; p < kc; p++)
+    {
+        const int *b = Bp + p * 8;
+        for (int r = 0; r < 4; r++)
+        {
+            int av = a[r][p];
+            for (int j = 0; j < 8; j++)
+            {
+                tile[r][j] += av * b[j];
+            }
+        }
+    }
+
+    gemm_store_edge(&tile[0][0], 8, C, ldc, mr, nr);
+}
+
+#if GEMM_X86
+
+__attribute__((target("avx2"))) void gemm_micro_avx2(const int *A, int lda, const int *Bp, int kc, int *C, int ldc, int mr, int nr)
+{
+    __m256i c00 = _mm256_setzero_si256(), c01 = _mm256_setzero_si256();
+    __m256i c10 = _mm256_setzero_si256(), c11 = _mm256_setzero_si256();
+    __m256i c20 = _mm256_setzero_si256(), c21 = _mm256_setzero_si256();
+    __m256i c30 = _mm256_setzero_si256(), c31 = _mm256_setzero_si256();
+    __m256i c40 = _mm256_setzero_si256(), c41 = _mm256_setzero_si256();
+    __m256i c50 = _mm256_setzero_si256(), c51 = _mm256_setzero_si256();
+
+    const int *a0 = A;
+    const int *a1 = A + (size_t)((mr > 1) ? 1 : 0) * lda;
+    const int *a2 = A + (size_t)((mr > 2) ? 2 : 0) * lda;
+    const int *a3 = A + (size_t)((mr > 3) ? 3 : 0) * lda;
+    const int *a4 = A + (size_t)((mr > 4) ? 4 : 0) * lda;
+    const int *a5 = A + (size_t)((mr > 5) ? 5 : 0) * lda;
+
+    for (int p = 0; p < kc; p++)
+    {
+        __m256i b0 = _mm256_load_si256((const __m256i *)(Bp + p * 16));
+        __m256i b1 = _mm256_load_si256((const __m256i *)(Bp + p * 16 + 8));
+        __m256i av;
+
+        av = _mm256_set1_epi32(a0[p]);
+        c00 = _mm256_add_epi32(c00, _mm256_mullo_epi32(av, b0));
+        c01 = _mm256_add_epi32(c01, _mm256_mullo_epi32(av, b1));
+        av = _mm256_set1_epi32(a1[p]);
+        c10 = _mm256_add_epi32(c10, _mm256_mullo_epi32(av, b0));
+        c11 = _mm256_add_epi32(c11, _mm256_mullo_epi32(av, b1));
+        av = _mm256_set1_epi32(a2[p]);
+        c20 = _mm256_add_epi32(c20, _mm256_mullo_epi32(av, b0));
+        c21 = _mm256_add_epi32(c21, _mm256_mullo_epi32(av, b1));
+        av = _mm256_set1_epi32(a3[p]);
+        c30 = _mm256_add_epi32(c30, _mm256_mullo_epi32(av, b0));
+        c31 = _mm256_add_epi32(c31, _mm256_mullo_epi32(av, b1));
+        av = _mm256_set1_epi32(a4[p]);
+        c40 = _mm256_add_epi32(c40, _mm256_mullo_epi32(av, b0));
+        c41 = _mm256_add_epi32(c41, _mm256_mullo_epi32(av, b1));
+        av = _mm256_set1_epi32(a5[p]);
+        c50 = _mm256_add_epi32(c50, _mm256_mullo_epi32(av, b0));
+        c51 = _mm256_add_epi32(c51, _mm256_mullo_epi32(av, b1));
+    }
+
+    if (mr == 6 && nr == 16)
+    {
+        __m256i rows[12] = {c00, c01, c10, c11, c20, c21, c30, c31, c40, c41, c50, c51};
+        for (int r = 0; r < 6; r++)
+        {
+            __m256i *c = (__m256i *)(C + (size_t)r * ldc);
+            _mm256_storeu_si256(c, _mm256_add_epi32(_mm256_loadu_si256(c), rows[r * 2]));
+            _mm256_storeu_si256(c + 1, _mm256_add_epi32(_mm256_loadu_si256(c + 1), rows[r * 2 + 1]));
+        }
+        return;
+    }
+
+    _Alignas(32) int tile[6 * 16];
+    __m256i *t = (__m256i *)tile;
+    _mm256_store_si256(t + 0, c00), _mm256_store_si256(t + 1, c01);
+    _mm256_store_si256(t + 2, c10), _mm256_store_si256(t + 3, c11);
+    _mm256_store_si256(t + 4, c20), _mm256_store_si256(t + 5, c21);
+    _mm256_store_si256(t + 6, c30), _mm256_store_si256(t + 7, c31);
+    _mm256_store_si256(t + 8, c40), _mm256_store_si256(t + 9, c41);
+    _mm256_store_si256(t + 10, c50), _mm256_store_si256(t + 11, c51);
+    gemm_store_edge(tile, 16, C, ldc, mr, nr);
+}
+
+__attribute__((target("avx512f"))) void gemm_micro_avx512(const int *A, int lda, const int *Bp, int kc, int *C, int ldc, int mr, int nr)
+{
+    __m512i acc[16];
+    for (int i = 0; i < 16; i++)
+    {
+        acc[i] = _mm512_setzero_si512();
+    }
+
+    const int *a[8];
+    for (int r = 0; r < 8; r++)
+    {
+        a[r] = A + (size_t)((r < mr) ? r : 0) * lda;
+    }
+
+    for (int p = 0; p < kc; p++)
+    {
+        __m512i b0 = _mm512_load_si512((const void *)(Bp + p * 32));
+        __m512i b1 = _mm512_load_si512((const void *)(Bp + p * 32 + 16));
+
+#pragma GCC unroll 8
+        for (int r = 0; r < 8; r++)
+        {
+            __m512i av = _mm512_set1_epi32(a[r][p]);
+            acc[r * 2] = _mm512_add_epi32(acc[r * 2], _mm512_mullo_epi32(av, b0));
+            acc[r * 2 + 1] = _mm512_add_epi32(acc[r * 2 + 1], _mm512_mullo_epi32(av, b1));
+        }
+    }
+
+    if (mr == 8 && nr == 32)
+    {
+        for (int r = 0; r < 8; r++)
+        {
+            int *c = C + (size_t)r * ldc;
+            _mm512_storeu_si512(c, _mm512_add_epi32(_mm512_loadu_si512(c), acc[r * 2]));
+            _mm512_storeu_si512(c + 16, _mm512_add_epi32(_mm512_loadu_si512(c + 16), acc[r * 2 + 1]));
+        }
+        return;
+    }
+
+    _Alignas(64) int tile[8 * 32];
+    for (int i = 0; i < 16; i++)
+    {
+        _mm512_store_si512((void *)(tile + i * 16), acc[i]);
+    }
+    gemm_store_edge(tile, 32, C, ldc, mr, nr);
+}
+
+#endif
+
+Gemm_kernel gemm_selected;
+pthread_once_t gemm_once = PTHREAD_ONCE_INIT;
+
+void gemm_resolve(void)
+{
+    Gemm_kernel scalar = {"scalar", 4, 8, gemm_micro_scalar};
+    Gemm_kernel selected = scalar;
+    const char *force = getenv("STRASSEN_KERNEL");
+
+#if GEMM_X86
+    __builtin_cpu_init();
+    int has_avx2 = __builtin_cpu_supports("avx2");
+    int has_avx512 = __builtin_cpu_supports("avx512f");
+    Gemm_kernel avx2 = {"avx2", 6, 16, gemm_micro_avx2};
+    Gemm_kernel avx512 = {"avx512", 8, 32, gemm_micro_avx512};
+
+    if (force != NULL)
+    {
+        if (strcmp(force, "avx512") == 0 && has_avx512)
+        {
+            selected = avx512;
+        }
+        else if (strcmp(force, "avx2") == 0 && has_avx2)
+        {
+            selected = avx2;
+        }
+    }
+    else if (has_avx512)
+    {
+        selected = avx512;
+    }
+    else if (has_avx2)
+    {
+        selected = avx2;
+    }
+#else
+    (void)force;
+#endif
+
+    gemm_selected = selected;
+}
+
+/**
+ * Widest kernel this CPU runs, chosen once and safe to call from any thread
+ */
+Gemm_kernel gemm_select(void)
+{
+    pthread_once(&gemm_once, gemm_resolve);
+    return gemm_selected;
+}
+
+/**
+ * All m rows of A (from column pc) against one packed kc x nc block of B, added into C
+ */
+void gemm_block(Gemm_kernel kernel, const int *A, int lda, const int *pack, int kc, int nc, int *C, int ldc, int m)
+{
+    for (int jr = 0; jr < nc; jr += kernel.nr)
+    {
+        int nr = (nc - jr < kernel.nr) ? nc - jr : kernel.nr;
+        const int *panel = pack + (size_t)(jr / kernel.nr) * kc * kernel.nr;
+        for (int ir = 0; ir < m; ir += kernel.mr)
+        {
+            int mr = (m - ir < kernel.mr) ? m - ir : kernel.mr;
+            kernel.micro(A + (size_t)ir * lda, lda, panel, kc, C + (size_t)ir * ldc + jr, ldc, mr, nr);
+        }
+    }
+}
+
+/**
+ * C = A * (B + sign * B2), A is m x k, B and B2 are k x n, all row-major with the given strides
+ * pack must hold gemm_pack_size(n) ints and be 64-byte aligned
+ */
+void gemm_packed_sum(const int *A, int lda, const int *B, int ldb, const int *B2, int ldb2, int sign, int *C, int ldc, int m, int k, int n, int *pack)
+{
+    Gemm_kernel kernel = gemm_select();
+
+    for (int i = 0; i < m; i++)
+    {
+        memset(C + (size_t)i * ldc, 0, n * sizeof(int));
+    }
+
+    for (int jc = 0; jc < n; jc += GEMM_NC)
+    {
+        int nc = (n - jc < GEMM_NC) ? n - jc : GEMM_NC;
+        for (int pc = 0; pc < k; pc += GEMM_KC)
+        {
+            int kc = (k - pc < GEMM_KC) ? k - pc : GEMM_KC;
+            const int *b2 = (sign != 0) ? B2 + (size_t)pc * ldb2 + jc : NULL;
+            gemm_pack_b(B + (size_t)pc * ldb + jc, ldb, b2, ldb2, sign, kc, nc, kernel.nr, pack);
+            gemm_block(kernel, A + pc, lda, pack, kc, nc, C + jc, ldc, m);
+        }
+    }
+}
+
+/**
+ * Ints gemm_prepack needs for a k x n B, every block of it packed at once
+ */
+size_t gemm_prepacked_size(int k, int n)
+{
+    Gemm_kernel kernel = gemm_select();
+    return (size_t)k * ((n + kernel.nr - 1) / kernel.nr) * kernel.nr;
+}
+
+/**
+ * Pack the whole of B ahead of time, for a B that is multiplied many times
+ * Block (jc, pc) starts at jc * k + pc * (its width rounded up to panels), GEMM_NC being a
+ * multiple of every kernel's nr
+ */
+void gemm_prepack(const int *B, int ldb, int k, int n, int *packed)
+{
+    Gemm_kernel kernel = gemm_select();
+    for (int jc = 0; jc < n; jc += GEMM_NC)
+    {
+        int nc = (n - jc < GEMM_NC) ? n - jc : GEMM_NC;
+        int width = (nc + kernel.nr - 1) / kernel.nr * kernel.nr;
+        for (int pc = 0; pc < k; pc += GEMM_KC)
+        {
+            int kc = (k - pc < GEMM_KC) ? k - pc : GEMM_KC;
+            gemm_pack_b(B + (size_t)pc * ldb + jc, ldb, NULL, 0, 0, kc, nc, kernel.nr, packed + (size_t)jc * k + (size_t)pc * width);
+        }
+    }
+}
+
+/**
+ * C = A * B with B packed by gemm_prepack, no packing work at all
+ */
+void gemm_prepacked(const int *A, int lda, const int *packed, int *C, int ldc, int m, int k, int n)
+{
+    Gemm_kernel kernel = gemm_select();
+
+    for (int i = 0; i < m; i++)
+    {
+        memset(C + (size_t)i * ldc, 0, n * sizeof(int));
+    }
+
+    for (int jc = 0; jc < n; jc += GEMM_NC)
+    {
+        int nc = (n - jc < GEMM_NC) ? n - jc : GEMM_NC;
+        int width = (nc + kernel.nr - 1) / kernel.nr * kernel.nr;
+        for (int pc = 0; pc < k; pc += GEMM_KC)
+        {
+            int kc = (k - pc < GEMM_KC) ? k - pc : GEMM_KC;
+            gemm_block(kernel, A + pc, lda, packed + (size_t)jc * k + (size_t)pc * width, kc, nc, C + jc, ldc, m);
+        }
+    }
+}
+
+/**
+ * C = A * B
+ */
+void gemm_packed(const int *A, int lda, const int *B, int ldb, int *C, int ldc, int m, int k, int n, int *pack)
+{
+    gemm_packed_sum(A, lda, B, ldb, NULL, 0, 0, C, ldc, m, k, n, pack);
+}
+
+#endif
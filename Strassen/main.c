@@ -1,5 +1,4 @@
 #include "main.h"
-#include "main.hpp"
 
 /**
  * CODING STANDARDS:
@@ -7,36 +6,226 @@
  * 2. Structs are okay but should not have associated functions, i.e no methods
  */
 
+/**
+ * Tile source for the test values, ctx points at the matrix's column count
+ */
+int test_tile_read(void *ctx, int row, int col, int rows, int cols, int *dst, int ld)
+{
+    int width = *(int *)ctx;
+    for (int i = 0; i < rows; i++)
+    {
+        for (int j = 0; j < cols; j++)
+        {
+            dst[(size_t)i * ld + j] = ((size_t)(row + i) * width + col + j) % 101;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Print the result element by element, large ones only get a checksum
+ */
+void print_result(Matrix result)
+{
+    if (result.rows <= PRINT_LIMIT && result.cols <= PRINT_LIMIT)
+    {
+        printf("Resultant Matrix:\n");
+        for (int i = 0; i < result.rows; i++)
+        {
+            for (int j = 0; j < result.cols; j++)
+            {
+                printf("Row %d Col %d: %d\n", i, j, MAT(result, i, j));
+            }
+        }
+    }
+    else
+    {
+        long long checksum = 0;
+        for (int i = 0; i < result.rows; i++)
+        {
+            for (int j = 0; j < result.cols; j++)
+            {
+                checksum += MAT(result, i, j);
+            }
+        }
+        printf("Checksum: %lld\n", checksum);
+    }
+}
+
+/**
+ * Write the per-level counters to path, "-" for stdout
+ */
+void profile_write(const Strassen_profile *profile, const char *path)
+{
+    FILE *out = (strcmp(path, "-") == 0) ? stdout : fopen(path, "w");
+    if (out == NULL)
+    {
+        fprintf(stderr, "Error: cannot write profile to %s\n", path);
+        return;
+    }
+    profile_report(profile, out);
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+}
+
+/**
+ * Streaming multiply of two tile sources, with the arena sized for it
+ */
+int stream_and_print(Tile_source *source_A, Tile_source *source_B, int cutoff)
+{
+    if (source_A->cols != source_B->rows)
+    {
+        fprintf(stderr, "Error: inner dimensions differ, %d x %d times %d x %d.\n", source_A->rows, source_A->cols, source_B->rows, source_B->cols);
+        return 1;
+    }
+
+    printf("Dim check : %d x %d x %d\n", source_A->rows, source_A->cols, source_B->cols);
+    Matrix result;
+    matrix_init(&result, source_A->rows, source_B->cols, 1);
+    Strassen_arena arena;
+    arena_init(&arena, strassen_stream_arena_size(source_A->rows, source_A->cols, source_B->cols, cutoff, STRASSEN_CLASSIC));
+    arena_bind(&arena);
+
+    // The streamed levels run depth-first, so STRASSEN_PROFILE counts them as in dfs mode
+    const char *profile_path = getenv("STRASSEN_PROFILE");
+    Strassen_profile profile;
+    if (profile_path != NULL)
+    {
+        profile_init(&profile);
+        profile_bind(&profile);
+    }
+
+    int status = strassen_stream_multiply(source_A, source_B, result, cutoff, STRASSEN_CLASSIC);
+    if (profile_path != NULL)
+    {
+        profile_bind(NULL);
+    }
+    if (status == 0)
+    {
+        arena_report(&arena, stdout);
+        if (profile_path != NULL)
+        {
+            profile_write(&profile, profile_path);
+        }
+        print_result(result);
+    }
+    else
+    {
+        fprintf(stderr, "Error: reading the input tiles failed.\n");
+    }
+
+    arena_destroy(&arena);
+    matrix_free(&result);
+    return (status == 0) ? 0 : 1;
+}
+
 int main(int argc, char **argv)
 {
     // Error control
-    if (argc != 3)
+    if (argc >= 2 && strcmp(argv[1], "tune") == 0)
     {
-        fprintf(stderr, "Usage: %s <dim1_rows> <dim2_cols>\n", argv[0]);
+        // Time candidate cutoffs on this host and persist the best one
+        int size = (argc >= 3) ? atoi(argv[2]) : STRASSEN_TUNE_SIZE;
+        if (size < 16 || (size & (size - 1)) != 0)
+        {
+            fprintf(stderr, "Error: tuning size must be a power of two of at least 16.\n");
+            return 1;
+        }
+        int cutoff = strassen_tune(size, STRASSEN_TUNE_FILE);
+        printf("Best cutoff: %d, saved to %s\n", cutoff, STRASSEN_TUNE_FILE);
+        return 0;
+    }
+
+    if (argc == 5 && strcmp(argv[1], "save") == 0)
+    {
+        // Write a rows x cols matrix file of test values for load
+        int rows = atoi(argv[2]);
+        int cols = atoi(argv[3]);
+        Tile_source source = {test_tile_read, &cols, rows, cols};
+        if (rows <= 0 || cols <= 0 || matrix_file_write(argv[4], &source) != 0)
+        {
+            fprintf(stderr, "Error: cannot write %s.\n", argv[4]);
+            return 1;
+        }
+        return 0;
+    }
+
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "load") == 0)
+    {
+        // Stream both operands from memory-mapped matrix files
+        int cutoff = (argc == 5) ? atoi(argv[4]) : strassen_load_cutoff(STRASSEN_TUNE_FILE, STRASSEN_DEFAULT_CUTOFF);
+        Mapped_matrix file_A, file_B;
+        if (cutoff <= 0 || mapped_matrix_open(&file_A, argv[2]) != 0)
+        {
+            fprintf(stderr, "Error: %s is not a matrix file, or the cutoff is not positive.\n", argv[2]);
+            return 1;
+        }
+        if (mapped_matrix_open(&file_B, argv[3]) != 0)
+        {
+            fprintf(stderr, "Error: %s is not a matrix file.\n", argv[3]);
+            mapped_matrix_close(&file_A);
+            return 1;
+        }
+        Tile_source source_A = mapped_matrix_source(&file_A);
+        Tile_source source_B = mapped_matrix_source(&file_B);
+        int status = stream_and_print(&source_A, &source_B, cutoff);
+        mapped_matrix_close(&file_A);
+        mapped_matrix_close(&file_B);
+        return status;
+    }
+
+    // Optional third dimension: A is m x k and B is k x n, n defaults to m
+    int has_n = (argc >= 4 && strspn(argv[3], "0123456789") == strlen(argv[3]));
+    int first_option = 3 + has_n;
+    if (argc < 3 || argc > first_option + 3)
+    {
+        fprintf(stderr, "Usage: %s <m> <k> [n] [bfs|dfs|par|winograd|par-winograd|stream] [cutoff] [threads]\n", argv[0]);
+        fprintf(stderr, "       %s tune [size]\n", argv[0]);
+        fprintf(stderr, "       %s save <rows> <cols> <file>\n", argv[0]);
+        fprintf(stderr, "       %s load <A file> <B file> [cutoff]\n", argv[0]);
         return 1;
     }
 
-    int dim1 = atoi(argv[1]);
-    int dim2 = atoi(argv[2]);
+    int m = atoi(argv[1]);
+    int k = atoi(argv[2]);
+    int n = has_n ? atoi(argv[3]) : m;
+    const char *mode = (argc > first_option) ? argv[first_option] : "dfs"; // Depth-first unless asked otherwise
+    int cutoff = (argc > first_option + 1) ? atoi(argv[first_option + 1]) : strassen_load_cutoff(STRASSEN_TUNE_FILE, STRASSEN_DEFAULT_CUTOFF);
+    int threads = (argc > first_option + 2) ? atoi(argv[first_option + 2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
 
-    if (dim1 <= 0 || dim2 <= 0)
+    int parallel = (strcmp(mode, "par") == 0 || strcmp(mode, "par-winograd") == 0);
+    Strassen_variant variant = (strstr(mode, "winograd") != NULL) ? STRASSEN_WINOGRAD : STRASSEN_CLASSIC;
+    if (strcmp(mode, "bfs") != 0 && strcmp(mode, "dfs") != 0 && strcmp(mode, "winograd") != 0 && strcmp(mode, "stream") != 0 && !parallel)
     {
-        fprintf(stderr, "Error: dimensions must be positive integers.\n");
+        fprintf(stderr, "Error: mode must be bfs, dfs, par, winograd, par-winograd or stream.\n");
+        return 1;
+    }
+    if (cutoff <= 0 || threads <= 0)
+    {
+        fprintf(stderr, "Error: cutoff and threads must be positive integers.\n");
         return 1;
     }
 
-    // Input buffers, these are just for testing, in hardware we will stream in values
-    int *input_buffer_A = (int *)malloc(dim1 * dim2 * sizeof(int));
-    int *input_buffer_B = (int *)malloc(dim1 * dim2 * sizeof(int));
-    int i = 0;
+    if (m <= 0 || k <= 0 || n <= 0)
+    {
+        fprintf(stderr, "Error: dimensions must be positive integers.\n");
+        return 1;
+    }
 
-    printf("Dim check : %d\n", dim1 * dim2);
-    for (i = 0; i < (dim1 * dim2); i++)
+    if (strcmp(mode, "stream") == 0)
     {
-        input_buffer_A[i] = i; // Fill bufffers with test values
-        input_buffer_B[i] = i; 
+        // Test values produced tile by tile, as a hardware front end would stream them in
+        Tile_source source_A = {test_tile_read, &k, m, k};
+        Tile_source source_B = {test_tile_read, &n, k, n};
+        return stream_and_print(&source_A, &source_B, cutoff);
     }
 
+    // Input buffers, these are just for testing, stream mode reads tiles instead
+    int *input_buffer_A = (int *)malloc((size_t)m * k * sizeof(int));
+    int *input_buffer_B = (int *)malloc((size_t)k * n * sizeof(int));
+
     if (input_buffer_A == NULL || input_buffer_B == NULL)
     {
         fprintf(stderr, "Error: memory allocation failed.\n");
@@ -45,18 +234,35 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    // Build and pad matrices, col_a = row_b for multiplication
-    Matrix input_matrix_A = matrix_build(input_buffer_A, dim1, dim2);
-    Matrix input_matrix_B = matrix_build(input_buffer_B, dim2, dim1);
-    pad_matrix(&input_matrix_A, dim1, dim2, dim2, dim1);
-    pad_matrix(&input_matrix_B, dim2, dim1, dim1, dim2);
+    printf("Dim check : %d x %d x %d\n", m, k, n);
+    for (size_t i = 0; i < (size_t)m * k; i++)
+    {
+        input_buffer_A[i] = i % 101; // Fill bufffers with test values, kept small so large products don't overflow
+    }
+    for (size_t i = 0; i < (size_t)k * n; i++)
+    {
+        input_buffer_B[i] = i % 101;
+    }
+
+    // Build matrices, col_a = row_b for multiplication
+    Matrix input_matrix_A = matrix_build(input_buffer_A, m, k);
+    Matrix input_matrix_B = matrix_build(input_buffer_B, k, n);
+
+    // Only the breadth-first tree needs square power of two operands, the other modes peel odd edges
+    if (strcmp(mode, "bfs") == 0)
+    {
+        int largest = (m > k) ? m : k;
+        largest = (largest > n) ? largest : n;
+        pad_matrix(&input_matrix_A, m, k, largest, largest);
+        pad_matrix(&input_matrix_B, k, n, largest, largest);
+    }
 
     // Print matrices for debugging
     // for (int i = 0; i < input_matrix_A.rows; i++)
     // {
     //     for (int j = 0; j < input_matrix_A.cols; j++)
     //     {
-    //         printf("%d ", input_matrix_A.matrix[i][j]);
+    //         printf("%d ", MAT(input_matrix_A, i, j));
     //     }
     //     printf("\n");
     // }
@@ -64,39 +270,82 @@ int main(int argc, char **argv)
     // {
     //     for (int j = 0; j < input_matrix_B.cols; j++)
     //     {
-    //         printf("%d ", input_matrix_B.matrix[i][j]);
+    //         printf("%d ", MAT(input_matrix_B, i, j));
     //     }
     //     printf("\n");
     // }
 
-    M_tree sub_Ms;
-    int partition_levels = (int)log2((input_matrix_A.rows < input_matrix_B.rows) ? input_matrix_B.rows : input_matrix_A.rows) - 1;
     Matrix result;
-    result.rows = input_matrix_A.rows;
-    result.cols = input_matrix_B.cols;
-    result.matrix = (int **)malloc(result.rows * sizeof(int *));
-    for (int i = 0; i < result.rows; i++)
+    matrix_init(&result, input_matrix_A.rows, input_matrix_B.cols, 1);
+
+    // Every allocation of the multiply comes out of one arena sized for it up front
+    // The breadth-first tree stops halving once its leaves are at or below the cutoff, or are 2 x 2
+    int max_levels = (int)log2((input_matrix_A.rows < input_matrix_B.rows) ? input_matrix_B.rows : input_matrix_A.rows) - 1;
+    int partition_levels = 1;
+    while (partition_levels < max_levels && (input_matrix_A.rows >> partition_levels) > cutoff)
     {
-        result.matrix[i] = (int *)malloc(result.cols * sizeof(int));
+        partition_levels++;
     }
+    Strassen_arena arena;
+    if (strcmp(mode, "bfs") == 0)
+    {
+        arena_init(&arena, strassen_bfs_arena_size(input_matrix_A.rows, partition_levels));
+    }
+    else
+    {
+        arena_init(&arena, strassen_arena_size(m, k, n, cutoff, variant, parallel ? threads : 1));
+    }
+    arena_bind(&arena);
 
-    // Partition, compute, and get result
-    partition(input_matrix_A, input_matrix_B, &sub_Ms, partition_levels);
-    compute_base(&sub_Ms);
-    compute_result(&sub_Ms, &result, partition_levels);
-
-    // Print result matrix
-    printf("Resultant Matrix:\n");
-    for (int i = 0; i < dim1; i++)
+    // STRASSEN_PROFILE=<file> writes the per-level counters there, "-" for stdout
+    const char *profile_path = getenv("STRASSEN_PROFILE");
+    Strassen_profile profile;
+    if (profile_path != NULL)
     {
-        for (int j = 0; j < dim1; j++)
+        profile_init(&profile);
+        profile_bind(&profile);
+        if (parallel)
         {
-            printf("Row %d Col %d: %d\n", i, j, result.matrix[i][j]);
+            fprintf(stderr, "Warning: STRASSEN_PROFILE only counts the depth-first levels below the parallel tasks.\n");
         }
     }
 
+    if (parallel)
+    {
+        // Upper levels as tasks on a work-stealing pool, depth-first below
+        strassen_parallel_multiply(input_matrix_A, input_matrix_B, result, cutoff, variant, threads);
+    }
+    else if (strcmp(mode, "bfs") != 0)
+    {
+        // One branch at a time with per-level scratch, peak memory O(n^2)
+        strassen_multiply(input_matrix_A, input_matrix_B, result, cutoff, variant);
+    }
+    else
+    {
+        // Partition, compute, and get result
+        M_tree sub_Ms;
+        partition(input_matrix_A, input_matrix_B, &sub_Ms, partition_levels);
+        compute_base(&sub_Ms);
+        compute_result(&sub_Ms, &result, partition_levels);
+    }
+
+    arena_report(&arena, stdout);
+    arena_reset(&arena);
+
+    if (profile_path != NULL)
+    {
+        profile_bind(NULL);
+        profile_write(&profile, profile_path);
+    }
+
+    // Print result matrix, the breadth-first one may still be padded
+    print_result(matrix_view(result, 0, 0, m, n));
+
+    arena_destroy(&arena);
     free(input_buffer_A);
     free(input_buffer_B);
-    free(result.matrix);
+    matrix_free(&input_matrix_A);
+    matrix_free(&input_matrix_B);
+    matrix_free(&result);
     return 0;
 }
\ No newline at end of file
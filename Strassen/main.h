@@ -1,12 +1,38 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "kernels.h"
+#include "profile.h"
+#include "scheduler.h"
+#include "stream.h"
+
+#define STRASSEN_DEFAULT_CUTOFF 64           // Products at or below this size are classical
+#define STRASSEN_TUNE_FILE "strassen.tune"   // Where tuning mode persists the best cutoff
+#define STRASSEN_TUNE_SIZE 1024              // Default matrix size timed by tuning mode
+#define PRINT_LIMIT 64                       // Largest result printed element by element
+
+#define MATRIX_ALIGN ARENA_ALIGN // Bytes, one cache line
+#define MATRIX_ALIGN_INTS (MATRIX_ALIGN / (int)sizeof(int))
+
+// Element (i, j) of a matrix or view
+#define MAT(m, i, j) ((m).data[(size_t)(i) * (m).stride + (j)])
+// Start of row i of a matrix or view
+#define MAT_ROW(m, i) ((m).data + (size_t)(i) * (m).stride)
 
 typedef struct
 {
-    int **matrix;  // 2D array to hold matrix values
+    int *data;     // Contiguous row-major storage, row i starts at data + i * stride
     int rows;      // Number of rows
     int cols;      // Number of columns
+    int stride;    // Elements between the starts of consecutive rows
+    int owner;     // 1 if data was allocated for this matrix, 0 for a view into another one
     int processed; // Flag to indicate if this matrix has been processed
     int sig_r;     // Significant rows
     int sig_c;     // Significant columns
@@ -30,22 +56,65 @@ typedef struct
 
 } M_tree;
 
+/**
+ * The stride is rounded up to a cache line so every row starts aligned
+ */
+int matrix_stride(int cols)
+{
+    return (cols + MATRIX_ALIGN_INTS - 1) / MATRIX_ALIGN_INTS * MATRIX_ALIGN_INTS;
+}
+
+size_t matrix_bytes(int rows, int cols)
+{
+    return (size_t)rows * matrix_stride(cols) * sizeof(int);
+}
+
+/**
+ * Allocate one aligned buffer for a rows x cols matrix, from the bound arena if there is one
+ */
+void matrix_alloc(Matrix *mat, int rows, int cols)
+{
+    mat->rows = rows;
+    mat->cols = cols;
+    mat->stride = matrix_stride(cols);
+    mat->owner = 1;
+    mat->data = (int *)strassen_alloc(matrix_bytes(rows, cols));
+}
+
+void matrix_free(Matrix *mat)
+{
+    if (mat->owner)
+    {
+        strassen_free(mat->data, matrix_bytes(mat->rows, mat->stride));
+    }
+    mat->data = NULL;
+    mat->owner = 0;
+}
+
+/**
+ * Sub-matrix view sharing the parent's storage and stride, nothing is allocated
+ * Used for the quadrants A11, A12, A21, A22
+ */
+Matrix matrix_view(Matrix parent, int row, int col, int rows, int cols)
+{
+    Matrix view = parent;
+    view.data = MAT_ROW(parent, row) + col;
+    view.rows = rows;
+    view.cols = cols;
+    view.sig_r = rows;
+    view.sig_c = cols;
+    view.owner = 0;
+    return view;
+}
+
 void matrix_init(Matrix *mat, int rows, int cols, int num_matrices)
 {
     for (int i = 0; i < num_matrices; i++)
     {
-        mat[i].rows = rows;
-        mat[i].cols = cols;
+        matrix_alloc(&mat[i], rows, cols);
         mat[i].sig_r = rows;
         mat[i].sig_c = cols;
         mat[i].processed = 0; // Initialize as not processed
-
-        // Allocate memory for the 2D array
-        mat[i].matrix = (int **)malloc(rows * sizeof(int *));
-        for (int j = 0; j < rows; j++)
-        {
-            mat[i].matrix[j] = (int *)malloc(cols * sizeof(int));
-        }
     }
 }
 
@@ -56,23 +125,12 @@ void matrix_init(Matrix *mat, int rows, int cols, int num_matrices)
 Matrix matrix_build(int *input_buffer, int dim1, int dim2)
 {
     Matrix mat;
-    mat.rows = dim1;
-    mat.cols = dim2;
-
-    // Allocate memory for the 2D array
-    mat.matrix = (int **)malloc(dim1 * sizeof(int *));
-    for (int i = 0; i < dim1; i++)
-    {
-        mat.matrix[i] = (int *)malloc(dim2 * sizeof(int));
-    }
+    matrix_init(&mat, dim1, dim2, 1);
 
-    // Fill the 2D array with values from the input buffer
+    // Copy the input buffer row by row into the strided storage
     for (int i = 0; i < dim1; i++)
     {
-        for (int j = 0; j < dim2; j++)
-        {
-            mat.matrix[i][j] = input_buffer[i * dim2 + j];
-        }
+        memcpy(MAT_ROW(mat, i), input_buffer + (size_t)i * dim2, dim2 * sizeof(int));
     }
 
     return mat;
@@ -90,52 +148,54 @@ void pad_matrix(Matrix *input_matrix, int rows_A, int cols_A, int rows_B, int co
     input_matrix->sig_c = cols_A;
 
     // Dimensions must be a power of 2 for Strassen's algorithm
-    input_matrix->rows = (int)pow(2, ceil(log2((rows_A < rows_B) ? rows_B : rows_A)));
-    input_matrix->cols = (int)pow(2, ceil(log2((cols_A < cols_B) ? cols_B : cols_A)));
-
-    // Allocate memory for the input_matrix->matrix
-    input_matrix->matrix = (int **)realloc(input_matrix->matrix, input_matrix->rows * sizeof(int *));
-    for (int i = rows_A; i < input_matrix->rows; i++)
-    {
-        input_matrix->matrix[i] = (int *)malloc(input_matrix->cols * sizeof(int));
-    }
+    int padded_rows = (int)pow(2, ceil(log2((rows_A < rows_B) ? rows_B : rows_A)));
+    int padded_cols = (int)pow(2, ceil(log2((cols_A < cols_B) ? cols_B : cols_A)));
 
-    // Fill the input_matrix->matrix
-    for (int i = 0; i < input_matrix->rows; i++)
+    // Move the original values into a buffer of the padded size
+    Matrix padded;
+    matrix_alloc(&padded, padded_rows, padded_cols);
+    for (int i = 0; i < padded_rows; i++)
     {
-        for (int j = 0; j < input_matrix->cols; j++)
+        int *row = MAT_ROW(padded, i);
+        int keep = (i < rows_A) ? cols_A : 0; // Retain original values
+        if (keep > 0)
         {
-
-            if (i < input_matrix->sig_r && j < input_matrix->sig_c)
-            {
-                continue; // Retain original values
-            }
-
-            // Else pad with zeros
-            input_matrix->matrix[i][j] = 0; // Padding with zeros
+            memcpy(row, MAT_ROW(*input_matrix, i), keep * sizeof(int));
         }
+        memset(row + keep, 0, (padded_cols - keep) * sizeof(int)); // Padding with zeros
     }
+
+    matrix_free(input_matrix);
+    input_matrix->data = padded.data;
+    input_matrix->rows = padded_rows;
+    input_matrix->cols = padded_cols;
+    input_matrix->stride = padded.stride;
+    input_matrix->owner = 1;
 }
 
 /**
  * Lowest level parition function
  * Takes in a matrix and outputs a sub-matrix based on the M index
  * Designed to avoid having to create many temporary matrices for A11, A12, etc.
+ * level is the depth of the node the output belongs to, the root's sub-matrices are level 0
  */
-void M_partition(Matrix input_matrix, Matrix *output_matrix, int new_rows, int new_cols, int M_subindex)
+void M_partition(Matrix input_matrix, Matrix *output_matrix, int new_rows, int new_cols, int M_subindex, int level)
 {
+    uint64_t started = profile_start();
+
     // Need to update row/col info
     output_matrix->rows = new_rows;
     output_matrix->cols = new_cols;
+    output_matrix->level = level;
 
-    // Debug
-    // for (int i = 0; i < new_rows; i++)
-    // {
-    //     for (int j = 0; j < new_cols; j++)
-    //     {
-    //         printf("M_partition: input_matrix[%d][%d] = %d\n", i, j, input_matrix.matrix[i][j]);
-    //     }
-    // }
+    // Quadrant views of the input, rows are read sequentially through the shared stride
+    Matrix X11 = matrix_view(input_matrix, 0, 0, new_rows, new_cols);
+    Matrix X12 = matrix_view(input_matrix, 0, new_cols, new_rows, new_cols);
+    Matrix X21 = matrix_view(input_matrix, new_rows, 0, new_rows, new_cols);
+    Matrix X22 = matrix_view(input_matrix, new_rows, new_cols, new_rows, new_cols);
+    Matrix *lhs = NULL;
+    Matrix *rhs = NULL;
+    int sign = 0; // +1 add, -1 subtract, 0 copy
 
     // See strassen algorithm slides for formulas
     switch (M_subindex)
@@ -143,85 +203,52 @@ void M_partition(Matrix input_matrix, Matrix *output_matrix, int new_rows, int n
 
     case 0: // [A11 + A22] = M1a
     case 1: // [B11 + B22] = M1b
-        for (int i = 0; i < (new_rows); i++)
-        {
-            for (int j = 0; j < (new_cols); j++)
-            {
-                output_matrix->matrix[i][j] = input_matrix.matrix[i][j] + input_matrix.matrix[i + new_rows][j + new_cols];
-                // printf("M_partition case 0/1: output_matrix[%d][%d] = %d + %d = %d\n", i, j, input_matrix.matrix[i][j], input_matrix.matrix[i + new_rows][j + new_cols], output_matrix->matrix[i][j]);
-            }
-        }
+        lhs = &X11, rhs = &X22, sign = 1;
         break;
 
     case 2:  // [A21 + A22] = M2a
     case 13: // [B21 + B22] = M7b
-        for (int i = 0; i < (new_rows); i++)
-        {
-            for (int j = 0; j < (new_cols); j++)
-            {
-                output_matrix->matrix[i][j] = input_matrix.matrix[i + new_rows][j] + input_matrix.matrix[i + new_rows][j + new_cols];
-            }
-        }
+        lhs = &X21, rhs = &X22, sign = 1;
         break;
 
     case 3: // [B11] = M2b
     case 4: // [A11] = M3a
-        for (int i = 0; i < (new_rows); i++)
-        {
-            for (int j = 0; j < (new_cols); j++)
-            {
-                output_matrix->matrix[i][j] = input_matrix.matrix[i][j];
-            }
-        }
+        lhs = &X11;
         break;
 
     case 5:  // [B12 - B22] = M3b
     case 12: // [A12 - A22] = M7a
-        for (int i = 0; i < (new_rows); i++)
-        {
-            for (int j = 0; j < (new_cols); j++)
-            {
-                output_matrix->matrix[i][j] = input_matrix.matrix[i][j + new_cols] - input_matrix.matrix[i + new_rows][j + new_cols];
-            }
-        }
+        lhs = &X12, rhs = &X22, sign = -1;
         break;
 
     case 6: // [A22] = M4a
     case 9: // [B22] = M5b
-        for (int i = 0; i < (new_rows); i++)
-        {
-            for (int j = 0; j < (new_cols); j++)
-            {
-                output_matrix->matrix[i][j] = input_matrix.matrix[i + new_rows][j + new_cols];
-            }
-        }
+        lhs = &X22;
         break;
 
     case 7:  // [B21 - B11] = M4b
     case 10: // [A21 - A11] = M6a
-        for (int i = 0; i < (new_rows); i++)
-        {
-            for (int j = 0; j < (new_cols); j++)
-            {
-                output_matrix->matrix[i][j] = input_matrix.matrix[i + new_rows][j] - input_matrix.matrix[i][j];
-            }
-        }
+        lhs = &X21, rhs = &X11, sign = -1;
         break;
 
     case 8:  // [A12 + A11] = M5a
     case 11: // [B12 + B11] = M6b
-        for (int i = 0; i < (new_rows); i++)
-        {
-            for (int j = 0; j < (new_cols); j++)
-            {
-                output_matrix->matrix[i][j] = input_matrix.matrix[i][j + new_cols] + input_matrix.matrix[i][j];
-            }
-        }
+        lhs = &X12, rhs = &X11, sign = 1;
         break;
 
     default:
         printf("Error: Invalid sub-matrix index %d\n", M_subindex);
+        return;
+    }
+
+    for (int i = 0; i < new_rows; i++)
+    {
+        const int *y = (rhs != NULL) ? MAT_ROW(*rhs, i) : NULL;
+        row_combine(MAT_ROW(*output_matrix, i), MAT_ROW(*lhs, i), y, sign, new_cols);
     }
+
+    uint64_t elements = (uint64_t)new_rows * new_cols;
+    profile_record(level, PROFILE_PARTITION, (sign != 0) ? elements : 0, 0, ((sign != 0) ? 2 : 1) * elements * sizeof(int), elements * sizeof(int), started);
 }
 
 /**
@@ -230,16 +257,29 @@ void M_partition(Matrix input_matrix, Matrix *output_matrix, int new_rows, int n
  * E.g. M1a and M1b of node above will form a new child node with 14 sub matrices
  * See strassen algorithm slides for more details
  */
-void matrix_partition(Node current_node, Node *child_node, int new_rows, int new_cols, int M_idx)
+void matrix_partition(Node current_node, Node *child_node, int new_rows, int new_cols, int M_idx, int level)
 {
     // Want to create 14 new sub-matrices for the child node
     for (int sub_mat_idx = 0; sub_mat_idx < 14; sub_mat_idx++)
     {
         // Pull MXa or MXb from parent node to form new sub-matrix
-        M_partition(current_node.sub_ms[M_idx + (sub_mat_idx % 2)], &child_node->sub_ms[sub_mat_idx], new_rows, new_cols, sub_mat_idx);
+        M_partition(current_node.sub_ms[M_idx + (sub_mat_idx % 2)], &child_node->sub_ms[sub_mat_idx], new_rows, new_cols, sub_mat_idx, level);
     }
 }
 
+/**
+ * Allocate a node's 14 dim x dim sub-matrices when it is created
+ * sub_ms[1] later holds the node's product, product_dim x product_dim
+ * level is the node's depth, only used to attribute the allocations when profiling
+ */
+void node_init(Node *node, int dim, int product_dim, int level)
+{
+    matrix_init(&node->sub_ms[0], dim, dim, 1);
+    matrix_init(&node->sub_ms[1], product_dim, product_dim, 1);
+    matrix_init(&node->sub_ms[2], dim, dim, 12);
+    profile_alloc(level, PROFILE_PARTITION, 14, 13 * matrix_bytes(dim, dim) + matrix_bytes(product_dim, product_dim));
+}
+
 /**
  * Free memory allocated for a node's sub-matrices
  */
@@ -247,41 +287,33 @@ void destroy_node(Node *node)
 {
     for (int i = 0; i < 14; i++)
     {
-        for (int j = 0; j < node->sub_ms[i].rows; j++)
-        {
-            free(node->sub_ms[i].matrix[j]);
-            node->sub_ms[i].matrix[j] = NULL;
-        }
-        free(node->sub_ms[i].matrix);
-        node->sub_ms[i].matrix = NULL;
+        matrix_free(&node->sub_ms[i]);
     }
     node->size = 0;
 }
 
 /**
  * Partition input matrices into 2x2 sub-matrices
+ * Nodes are allocated as they are created, at the size of their level
  */
 void partition(Matrix input_matrix_A, Matrix input_matrix_B, M_tree *node_tree, int partition_levels)
 {
 
     int total_nodes = (int)pow(7, (partition_levels - 1)) + 1; // Total number of nodes on bottom level
-    int total_sub_Ms = total_nodes * 14;                       // Each node has 14 sub-matrices
-    node_tree->tree = (Node *)malloc(2 * total_nodes * sizeof(Node));
-    for (int i = 0; i < total_nodes * 2; i++)
-    {
-        matrix_init(node_tree->tree[i].sub_ms, input_matrix_A.rows, input_matrix_A.cols, 14);
-    }
+    node_tree->tree = (Node *)strassen_alloc(2 * total_nodes * sizeof(Node));
+    profile_alloc(0, PROFILE_PARTITION, 1, 2 * total_nodes * sizeof(Node));
 
     // Start with the root node
     int current_level = 0;
     int nodes_in_current_level = 1;
-    int node_index = 0;
     node_tree->top_idx = 0;
 
     // Initialize the root node by partitioning the input matrices
+    int root_dim = input_matrix_A.rows / 2;
+    node_init(&node_tree->tree[0], root_dim, (partition_levels > 1) ? root_dim : input_matrix_A.rows, 0);
     for (int m = 0; m < 14; m++)
     {
-        M_partition(((m % 2 == 0) ? input_matrix_A : input_matrix_B), &node_tree->tree[0].sub_ms[m], (input_matrix_A.rows / 2), (input_matrix_A.cols / 2), m);
+        M_partition(((m % 2 == 0) ? input_matrix_A : input_matrix_B), &node_tree->tree[0].sub_ms[m], (input_matrix_A.rows / 2), (input_matrix_A.cols / 2), m, 0);
     }
     node_tree->size = 1;
     current_level++;
@@ -297,7 +329,8 @@ void partition(Matrix input_matrix_A, Matrix input_matrix_B, M_tree *node_tree,
             for (int m = 0; m < 7; m++) // For each node, create 7 child nodes
             {
                 int child_idx = node_tree->top_idx + (nodes_in_current_level - node) + (7 * node) + m;
-                matrix_partition(node_tree->tree[node_tree->top_idx], &node_tree->tree[child_idx], level_rows, level_cols, m * 2);
+                node_init(&node_tree->tree[child_idx], level_rows, (current_level + 1 < partition_levels) ? level_rows : 2 * level_rows, current_level);
+                matrix_partition(node_tree->tree[node_tree->top_idx], &node_tree->tree[child_idx], level_rows, level_cols, m * 2, current_level);
                 node_tree->size++;
             }
 
@@ -314,39 +347,36 @@ void partition(Matrix input_matrix_A, Matrix input_matrix_B, M_tree *node_tree,
 
 /***
  * Helper function to caluclate final product via intermediates
+ * level is the depth of the node whose product this is
  */
-void calculate_product(Matrix intermediates[7], Matrix *result, int dim1, int dim2)
+void calculate_product(Matrix intermediates[7], Matrix *result, int dim1, int dim2, int level)
 {
+    uint64_t started = profile_start();
 
-    // Fill the result matrix using the intermediates
-    for (int i = 0; i < dim1; i++)
+    // Fill the result matrix one quadrant row at a time, each row is a single pass over the Ms
+    int half_r = dim1 / 2;
+    int half_c = dim2 / 2;
+    for (int i = 0; i < half_r; i++)
     {
-        for (int j = 0; j < dim2; j++)
-        {
-            if (i < dim1 / 2 && j < dim2 / 2) // C11 = M1 + M4 - M5 + M7
-            {
-                result->matrix[i][j] = intermediates[0].matrix[i][j] + intermediates[3].matrix[i][j] - intermediates[4].matrix[i][j] + intermediates[6].matrix[i][j];
-            }
-            else if (i < dim1 / 2 && j >= dim2 / 2) // C12 = M3 + M5
-            {
-                result->matrix[i][j] = intermediates[2].matrix[i][j - dim2 / 2] + intermediates[4].matrix[i][j - dim2 / 2];
-            }
-            else if (i >= dim1 / 2 && j < dim2 / 2) // C21 = M2 + M4
-            {
-                int temp2 = intermediates[1].matrix[i - dim1 / 2][j];
-                int temp3 = intermediates[3].matrix[i - dim1 / 2][j];
-                int temp4 = result->matrix[i][j];
-                result->matrix[i][j] = intermediates[1].matrix[i - dim1 / 2][j] + intermediates[3].matrix[i - dim1 / 2][j];
-            }
-            else // C22 = M1 - M2 + M3 + M6
-            {
-                result->matrix[i][j] = intermediates[0].matrix[i - dim1 / 2][j - dim2 / 2] - intermediates[1].matrix[i - dim1 / 2][j - dim2 / 2] + intermediates[2].matrix[i - dim1 / 2][j - dim2 / 2] + intermediates[5].matrix[i - dim1 / 2][j - dim2 / 2];
-            }
-        }
+        const int *M1 = MAT_ROW(intermediates[0], i), *M2 = MAT_ROW(intermediates[1], i);
+        const int *M3 = MAT_ROW(intermediates[2], i), *M4 = MAT_ROW(intermediates[3], i);
+        const int *M5 = MAT_ROW(intermediates[4], i), *M6 = MAT_ROW(intermediates[5], i);
+        const int *M7 = MAT_ROW(intermediates[6], i);
+        int *top = MAT_ROW(*result, i);
+        int *bottom = MAT_ROW(*result, i + half_r);
+
+        row_combine4(top, M1, M4, 1, M5, -1, M7, 1, half_c);            // C11 = M1 + M4 - M5 + M7
+        row_combine(top + half_c, M3, M5, 1, half_c);                   // C12 = M3 + M5
+        row_combine(bottom, M2, M4, 1, half_c);                         // C21 = M2 + M4
+        row_combine4(bottom + half_c, M1, M2, -1, M3, 1, M6, 1, half_c); // C22 = M1 - M2 + M3 + M6
     }
 
     result->rows = dim1;
     result->cols = dim2;
+
+    // 8 additions per quadrant element, 12 M rows read and 4 C rows written
+    uint64_t elements = (uint64_t)half_r * half_c;
+    profile_record(level, PROFILE_COMBINE, 8 * elements, 0, 12 * elements * sizeof(int), 4 * elements * sizeof(int), started);
 }
 
 /**
@@ -355,14 +385,12 @@ void calculate_product(Matrix intermediates[7], Matrix *result, int dim1, int di
 void matrix_mult(Matrix *A, Matrix *B, Matrix *C)
 {
 
-    int **temp_matrix = (int **)malloc(A->rows * sizeof(int *));
+    // C may alias A, so accumulate into a temporary first
+    Matrix temp_matrix;
+    matrix_alloc(&temp_matrix, A->rows, B->cols);
     for (int i = 0; i < A->rows; i++)
     {
-        temp_matrix[i] = (int *)malloc(B->cols * sizeof(int));
-        for (int j = 0; j < B->cols; j++)
-        {
-            temp_matrix[i][j] = 0; // Initialize to zero
-        }
+        memset(MAT_ROW(temp_matrix, i), 0, B->cols * sizeof(int)); // Initialize to zero
     }
 
     for (int i = 0; i < A->rows; i++)
@@ -371,8 +399,7 @@ void matrix_mult(Matrix *A, Matrix *B, Matrix *C)
         {
             for (int k = 0; k < A->cols; k++)
             {
-                temp_matrix[i][j] += A->matrix[i][k] * B->matrix[k][j];
-                // printf("Multiplying A[%d][%d] * B[%d][%d] and adding to C[%d][%d]: %d * %d = %d\n", i, k, k, j, i, j, A->matrix[i][k], B->matrix[k][j], A->matrix[i][k] * B->matrix[k][j]);
+                MAT(temp_matrix, i, j) += MAT(*A, i, k) * MAT(*B, k, j);
             }
         }
     }
@@ -380,18 +407,11 @@ void matrix_mult(Matrix *A, Matrix *B, Matrix *C)
     // Copy the result to C
     for (int i = 0; i < A->rows; i++)
     {
-        for (int j = 0; j < B->cols; j++)
-        {
-            C->matrix[i][j] = temp_matrix[i][j];
-        }
+        memcpy(MAT_ROW(*C, i), MAT_ROW(temp_matrix, i), B->cols * sizeof(int));
     }
 
     // Free temporary matrix
-    for (int i = 0; i < A->rows; i++)
-    {
-        free(temp_matrix[i]);
-    }
-    free(temp_matrix);
+    matrix_free(&temp_matrix);
 }
 
 /**
@@ -406,15 +426,22 @@ void compute_base(M_tree *tree)
  
         // Iterate through matrices within each node to form bottom layers Ms
         Matrix intermediates[7];
+        int level = tree->tree[node].sub_ms[0].level;
         for (int m = 0; m < 7; m++)
         {
             // Store result in same node, in idx % 7
-            matrix_mult(&tree->tree[node].sub_ms[m * 2], &tree->tree[node].sub_ms[(m * 2) + 1], &tree->tree[node].sub_ms[m * 2]);
-            intermediates[m] = tree->tree[node].sub_ms[m * 2];
+            Matrix *A = &tree->tree[node].sub_ms[m * 2];
+            Matrix *B = &tree->tree[node].sub_ms[(m * 2) + 1];
+            uint64_t started = profile_start();
+            matrix_mult(A, B, A);
+            profile_alloc(level, PROFILE_BASE, 1, matrix_bytes(A->rows, B->cols));
+            profile_record(level, PROFILE_BASE, (uint64_t)A->rows * A->cols * B->cols, (uint64_t)A->rows * A->cols * B->cols,
+                           ((uint64_t)A->rows * A->cols + (uint64_t)B->rows * B->cols) * sizeof(int), (uint64_t)A->rows * B->cols * sizeof(int), started);
+            intermediates[m] = *A;
         }
 
         // Calculate final product matrix for this node and store in head matrix
-        calculate_product(intermediates, &tree->tree[node].sub_ms[1], tree->tree[node].sub_ms[1].rows * 2, tree->tree[node].sub_ms[1].cols * 2);
+        calculate_product(intermediates, &tree->tree[node].sub_ms[1], tree->tree[node].sub_ms[1].rows * 2, tree->tree[node].sub_ms[1].cols * 2, level);
     }
 }
 
@@ -425,7 +452,7 @@ void compute_result(M_tree *tree, Matrix *result, int levels)
 {
 
     int nodes_in_above_level = tree->size / 7;
-    Matrix temp;
+    int level = levels - 2; // Level of the parents being formed, the bottom one is levels - 1
 
     while (nodes_in_above_level >= 1)
     {
@@ -441,21 +468,1579 @@ void compute_result(M_tree *tree, Matrix *result, int levels)
 
             // Calculate final product matrix for this node and store in head matrix
             int parent_node_pos = tree->top_idx - nodes_in_above_level + node;
-            matrix_init(&tree->tree[parent_node_pos].sub_ms[1], tree->tree[tree->top_idx + node].sub_ms[1].rows * 2, tree->tree[tree->top_idx + node].sub_ms[1].cols * 2, 1);
-            calculate_product(intermediates, &tree->tree[parent_node_pos].sub_ms[1], tree->tree[parent_node_pos].sub_ms[1].rows, tree->tree[parent_node_pos].sub_ms[1].cols);
-            temp = tree->tree[parent_node_pos].sub_ms[1];
+            Matrix *product = &tree->tree[parent_node_pos].sub_ms[1];
+            matrix_init(product, tree->tree[tree->top_idx + node].sub_ms[1].rows * 2, tree->tree[tree->top_idx + node].sub_ms[1].cols * 2, 1);
+            profile_alloc(level, PROFILE_COMBINE, 1, matrix_bytes(product->rows, product->cols));
+            calculate_product(intermediates, product, product->rows, product->cols, level);
         }
 
         tree->top_idx -= nodes_in_above_level;
         nodes_in_above_level /= 7;
+        level--;
     }
 
     // Copy the final result to the result matrix
     for (int i = 0; i < result->rows; i++)
     {
-        for (int j = 0; j < result->cols; j++)
+        memcpy(MAT_ROW(*result, i), MAT_ROW(tree->tree[tree->top_idx].sub_ms[1], i), result->cols * sizeof(int));
+    }
+}
+/**
+ * Depth-first Strassen
+ * The breadth-first path above keeps every node of the bottom level alive at once. Here one
+ * M is computed at a time, recursing all the way down before the next one starts, so only a
+ * single branch is ever live. Each level owns three preallocated buffers: the A-side operand
+ * S, the B-side operand T and the product P, which is folded into the C quadrants as soon as
+ * it is computed. Scratch is 3 * (n/2)^2 * (1 + 1/4 + 1/16 + ...) = n^2 ints, so peak memory
+ * stays O(n^2) no matter how deep the recursion goes
+ */
+typedef struct
+{
+    Matrix S; // A-side operand, e.g. A11 + A22
+    Matrix T; // B-side operand, e.g. B11 + B22
+    Matrix P; // S * T
+
+} Level_scratch;
+
+typedef enum
+{
+    STRASSEN_CLASSIC, // Seven products from 18 quadrant additions per level
+    STRASSEN_WINOGRAD // Same products from 15, intermediate sums are reused
+
+} Strassen_variant;
+
+typedef struct
+{
+    Level_scratch *levels;
+    Strassen_variant variant;
+    int depth;  // Strassen levels, products below the last one are classical
+    int cutoff; // Products with any dimension at or below this are classical
+    int *pack;  // B panels for the leaf GEMMs
+    size_t pack_bytes;
+
+} Strassen_scratch;
+
+/**
+ * out = X + sign * Y, sign of 0 copies X
+ * All three may be views, out must not overlap X or Y
+ */
+void matrix_combine(Matrix X, Matrix Y, Matrix out, int sign)
+{
+    for (int i = 0; i < out.rows; i++)
+    {
+        const int *y = (sign != 0) ? MAT_ROW(Y, i) : NULL;
+        row_combine(MAT_ROW(out, i), MAT_ROW(X, i), y, sign, out.cols);
+    }
+}
+
+/**
+ * out1 (+/-)= X and out2 (+/-)= X in one pass, a sign of 0 overwrites that output with X
+ * Each row of X is read from memory once and is still in L1 for the second output
+ */
+void matrix_scatter(Matrix X, Matrix out1, int sign1, Matrix out2, int sign2)
+{
+    for (int i = 0; i < X.rows; i++)
+    {
+        const int *x = MAT_ROW(X, i);
+        int *o1 = MAT_ROW(out1, i);
+        int *o2 = MAT_ROW(out2, i);
+        if (sign1 == 0)
+        {
+            memcpy(o1, x, X.cols * sizeof(int));
+        }
+        else
+        {
+            row_combine(o1, o1, x, sign1, X.cols);
+        }
+
+        if (sign2 == 0)
+        {
+            memcpy(o2, x, X.cols * sizeof(int));
+        }
+        else
+        {
+            row_combine(o2, o2, x, sign2, X.cols);
+        }
+    }
+}
+
+/**
+ * out += sign * X
+ */
+void matrix_accumulate(Matrix X, Matrix out, int sign)
+{
+    for (int i = 0; i < out.rows; i++)
+    {
+        row_combine(MAT_ROW(out, i), MAT_ROW(out, i), MAT_ROW(X, i), sign, out.cols);
+    }
+}
+
+/**
+ * Depth-first forms of the sums above that count against a profile level and stage, like
+ * M_partition and calculate_product do on the breadth-first path. Operand sums of a level
+ * are partition work, folding its products into C is combine work
+ */
+void profiled_combine(Matrix X, Matrix Y, Matrix out, int sign, int level, Profile_stage stage)
+{
+    uint64_t started = profile_start();
+    matrix_combine(X, Y, out, sign);
+    uint64_t elements = (uint64_t)out.rows * out.cols;
+    profile_record(level, stage, (sign != 0) ? elements : 0, 0, ((sign != 0) ? 2 : 1) * elements * sizeof(int), elements * sizeof(int), started);
+}
+
+void profiled_scatter(Matrix X, Matrix out1, int sign1, Matrix out2, int sign2, int level)
+{
+    uint64_t started = profile_start();
+    matrix_scatter(X, out1, sign1, out2, sign2);
+    uint64_t elements = (uint64_t)X.rows * X.cols;
+    uint64_t sums = (sign1 != 0) + (sign2 != 0);
+    profile_record(level, PROFILE_COMBINE, sums * elements, 0, (1 + sums) * elements * sizeof(int), 2 * elements * sizeof(int), started);
+}
+
+void profiled_accumulate(Matrix X, Matrix out, int sign, int level)
+{
+    uint64_t started = profile_start();
+    matrix_accumulate(X, out, sign);
+    uint64_t elements = (uint64_t)out.rows * out.cols;
+    profile_record(level, PROFILE_COMBINE, elements, 0, 2 * elements * sizeof(int), elements * sizeof(int), started);
+}
+
+/**
+ * Classical product for the leaves of the depth-first recursion
+ * C never aliases A or B here, so it is written in place in i-k-j order
+ */
+void matrix_mult_base(Matrix A, Matrix B, Matrix C)
+{
+    for (int i = 0; i < C.rows; i++)
+    {
+        int *c = MAT_ROW(C, i);
+        memset(c, 0, C.cols * sizeof(int));
+        for (int k = 0; k < A.cols; k++)
+        {
+            int a = MAT(A, i, k);
+            const int *b = MAT_ROW(B, k);
+            for (int j = 0; j < C.cols; j++)
+            {
+                c[j] += a * b[j];
+            }
+        }
+    }
+}
+
+/**
+ * Number of levels before a dimension drops to leaf_size or below
+ * Odd dimensions are peeled at each level, so the halves are rounded down
+ */
+int strassen_depth(int m, int k, int n, int leaf_size)
+{
+    int depth = 0;
+    while (m > leaf_size && k > leaf_size && n > leaf_size)
+    {
+        m /= 2;
+        k /= 2;
+        n /= 2;
+        depth++;
+    }
+    return depth;
+}
+
+/**
+ * Allocate the per-level buffers for an m x k by k x n product, done once up front
+ * Any product no larger in each dimension fits, its levels use views of these buffers
+ * Levels above first_level are left empty, for workers that only ever run the lower levels
+ */
+void strassen_scratch_init_from(Strassen_scratch *scratch, int m, int k, int n, int cutoff, int first_level)
+{
+    int depth = strassen_depth(m, k, n, cutoff);
+    size_t pack_ints = gemm_pack_size(n);
+    scratch->depth = depth;
+    scratch->cutoff = cutoff;
+    scratch->variant = STRASSEN_CLASSIC;
+    scratch->levels = (Level_scratch *)strassen_alloc(depth * sizeof(Level_scratch));
+    if (depth > 0)
+    {
+        memset(scratch->levels, 0, depth * sizeof(Level_scratch));
+    }
+    for (int level = 0; level < depth; level++)
+    {
+        m /= 2;
+        k /= 2;
+        n /= 2;
+        if (level < first_level)
+        {
+            continue;
+        }
+        matrix_init(&scratch->levels[level].S, m, k, 1);
+        matrix_init(&scratch->levels[level].T, k, n, 1);
+        matrix_init(&scratch->levels[level].P, m, n, 1);
+    }
+
+    scratch->pack_bytes = pack_ints * sizeof(int);
+    scratch->pack = (int *)strassen_alloc(scratch->pack_bytes);
+}
+
+/**
+ * Bytes strassen_scratch_init_from takes, allocation for allocation
+ */
+size_t strassen_scratch_bytes(int m, int k, int n, int cutoff, int first_level)
+{
+    int depth = strassen_depth(m, k, n, cutoff);
+    size_t bytes = arena_round(depth * sizeof(Level_scratch)) + arena_round(gemm_pack_size(n) * sizeof(int));
+    for (int level = 0; level < depth; level++)
+    {
+        m /= 2;
+        k /= 2;
+        n /= 2;
+        if (level >= first_level)
+        {
+            bytes += matrix_bytes(m, k) + matrix_bytes(k, n) + matrix_bytes(m, n);
+        }
+    }
+    return bytes;
+}
+
+void strassen_scratch_init(Strassen_scratch *scratch, int m, int k, int n, int cutoff)
+{
+    strassen_scratch_init_from(scratch, m, k, n, cutoff, 0);
+}
+
+int strassen_is_leaf(const Strassen_scratch *scratch, int m, int k, int n, int level)
+{
+    return level >= scratch->depth || m <= scratch->cutoff || k <= scratch->cutoff || n <= scratch->cutoff;
+}
+
+/**
+ * Dynamic peeling, fixes up C after the even core (2hm x 2hk times 2hk x 2hn) was multiplied
+ * into its top-left corner. Odd dimensions cost one rank-1 update, one column and one row
+ * of dot products instead of padding the operands out to the next even or power-of-two size
+ */
+void strassen_peel(Matrix A, Matrix B, Matrix C, int hm, int hk, int hn)
+{
+    int m = C.rows, k = A.cols, n = C.cols;
+
+    // Odd k: the core is missing the last column of A times the last row of B
+    if (2 * hk < k)
+    {
+        for (int i = 0; i < 2 * hm; i++)
+        {
+            row_axpy(MAT_ROW(C, i), MAT_ROW(B, k - 1), MAT(A, i, k - 1), 2 * hn);
+        }
+    }
+
+    // Odd n: last column of C for the core rows
+    if (2 * hn < n)
+    {
+        for (int i = 0; i < 2 * hm; i++)
+        {
+            int sum = 0;
+            for (int p = 0; p < k; p++)
+            {
+                sum += MAT(A, i, p) * MAT(B, p, n - 1);
+            }
+            MAT(C, i, n - 1) = sum;
+        }
+    }
+
+    // Odd m: last row of C, every column
+    if (2 * hm < m)
+    {
+        int *c = MAT_ROW(C, m - 1);
+        memset(c, 0, n * sizeof(int));
+        for (int p = 0; p < k; p++)
         {
-            result->matrix[i][j] = tree->tree[tree->top_idx].sub_ms[1].matrix[i][j];
+            row_axpy(c, MAT_ROW(B, p), MAT(A, m - 1, p), n);
         }
     }
-}
\ No newline at end of file
+}
+
+void strassen_scratch_destroy(Strassen_scratch *scratch)
+{
+    // Reverse order of allocation, so an arena can roll every buffer back
+    strassen_free(scratch->pack, scratch->pack_bytes);
+    for (int level = scratch->depth - 1; level >= 0; level--)
+    {
+        matrix_free(&scratch->levels[level].P);
+        matrix_free(&scratch->levels[level].T);
+        matrix_free(&scratch->levels[level].S);
+    }
+    strassen_free(scratch->levels, scratch->depth * sizeof(Level_scratch));
+    scratch->levels = NULL;
+    scratch->pack = NULL;
+    scratch->depth = 0;
+}
+
+void strassen_dfs(Matrix A, Matrix B, Matrix C, Strassen_scratch *scratch, int level);
+
+/**
+ * P = S * (X + sign * Y) one level down, a sign of 0 multiplies by X alone
+ * When the level below is a leaf the B-side sum is formed while the GEMM packs its panels,
+ * otherwise it goes through this level's T buffer
+ */
+void strassen_product(Matrix S, Matrix X, Matrix Y, int sign, Matrix P, Strassen_scratch *scratch, int level)
+{
+    if (strassen_is_leaf(scratch, S.rows, S.cols, X.cols, level + 1))
+    {
+        uint64_t started = profile_start();
+        gemm_packed_sum(S.data, S.stride, X.data, X.stride, Y.data, Y.stride, sign, P.data, P.stride, P.rows, S.cols, P.cols, scratch->pack);
+        uint64_t mults = (uint64_t)P.rows * S.cols * P.cols;
+        uint64_t b_elements = (uint64_t)X.rows * X.cols;
+        profile_record(level + 1, PROFILE_BASE, mults + ((sign != 0) ? b_elements : 0), mults,
+                       ((uint64_t)S.rows * S.cols + ((sign != 0) ? 2 : 1) * b_elements) * sizeof(int), (uint64_t)P.rows * P.cols * sizeof(int), started);
+        return;
+    }
+
+    Matrix B = X;
+    if (sign != 0)
+    {
+        B = matrix_view(scratch->levels[level].T, 0, 0, X.rows, X.cols);
+        profiled_combine(X, Y, B, sign, level, PROFILE_PARTITION);
+    }
+    strassen_dfs(S, B, P, scratch, level + 1);
+}
+
+/**
+ * Second half of a Strassen-Winograd level, once P3, P5, P6 and P7 sit in C11, C22, C12 and
+ * C21 and T2 = B22 - T1 has been formed. P1 goes through P, P4 and P2 through C11
+ */
+void strassen_winograd_finish(Matrix A, Matrix B, Matrix C, Matrix T2, Strassen_scratch *scratch, int level)
+{
+    int hm = A.rows / 2;
+    int hk = A.cols / 2;
+    int hn = B.cols / 2;
+    Matrix A11 = matrix_view(A, 0, 0, hm, hk), A12 = matrix_view(A, 0, hk, hm, hk);
+    Matrix A22 = matrix_view(A, hm, hk, hm, hk);
+    Matrix B11 = matrix_view(B, 0, 0, hk, hn), B21 = matrix_view(B, hk, 0, hk, hn);
+    Matrix C11 = matrix_view(C, 0, 0, hm, hn), C12 = matrix_view(C, 0, hn, hm, hn);
+    Matrix C21 = matrix_view(C, hm, 0, hm, hn), C22 = matrix_view(C, hm, hn, hm, hn);
+    Matrix P = matrix_view(scratch->levels[level].P, 0, 0, hm, hn);
+
+    // P1 = A11 B11 -> P
+    strassen_product(A11, B11, B11, 0, P, scratch, level);
+
+    profiled_accumulate(P, C12, 1, level);                      // U2 = P1 + P6
+    profiled_combine(C12, C21, C21, 1, level, PROFILE_COMBINE); // U3 = U2 + P7
+    profiled_accumulate(C22, C12, 1, level);                    // U4 = U2 + P5
+    profiled_accumulate(C21, C22, 1, level);                    // C22 = U7 = U3 + P5
+    profiled_accumulate(C11, C12, 1, level);                    // C12 = U5 = U4 + P3
+
+    // P4 = A22(T2 - B21) -> C11
+    strassen_product(A22, T2, B21, -1, C11, scratch, level);
+    profiled_accumulate(C11, C21, -1, level);                   // C21 = U6 = U3 - P4
+
+    // P2 = A12 B21 -> C11
+    strassen_product(A12, B21, B21, 0, C11, scratch, level);
+    profiled_accumulate(P, C11, 1, level);                      // C11 = U1 = P1 + P2
+
+    strassen_peel(A, B, C, hm, hk, hn);
+}
+
+/**
+ * Strassen-Winograd level, 8 operand sums and 7 result sums instead of 18 in total
+ * Follows the two-temporary schedule of Boyer, Dumas, Pernet and Zhou: the C quadrants hold
+ * products and partial sums as they are built, S and T hold the chained operand sums
+ * (S2 = S1 - A11, S4 = A12 - S2, T2 = B22 - T1, T4 = T2 - B21) and P holds P1
+ */
+void strassen_dfs_winograd(Matrix A, Matrix B, Matrix C, Strassen_scratch *scratch, int level)
+{
+    int hm = A.rows / 2;
+    int hk = A.cols / 2;
+    int hn = B.cols / 2;
+    Matrix A11 = matrix_view(A, 0, 0, hm, hk), A12 = matrix_view(A, 0, hk, hm, hk);
+    Matrix A21 = matrix_view(A, hm, 0, hm, hk), A22 = matrix_view(A, hm, hk, hm, hk);
+    Matrix B11 = matrix_view(B, 0, 0, hk, hn), B12 = matrix_view(B, 0, hn, hk, hn);
+    Matrix B22 = matrix_view(B, hk, hn, hk, hn);
+    Matrix C11 = matrix_view(C, 0, 0, hm, hn), C12 = matrix_view(C, 0, hn, hm, hn);
+    Matrix C21 = matrix_view(C, hm, 0, hm, hn), C22 = matrix_view(C, hm, hn, hm, hn);
+
+    Matrix S = matrix_view(scratch->levels[level].S, 0, 0, hm, hk);
+    Matrix T = matrix_view(scratch->levels[level].T, 0, 0, hk, hn);
+
+    // P7 = (A11 - A21)(B22 - B12) -> C21
+    profiled_combine(A11, A21, S, -1, level, PROFILE_PARTITION);
+    strassen_product(S, B22, B12, -1, C21, scratch, level);
+
+    // P5 = (A21 + A22)(B12 - B11) -> C22, keeping S1 and T1
+    profiled_combine(A21, A22, S, 1, level, PROFILE_PARTITION);
+    profiled_combine(B12, B11, T, -1, level, PROFILE_PARTITION);
+    strassen_product(S, T, T, 0, C22, scratch, level);
+
+    // P6 = (S1 - A11)(B22 - T1) -> C12, keeping S2 and T2
+    profiled_combine(S, A11, S, -1, level, PROFILE_PARTITION);
+    profiled_combine(B22, T, T, -1, level, PROFILE_PARTITION);
+    strassen_product(S, T, T, 0, C12, scratch, level);
+
+    // P3 = (A12 - S2)B22 -> C11
+    profiled_combine(A12, S, S, -1, level, PROFILE_PARTITION);
+    strassen_product(S, B22, B22, 0, C11, scratch, level);
+
+    strassen_winograd_finish(A, B, C, T, scratch, level);
+}
+
+/**
+ * C = A * B using the scratch of this level and below
+ * A, B and C may be views, C must not overlap A or B
+ */
+void strassen_dfs(Matrix A, Matrix B, Matrix C, Strassen_scratch *scratch, int level)
+{
+    if (strassen_is_leaf(scratch, A.rows, A.cols, B.cols, level))
+    {
+        uint64_t started = profile_start();
+        gemm_packed(A.data, A.stride, B.data, B.stride, C.data, C.stride, C.rows, A.cols, C.cols, scratch->pack);
+        uint64_t mults = (uint64_t)C.rows * A.cols * C.cols;
+        profile_record(level, PROFILE_BASE, mults, mults, ((uint64_t)A.rows * A.cols + (uint64_t)B.rows * B.cols) * sizeof(int),
+                       (uint64_t)C.rows * C.cols * sizeof(int), started);
+        return;
+    }
+    if (scratch->variant == STRASSEN_WINOGRAD)
+    {
+        strassen_dfs_winograd(A, B, C, scratch, level);
+        return;
+    }
+
+    int hm = A.rows / 2;
+    int hk = A.cols / 2;
+    int hn = B.cols / 2;
+    Matrix A11 = matrix_view(A, 0, 0, hm, hk), A12 = matrix_view(A, 0, hk, hm, hk);
+    Matrix A21 = matrix_view(A, hm, 0, hm, hk), A22 = matrix_view(A, hm, hk, hm, hk);
+    Matrix B11 = matrix_view(B, 0, 0, hk, hn), B12 = matrix_view(B, 0, hn, hk, hn);
+    Matrix B21 = matrix_view(B, hk, 0, hk, hn), B22 = matrix_view(B, hk, hn, hk, hn);
+    Matrix C11 = matrix_view(C, 0, 0, hm, hn), C12 = matrix_view(C, 0, hn, hm, hn);
+    Matrix C21 = matrix_view(C, hm, 0, hm, hn), C22 = matrix_view(C, hm, hn, hm, hn);
+
+    Matrix S = matrix_view(scratch->levels[level].S, 0, 0, hm, hk);
+    Matrix P = matrix_view(scratch->levels[level].P, 0, 0, hm, hn);
+
+    // M1 = (A11 + A22)(B11 + B22), C11 = C22 = M1
+    profiled_combine(A11, A22, S, 1, level, PROFILE_PARTITION);
+    strassen_product(S, B11, B22, 1, P, scratch, level);
+    profiled_scatter(P, C11, 0, C22, 0, level);
+
+    // M2 = (A21 + A22)B11, C21 = M2, C22 -= M2
+    profiled_combine(A21, A22, S, 1, level, PROFILE_PARTITION);
+    strassen_product(S, B11, B11, 0, P, scratch, level);
+    profiled_scatter(P, C21, 0, C22, -1, level);
+
+    // M3 = A11(B12 - B22), C12 = M3, C22 += M3
+    strassen_product(A11, B12, B22, -1, P, scratch, level);
+    profiled_scatter(P, C12, 0, C22, 1, level);
+
+    // M4 = A22(B21 - B11), C11 += M4, C21 += M4
+    strassen_product(A22, B21, B11, -1, P, scratch, level);
+    profiled_scatter(P, C11, 1, C21, 1, level);
+
+    // M5 = (A11 + A12)B22, C11 -= M5, C12 += M5
+    profiled_combine(A11, A12, S, 1, level, PROFILE_PARTITION);
+    strassen_product(S, B22, B22, 0, P, scratch, level);
+    profiled_scatter(P, C11, -1, C12, 1, level);
+
+    // M6 = (A21 - A11)(B11 + B12), C22 += M6
+    profiled_combine(A21, A11, S, -1, level, PROFILE_PARTITION);
+    strassen_product(S, B11, B12, 1, P, scratch, level);
+    profiled_accumulate(P, C22, 1, level);
+
+    // M7 = (A12 - A22)(B21 + B22), C11 += M7
+    profiled_combine(A12, A22, S, -1, level, PROFILE_PARTITION);
+    strassen_product(S, B21, B22, 1, P, scratch, level);
+    profiled_accumulate(P, C11, 1, level);
+
+    strassen_peel(A, B, C, hm, hk, hn);
+}
+
+/**
+ * Rectangular splitting
+ * Strassen halves all three dimensions together, so a tall-skinny or short-wide product would
+ * hit the cutoff on its small side after a level or two and leave the rest to the classical
+ * kernel. Each dimension is instead cut into pieces close to the smallest one, and the
+ * near-cubic block products are run one after another. Pieces along k are summed into C
+ */
+typedef void (*Block_mult)(Matrix A, Matrix B, Matrix C, void *ctx);
+
+int split_piece(int d, int smallest)
+{
+    int pieces = (d / smallest > 1) ? d / smallest : 1;
+    return (d + pieces - 1) / pieces;
+}
+
+void split_shape(int m, int k, int n, int *mc, int *kc, int *nc)
+{
+    int smallest = (m < k) ? m : k;
+    smallest = (smallest < n) ? smallest : n;
+    *mc = split_piece(m, smallest);
+    *kc = split_piece(k, smallest);
+    *nc = split_piece(n, smallest);
+}
+
+void split_multiply(Matrix A, Matrix B, Matrix C, int mc, int kc, int nc, Block_mult mult, void *ctx)
+{
+    int m = C.rows, k = A.cols, n = C.cols;
+    Matrix partial = {0};
+    if (kc < k)
+    {
+        matrix_init(&partial, mc, nc, 1);
+    }
+
+    for (int i0 = 0; i0 < m; i0 += mc)
+    {
+        int rows = (m - i0 < mc) ? m - i0 : mc;
+        for (int j0 = 0; j0 < n; j0 += nc)
+        {
+            int cols = (n - j0 < nc) ? n - j0 : nc;
+            Matrix C_block = matrix_view(C, i0, j0, rows, cols);
+            for (int p0 = 0; p0 < k; p0 += kc)
+            {
+                int inner = (k - p0 < kc) ? k - p0 : kc;
+                Matrix A_block = matrix_view(A, i0, p0, rows, inner);
+                Matrix B_block = matrix_view(B, p0, j0, inner, cols);
+                if (p0 == 0)
+                {
+                    mult(A_block, B_block, C_block, ctx);
+                    continue;
+                }
+
+                Matrix P_block = matrix_view(partial, 0, 0, rows, cols);
+                mult(A_block, B_block, P_block, ctx);
+                matrix_accumulate(P_block, C_block, 1);
+            }
+        }
+    }
+
+    matrix_free(&partial);
+}
+
+void strassen_dfs_block(Matrix A, Matrix B, Matrix C, void *ctx)
+{
+    strassen_dfs(A, B, C, (Strassen_scratch *)ctx, 0);
+}
+
+/**
+ * Depth-first multiply of any m x k by k x n, products at or below cutoff use the packed SIMD
+ * GEMM in kernels.h. A cutoff at or above the size is a plain GEMM
+ * Both variants give identical results, Winograd does fewer additions per level
+ */
+void strassen_multiply(Matrix A, Matrix B, Matrix C, int cutoff, Strassen_variant variant)
+{
+    int mc, kc, nc;
+    split_shape(A.rows, A.cols, B.cols, &mc, &kc, &nc);
+
+    size_t mark = arena_mark(strassen_arena);
+    Strassen_scratch scratch;
+    strassen_scratch_init(&scratch, mc, kc, nc, cutoff);
+    scratch.variant = variant;
+    split_multiply(A, B, C, mc, kc, nc, strassen_dfs_block, &scratch);
+    strassen_scratch_destroy(&scratch);
+    arena_release(strassen_arena, mark);
+}
+
+/**
+ * Prepared operands
+ * When B is fixed across many multiplies its side of every level can be worked out once. A
+ * prepared B is a tree: each node holds one B-side operand and its seven sub-operands one
+ * level down, in the order the schedule of the chosen variant uses them. Operands that are
+ * plain quadrants are views, only the sums (5 per node classic, 4 Winograd) own storage, and
+ * the last level is also kept packed for the leaf GEMM. A call does just the A-side sums, the
+ * products and the result sums, and its leaves skip packing B
+ * The cache costs about (7/4)^depth times B's size, twice that counting the packed copies
+ * The tree follows the split and depth of an m x k by k x n product, one tree per B block.
+ * B itself must outlive the cache unchanged, odd edges are peeled from it
+ */
+typedef struct Prepared_node
+{
+    Matrix B;                        // Operand at this node, a view or an owned sum
+    struct Prepared_node *children;  // Seven operands one level down, NULL at the last level
+    int *packed;                     // B packed for the leaf GEMM, last level only
+
+} Prepared_node;
+
+typedef struct
+{
+    Matrix B;                // The operand as given
+    Prepared_node *blocks;   // One tree per block of the split, row-major over k then n
+    int k_blocks, n_blocks;
+    int kc, nc;              // Block size along k and n
+    int cutoff;
+    Strassen_variant variant;
+    size_t bytes;            // Owned by the sums
+
+} Prepared_operand;
+
+/**
+ * X + sign * Y in a buffer of its own
+ */
+Matrix prepared_sum(Prepared_operand *prep, Matrix X, Matrix Y, int sign)
+{
+    Matrix sum;
+    matrix_init(&sum, X.rows, X.cols, 1);
+    matrix_combine(X, Y, sum, sign);
+    prep->bytes += matrix_bytes(X.rows, X.cols);
+    return sum;
+}
+
+void prepared_node_build(Prepared_operand *prep, Prepared_node *node, Matrix B, int levels)
+{
+    node->B = B;
+    node->children = NULL;
+    node->packed = NULL;
+    if (levels == 0)
+    {
+        size_t packed_bytes = gemm_prepacked_size(B.rows, B.cols) * sizeof(int);
+        node->packed = (int *)strassen_alloc(packed_bytes);
+        gemm_prepack(B.data, B.stride, B.rows, B.cols, node->packed);
+        prep->bytes += packed_bytes;
+        return;
+    }
+
+    int hk = B.rows / 2;
+    int hn = B.cols / 2;
+    Matrix B11 = matrix_view(B, 0, 0, hk, hn), B12 = matrix_view(B, 0, hn, hk, hn);
+    Matrix B21 = matrix_view(B, hk, 0, hk, hn), B22 = matrix_view(B, hk, hn, hk, hn);
+
+    Matrix operand[7];
+    if (prep->variant == STRASSEN_WINOGRAD)
+    {
+        operand[0] = B11;                                     // P1
+        operand[1] = B21;                                     // P2
+        operand[2] = B22;                                     // P3
+        operand[4] = prepared_sum(prep, B12, B11, -1);        // P5, T1 = B12 - B11
+        operand[5] = prepared_sum(prep, B22, operand[4], -1); // P6, T2 = B22 - T1
+        operand[6] = prepared_sum(prep, B22, B12, -1);        // P7, T3 = B22 - B12
+        operand[3] = prepared_sum(prep, operand[5], B21, -1); // P4, T4 = T2 - B21
+    }
+    else
+    {
+        operand[0] = prepared_sum(prep, B11, B22, 1);  // M1
+        operand[1] = B11;                              // M2
+        operand[2] = prepared_sum(prep, B12, B22, -1); // M3
+        operand[3] = prepared_sum(prep, B21, B11, -1); // M4
+        operand[4] = B22;                              // M5
+        operand[5] = prepared_sum(prep, B11, B12, 1);  // M6
+        operand[6] = prepared_sum(prep, B21, B22, 1);  // M7
+    }
+
+    node->children = (Prepared_node *)strassen_alloc(7 * sizeof(Prepared_node));
+    for (int p = 0; p < 7; p++)
+    {
+        prepared_node_build(prep, &node->children[p], operand[p], levels - 1);
+    }
+}
+
+void prepared_node_destroy(Prepared_node *node)
+{
+    if (node->packed != NULL)
+    {
+        strassen_free(node->packed, gemm_prepacked_size(node->B.rows, node->B.cols) * sizeof(int));
+        node->packed = NULL;
+    }
+    if (node->children == NULL)
+    {
+        return;
+    }
+    for (int p = 6; p >= 0; p--)
+    {
+        prepared_node_destroy(&node->children[p]);
+        matrix_free(&node->children[p].B);
+    }
+    strassen_free(node->children, 7 * sizeof(Prepared_node));
+    node->children = NULL;
+}
+
+/**
+ * Build the operand trees of B for products with m-row A operands
+ */
+void strassen_prepare(Prepared_operand *prep, Matrix B, int m, int cutoff, Strassen_variant variant)
+{
+    int k = B.rows, n = B.cols;
+    int mc, kc, nc;
+    split_shape(m, k, n, &mc, &kc, &nc);
+
+    prep->B = B;
+    prep->kc = kc;
+    prep->nc = nc;
+    prep->k_blocks = (k + kc - 1) / kc;
+    prep->n_blocks = (n + nc - 1) / nc;
+    prep->cutoff = cutoff;
+    prep->variant = variant;
+    prep->bytes = 0;
+    prep->blocks = (Prepared_node *)strassen_alloc(prep->k_blocks * prep->n_blocks * sizeof(Prepared_node));
+    for (int p0 = 0; p0 < k; p0 += kc)
+    {
+        int inner = (k - p0 < kc) ? k - p0 : kc;
+        for (int j0 = 0; j0 < n; j0 += nc)
+        {
+            int cols = (n - j0 < nc) ? n - j0 : nc;
+            Prepared_node *block = &prep->blocks[(p0 / kc) * prep->n_blocks + j0 / nc];
+            prepared_node_build(prep, block, matrix_view(B, p0, j0, inner, cols), strassen_depth(mc, inner, cols, cutoff));
+        }
+    }
+}
+
+void strassen_prepared_destroy(Prepared_operand *prep)
+{
+    for (int b = prep->k_blocks * prep->n_blocks - 1; b >= 0; b--)
+    {
+        prepared_node_destroy(&prep->blocks[b]);
+    }
+    strassen_free(prep->blocks, prep->k_blocks * prep->n_blocks * sizeof(Prepared_node));
+    prep->blocks = NULL;
+}
+
+/**
+ * C = A * B where B's side of each level comes from the tree, same schedules as strassen_dfs
+ * The tree may stop above or below where this product does, past its end the plain path runs
+ */
+void strassen_dfs_prepared(Matrix A, const Prepared_node *node, Matrix C, Strassen_scratch *scratch, int level)
+{
+    Matrix B = node->B;
+    if (strassen_is_leaf(scratch, A.rows, A.cols, B.cols, level))
+    {
+        if (node->packed != NULL)
+        {
+            gemm_prepacked(A.data, A.stride, node->packed, C.data, C.stride, C.rows, A.cols, C.cols);
+        }
+        else
+        {
+            gemm_packed(A.data, A.stride, B.data, B.stride, C.data, C.stride, C.rows, A.cols, C.cols, scratch->pack);
+        }
+        return;
+    }
+    if (node->children == NULL)
+    {
+        strassen_dfs(A, B, C, scratch, level);
+        return;
+    }
+
+    int hm = A.rows / 2;
+    int hk = A.cols / 2;
+    int hn = B.cols / 2;
+    const Prepared_node *child = node->children;
+    Matrix A11 = matrix_view(A, 0, 0, hm, hk), A12 = matrix_view(A, 0, hk, hm, hk);
+    Matrix A21 = matrix_view(A, hm, 0, hm, hk), A22 = matrix_view(A, hm, hk, hm, hk);
+    Matrix C11 = matrix_view(C, 0, 0, hm, hn), C12 = matrix_view(C, 0, hn, hm, hn);
+    Matrix C21 = matrix_view(C, hm, 0, hm, hn), C22 = matrix_view(C, hm, hn, hm, hn);
+    Matrix S = matrix_view(scratch->levels[level].S, 0, 0, hm, hk);
+    Matrix P = matrix_view(scratch->levels[level].P, 0, 0, hm, hn);
+
+    if (scratch->variant == STRASSEN_WINOGRAD)
+    {
+        matrix_combine(A11, A21, S, -1);                       // S3
+        strassen_dfs_prepared(S, &child[6], C21, scratch, level + 1); // P7 = S3 T3
+        matrix_combine(A21, A22, S, 1);                        // S1
+        strassen_dfs_prepared(S, &child[4], C22, scratch, level + 1); // P5 = S1 T1
+        matrix_combine(S, A11, S, -1);                         // S2
+        strassen_dfs_prepared(S, &child[5], C12, scratch, level + 1); // P6 = S2 T2
+        matrix_combine(A12, S, S, -1);                         // S4
+        strassen_dfs_prepared(S, &child[2], C11, scratch, level + 1); // P3 = S4 B22
+        strassen_dfs_prepared(A11, &child[0], P, scratch, level + 1); // P1 = A11 B11
+
+        matrix_accumulate(P, C12, 1);     // U2 = P1 + P6
+        matrix_combine(C12, C21, C21, 1); // U3 = U2 + P7
+        matrix_accumulate(C22, C12, 1);   // U4 = U2 + P5
+        matrix_accumulate(C21, C22, 1);   // C22 = U7 = U3 + P5
+        matrix_accumulate(C11, C12, 1);   // C12 = U5 = U4 + P3
+
+        strassen_dfs_prepared(A22, &child[3], C11, scratch, level + 1); // P4 = A22 T4
+        matrix_accumulate(C11, C21, -1);                         // C21 = U6 = U3 - P4
+        strassen_dfs_prepared(A12, &child[1], C11, scratch, level + 1); // P2 = A12 B21
+        matrix_accumulate(P, C11, 1);                            // C11 = U1 = P1 + P2
+    }
+    else
+    {
+        matrix_combine(A11, A22, S, 1);
+        strassen_dfs_prepared(S, &child[0], P, scratch, level + 1); // M1
+        matrix_scatter(P, C11, 0, C22, 0);
+
+        matrix_combine(A21, A22, S, 1);
+        strassen_dfs_prepared(S, &child[1], P, scratch, level + 1); // M2
+        matrix_scatter(P, C21, 0, C22, -1);
+
+        strassen_dfs_prepared(A11, &child[2], P, scratch, level + 1); // M3
+        matrix_scatter(P, C12, 0, C22, 1);
+
+        strassen_dfs_prepared(A22, &child[3], P, scratch, level + 1); // M4
+        matrix_scatter(P, C11, 1, C21, 1);
+
+        matrix_combine(A11, A12, S, 1);
+        strassen_dfs_prepared(S, &child[4], P, scratch, level + 1); // M5
+        matrix_scatter(P, C11, -1, C12, 1);
+
+        matrix_combine(A21, A11, S, -1);
+        strassen_dfs_prepared(S, &child[5], P, scratch, level + 1); // M6
+        matrix_accumulate(P, C22, 1);
+
+        matrix_combine(A12, A22, S, -1);
+        strassen_dfs_prepared(S, &child[6], P, scratch, level + 1); // M7
+        matrix_accumulate(P, C11, 1);
+    }
+
+    strassen_peel(A, B, C, hm, hk, hn);
+}
+
+typedef struct
+{
+    const Prepared_operand *prep;
+    Strassen_scratch scratch;
+
+} Prepared_call;
+
+/**
+ * split_multiply hands over views, the tree for one is found from where it starts in B
+ */
+void strassen_prepared_block(Matrix A, Matrix B, Matrix C, void *ctx)
+{
+    Prepared_call *call = (Prepared_call *)ctx;
+    const Prepared_operand *prep = call->prep;
+    size_t offset = (size_t)(B.data - prep->B.data);
+    int row = (int)(offset / prep->B.stride), col = (int)(offset % prep->B.stride);
+    strassen_dfs_prepared(A, &prep->blocks[(row / prep->kc) * prep->n_blocks + col / prep->nc], C, &call->scratch, 0);
+}
+
+/**
+ * C = A * B for the B held by prep, A may have any number of rows that splits k and n the way
+ * the cache was built for. Returns 0, or -1 if the shapes don't fit the cache
+ */
+int strassen_multiply_prepared(Matrix A, const Prepared_operand *prep, Matrix C)
+{
+    int m = A.rows, k = prep->B.rows, n = prep->B.cols;
+    int mc, kc, nc;
+    split_shape(m, A.cols, n, &mc, &kc, &nc);
+    if (A.cols != k || C.rows != m || C.cols != n || kc != prep->kc || nc != prep->nc)
+    {
+        return -1;
+    }
+
+    size_t mark = arena_mark(strassen_arena);
+    Prepared_call call;
+    call.prep = prep;
+    strassen_scratch_init(&call.scratch, mc, kc, nc, prep->cutoff);
+    call.scratch.variant = prep->variant;
+    split_multiply(A, prep->B, C, mc, kc, nc, strassen_prepared_block, &call);
+    strassen_scratch_destroy(&call.scratch);
+    arena_release(strassen_arena, mark);
+    return 0;
+}
+
+/**
+ * Parallel Strassen
+ * The top parallel_depth levels are a task tree: each node spawns its seven products as tasks
+ * on the work-stealing pool, waits for them (running other tasks meanwhile), then combines
+ * them with calculate_product. Products on the last parallel level run the ordinary
+ * depth-first schedule with the scratch of whichever worker picked them up, so workers never
+ * share buffers. Parallel nodes own their seven M buffers, 7^parallel_depth tasks in total
+ */
+typedef struct
+{
+    Thread_pool pool;
+    Strassen_scratch *scratch; // One per worker
+    int depth;                 // Strassen levels in total
+    int parallel_depth;        // Levels spawned as tasks
+
+} Parallel_strassen;
+
+typedef struct
+{
+    Matrix AX, AY; // A-side operand AX + a_sign * AY
+    int a_sign;
+    Matrix BX, BY; // B-side operand BX + b_sign * BY
+    int b_sign;
+    Matrix M;      // Product, owned by the parent node
+    int level;     // Level of the parent node
+    Parallel_strassen *ctx;
+
+} Product_task;
+
+void strassen_parallel_node(Matrix A, Matrix B, Matrix C, int level, Parallel_strassen *ctx);
+
+/**
+ * Winograd's seven result sums over P1..P7, the products are used as the partial sums
+ */
+void winograd_product(Matrix P[7], Matrix *result)
+{
+    int hm = P[0].rows, hn = P[0].cols;
+    Matrix C11 = matrix_view(*result, 0, 0, hm, hn), C12 = matrix_view(*result, 0, hn, hm, hn);
+    Matrix C21 = matrix_view(*result, hm, 0, hm, hn), C22 = matrix_view(*result, hm, hn, hm, hn);
+
+    matrix_combine(P[0], P[1], C11, 1); // C11 = U1 = P1 + P2
+    matrix_accumulate(P[0], P[5], 1);   // U2 = P1 + P6
+    matrix_accumulate(P[5], P[6], 1);   // U3 = U2 + P7
+    matrix_combine(P[5], P[4], C12, 1); // U4 = U2 + P5
+    matrix_accumulate(P[2], C12, 1);    // C12 = U5 = U4 + P3
+    matrix_combine(P[6], P[3], C21, -1); // C21 = U6 = U3 - P4
+    matrix_combine(P[6], P[4], C22, 1); // C22 = U7 = U3 + P5
+}
+
+/**
+ * Smallest number of task levels that gives every thread a couple of products to start with
+ */
+int strassen_parallel_depth(int threads, int depth)
+{
+    int parallel_depth = 0;
+    int tasks = 1;
+    while (threads > 1 && tasks < 2 * threads && parallel_depth < depth)
+    {
+        tasks *= 7;
+        parallel_depth++;
+    }
+    return parallel_depth;
+}
+
+void strassen_product_task(void *arg)
+{
+    Product_task *task = (Product_task *)arg;
+    Parallel_strassen *ctx = task->ctx;
+
+    if (task->level + 1 < ctx->parallel_depth)
+    {
+        // Still in the task tree, operands must outlive the child tasks so they get their own buffers
+        Matrix S = task->AX, T = task->BX;
+        if (task->a_sign != 0)
+        {
+            matrix_init(&S, task->AX.rows, task->AX.cols, 1);
+            matrix_combine(task->AX, task->AY, S, task->a_sign);
+        }
+        if (task->b_sign != 0)
+        {
+            matrix_init(&T, task->BX.rows, task->BX.cols, 1);
+            matrix_combine(task->BX, task->BY, T, task->b_sign);
+        }
+        strassen_parallel_node(S, T, task->M, task->level + 1, ctx);
+        if (task->a_sign != 0)
+        {
+            matrix_free(&S);
+        }
+        if (task->b_sign != 0)
+        {
+            matrix_free(&T);
+        }
+        return;
+    }
+
+    // Serial from here on, in this worker's scratch
+    Strassen_scratch *scratch = &ctx->scratch[worker_id()];
+    Matrix S = task->AX;
+    if (task->a_sign != 0)
+    {
+        S = matrix_view(scratch->levels[task->level].S, 0, 0, task->AX.rows, task->AX.cols);
+        matrix_combine(task->AX, task->AY, S, task->a_sign);
+    }
+    strassen_product(S, task->BX, task->BY, task->b_sign, task->M, scratch, task->level);
+}
+
+void strassen_parallel_node(Matrix A, Matrix B, Matrix C, int level, Parallel_strassen *ctx)
+{
+    Strassen_scratch *own = &ctx->scratch[worker_id()];
+    if (strassen_is_leaf(own, A.rows, A.cols, B.cols, level))
+    {
+        // A smaller block of a split product can bottom out inside the task levels
+        gemm_packed(A.data, A.stride, B.data, B.stride, C.data, C.stride, C.rows, A.cols, C.cols, own->pack);
+        return;
+    }
+
+    int hm = A.rows / 2;
+    int hk = A.cols / 2;
+    int hn = B.cols / 2;
+    Matrix A11 = matrix_view(A, 0, 0, hm, hk), A12 = matrix_view(A, 0, hk, hm, hk);
+    Matrix A21 = matrix_view(A, hm, 0, hm, hk), A22 = matrix_view(A, hm, hk, hm, hk);
+    Matrix B11 = matrix_view(B, 0, 0, hk, hn), B12 = matrix_view(B, 0, hn, hk, hn);
+    Matrix B21 = matrix_view(B, hk, 0, hk, hn), B22 = matrix_view(B, hk, hn, hk, hn);
+
+    // See strassen algorithm slides for formulas
+    Product_task tasks[7] = {
+        {A11, A22, 1, B11, B22, 1, {0}, level, ctx},  // M1 = (A11 + A22)(B11 + B22)
+        {A21, A22, 1, B11, B11, 0, {0}, level, ctx},  // M2 = (A21 + A22)B11
+        {A11, A11, 0, B12, B22, -1, {0}, level, ctx}, // M3 = A11(B12 - B22)
+        {A22, A22, 0, B21, B11, -1, {0}, level, ctx}, // M4 = A22(B21 - B11)
+        {A11, A12, 1, B22, B22, 0, {0}, level, ctx},  // M5 = (A11 + A12)B22
+        {A21, A11, -1, B11, B12, 1, {0}, level, ctx}, // M6 = (A21 - A11)(B11 + B12)
+        {A12, A22, -1, B21, B22, 1, {0}, level, ctx}, // M7 = (A12 - A22)(B21 + B22)
+    };
+
+    // Winograd's chained sums S1, S2, T1, T2 are built here once, the rest inside the tasks
+    int winograd = (own->variant == STRASSEN_WINOGRAD);
+    Matrix S1 = {0}, S2 = {0}, T1 = {0}, T2 = {0};
+    if (winograd)
+    {
+        matrix_init(&S1, hm, hk, 1);
+        matrix_init(&S2, hm, hk, 1);
+        matrix_init(&T1, hk, hn, 1);
+        matrix_init(&T2, hk, hn, 1);
+        matrix_combine(A21, A22, S1, 1);  // S1 = A21 + A22
+        matrix_combine(S1, A11, S2, -1);  // S2 = S1 - A11
+        matrix_combine(B12, B11, T1, -1); // T1 = B12 - B11
+        matrix_combine(B22, T1, T2, -1);  // T2 = B22 - T1
+
+        Product_task winograd_tasks[7] = {
+            {A11, A11, 0, B11, B11, 0, {0}, level, ctx},  // P1 = A11 B11
+            {A12, A12, 0, B21, B21, 0, {0}, level, ctx},  // P2 = A12 B21
+            {A12, S2, -1, B22, B22, 0, {0}, level, ctx},  // P3 = S4 B22, S4 = A12 - S2
+            {A22, A22, 0, T2, B21, -1, {0}, level, ctx},  // P4 = A22 T4, T4 = T2 - B21
+            {S1, S1, 0, T1, T1, 0, {0}, level, ctx},      // P5 = S1 T1
+            {S2, S2, 0, T2, T2, 0, {0}, level, ctx},      // P6 = S2 T2
+            {A11, A21, -1, B22, B12, -1, {0}, level, ctx}, // P7 = S3 T3, S3 = A11 - A21, T3 = B22 - B12
+        };
+        memcpy(tasks, winograd_tasks, sizeof(tasks));
+    }
+
+    atomic_int pending;
+    atomic_init(&pending, 7);
+    Matrix intermediates[7];
+    for (int m = 0; m < 7; m++)
+    {
+        matrix_init(&tasks[m].M, hm, hn, 1);
+        pool_spawn(&ctx->pool, strassen_product_task, &tasks[m], &pending);
+    }
+    pool_wait(&ctx->pool, &pending);
+
+    for (int m = 0; m < 7; m++)
+    {
+        intermediates[m] = tasks[m].M;
+    }
+    Matrix C_core = matrix_view(C, 0, 0, 2 * hm, 2 * hn);
+    if (winograd)
+    {
+        winograd_product(intermediates, &C_core);
+        matrix_free(&S1);
+        matrix_free(&S2);
+        matrix_free(&T1);
+        matrix_free(&T2);
+    }
+    else
+    {
+        calculate_product(intermediates, &C_core, 2 * hm, 2 * hn, level);
+    }
+    strassen_peel(A, B, C, hm, hk, hn);
+
+    for (int m = 0; m < 7; m++)
+    {
+        matrix_free(&tasks[m].M);
+    }
+}
+
+void strassen_parallel_block(Matrix A, Matrix B, Matrix C, void *ctx)
+{
+    // Node buffers are freed out of order, drop them all once the block's task tree is done
+    size_t mark = arena_mark(strassen_arena);
+    strassen_parallel_node(A, B, C, 0, (Parallel_strassen *)ctx);
+    arena_release(strassen_arena, mark);
+}
+
+/**
+ * Same contract as strassen_multiply, spread over threads workers
+ */
+void strassen_parallel_multiply(Matrix A, Matrix B, Matrix C, int cutoff, Strassen_variant variant, int threads)
+{
+    int mc, kc, nc;
+    split_shape(A.rows, A.cols, B.cols, &mc, &kc, &nc);
+
+    Parallel_strassen ctx;
+    ctx.depth = strassen_depth(mc, kc, nc, cutoff);
+    ctx.parallel_depth = strassen_parallel_depth(threads, ctx.depth);
+    if (ctx.parallel_depth == 0)
+    {
+        strassen_multiply(A, B, C, cutoff, variant);
+        return;
+    }
+
+    // Workers only run levels from the last parallel one down
+    size_t mark = arena_mark(strassen_arena);
+    ctx.scratch = (Strassen_scratch *)strassen_alloc(threads * sizeof(Strassen_scratch));
+    for (int t = 0; t < threads; t++)
+    {
+        strassen_scratch_init_from(&ctx.scratch[t], mc, kc, nc, cutoff, ctx.parallel_depth - 1);
+        ctx.scratch[t].variant = variant;
+    }
+
+    pool_init(&ctx.pool, threads);
+    split_multiply(A, B, C, mc, kc, nc, strassen_parallel_block, &ctx);
+    pool_destroy(&ctx.pool);
+
+    for (int t = threads - 1; t >= 0; t--)
+    {
+        strassen_scratch_destroy(&ctx.scratch[t]);
+    }
+    strassen_free(ctx.scratch, threads * sizeof(Strassen_scratch));
+    arena_release(strassen_arena, mark);
+}
+
+/**
+ * Arena bytes for strassen_multiply (threads 1) or strassen_parallel_multiply, enough that
+ * nothing falls back to the heap. Parallel nodes free out of order, so their buffers are
+ * summed over one block's task tree rather than counted at their peak
+ */
+size_t strassen_arena_size(int m, int k, int n, int cutoff, Strassen_variant variant, int threads)
+{
+    int mc, kc, nc;
+    split_shape(m, k, n, &mc, &kc, &nc);
+    size_t partial = (kc < k) ? matrix_bytes(mc, nc) : 0;
+
+    int depth = strassen_depth(mc, kc, nc, cutoff);
+    int parallel_depth = strassen_parallel_depth(threads, depth);
+    if (parallel_depth == 0)
+    {
+        return strassen_scratch_bytes(mc, kc, nc, cutoff, 0) + partial;
+    }
+
+    size_t bytes = arena_round(threads * sizeof(Strassen_scratch)) + partial;
+    bytes += threads * strassen_scratch_bytes(mc, kc, nc, cutoff, parallel_depth - 1);
+
+    // Seven products per node, plus the operand sums that outlive the node (see strassen_product_task)
+    int winograd = (variant == STRASSEN_WINOGRAD);
+    size_t nodes = 1;
+    for (int level = 0; level < parallel_depth; level++)
+    {
+        mc /= 2;
+        kc /= 2;
+        nc /= 2;
+        size_t a_side = matrix_bytes(mc, kc), b_side = matrix_bytes(kc, nc);
+        size_t node = 7 * matrix_bytes(mc, nc) + (winograd ? 2 * (a_side + b_side) : 0);
+        if (level + 1 < parallel_depth)
+        {
+            node += (winograd ? 2 : 5) * (a_side + b_side);
+        }
+        bytes += nodes * node;
+        nodes *= 7;
+    }
+    return bytes;
+}
+
+/**
+ * Arena bytes for the breadth-first path on dim x dim operands: the node array, every node
+ * as partition allocates it, one reused matrix_mult temporary and the products compute_result
+ * builds on the way back up
+ */
+size_t strassen_bfs_arena_size(int dim, int partition_levels)
+{
+    int total_nodes = (int)pow(7, (partition_levels - 1)) + 1;
+    size_t bytes = arena_round(2 * total_nodes * sizeof(Node));
+
+    size_t nodes = 1;
+    int levels = (partition_levels > 1) ? partition_levels : 1;
+    for (int level = 0; level < levels; level++)
+    {
+        int sub = dim >> (level + 1);
+        int product = (level + 1 < levels) ? sub : ((level == 0) ? dim : 2 * sub);
+        bytes += nodes * (13 * matrix_bytes(sub, sub) + matrix_bytes(product, product));
+        if (level + 1 == levels)
+        {
+            bytes += matrix_bytes(sub, sub);
+        }
+        else
+        {
+            bytes += nodes * matrix_bytes(dim >> level, dim >> level);
+        }
+        nodes *= 7;
+    }
+    return bytes;
+}
+
+/**
+ * Streaming multiply
+ * A loader thread pulls the operands from their tile sources straight into their final
+ * storage. Rows are loaded in pairs, a band of the top half then the same band of the bottom
+ * half, so the top level's operand sums are formed band by band while later bands are still
+ * being read. The top level is Strassen-Winograd, its chained sums (S2 = S1 - A11,
+ * T2 = B22 - T1) all come out of one pass over each row pair. Levels below use the variant
+ * asked for
+ */
+typedef struct
+{
+    Tile_source *source;
+    Matrix dst;
+    int half;   // Row i is loaded together with row half + i
+    int ready;  // Leading row pairs loaded so far
+    int failed;
+
+} Stream_operand;
+
+typedef struct
+{
+    Stream_operand operands[2]; // A, then B
+    pthread_mutex_t lock;
+    pthread_cond_t loaded;
+
+} Stream_loader;
+
+void stream_publish(Stream_loader *loader, Stream_operand *operand, int ready, int failed)
+{
+    pthread_mutex_lock(&loader->lock);
+    operand->ready = ready;
+    operand->failed = failed;
+    pthread_cond_broadcast(&loader->loaded);
+    pthread_mutex_unlock(&loader->lock);
+}
+
+void *stream_loader_run(void *arg)
+{
+    Stream_loader *loader = (Stream_loader *)arg;
+    for (int o = 0; o < 2; o++)
+    {
+        Stream_operand *operand = &loader->operands[o];
+        Matrix dst = operand->dst;
+        int failed = 0;
+        for (int r = 0; r < operand->half && !failed; r += STREAM_TILE)
+        {
+            int rows = (operand->half - r < STREAM_TILE) ? operand->half - r : STREAM_TILE;
+            failed = tile_source_load(operand->source, r, rows, MAT_ROW(dst, r), dst.stride) != 0 ||
+                     tile_source_load(operand->source, operand->half + r, rows, MAT_ROW(dst, operand->half + r), dst.stride) != 0;
+            stream_publish(loader, operand, r + rows, failed);
+        }
+
+        // Odd last row, only needed once the products start
+        int rest = dst.rows - 2 * operand->half;
+        if (!failed && rest > 0)
+        {
+            failed = tile_source_load(operand->source, 2 * operand->half, rest, MAT_ROW(dst, 2 * operand->half), dst.stride) != 0;
+        }
+        stream_publish(loader, operand, operand->half, failed); // A failure releases the consumer too
+    }
+    return NULL;
+}
+
+void stream_wait(Stream_loader *loader, Stream_operand *operand, int rows)
+{
+    pthread_mutex_lock(&loader->lock);
+    while (operand->ready < rows)
+    {
+        pthread_cond_wait(&loader->loaded, &loader->lock);
+    }
+    pthread_mutex_unlock(&loader->lock);
+}
+
+/**
+ * The streamed top level only pays off when the product is a single block that recurses
+ */
+int strassen_stream_overlaps(int m, int k, int n, int cutoff)
+{
+    int mc, kc, nc;
+    split_shape(m, k, n, &mc, &kc, &nc);
+    return mc == m && kc == k && nc == n && strassen_depth(m, k, n, cutoff) > 0;
+}
+
+/**
+ * C = A * B with A and B read from tile sources, C must be A.rows x B.cols
+ * Returns 0, or -1 if the shapes don't match or a source failed
+ */
+int strassen_stream_multiply(Tile_source *a, Tile_source *b, Matrix C, int cutoff, Strassen_variant variant)
+{
+    int m = a->rows, k = a->cols, n = b->cols;
+    if (b->rows != k || C.rows != m || C.cols != n)
+    {
+        return -1;
+    }
+
+    size_t mark = arena_mark(strassen_arena);
+    Matrix A, B;
+    matrix_init(&A, m, k, 1);
+    matrix_init(&B, k, n, 1);
+
+    int status = 0;
+    if (!strassen_stream_overlaps(m, k, n, cutoff))
+    {
+        // Nothing to overlap with, read both and multiply
+        status = tile_source_load(a, 0, m, A.data, A.stride) | tile_source_load(b, 0, k, B.data, B.stride);
+        if (status == 0)
+        {
+            strassen_multiply(A, B, C, cutoff, variant);
+        }
+        matrix_free(&B);
+        matrix_free(&A);
+        arena_release(strassen_arena, mark);
+        return (status == 0) ? 0 : -1;
+    }
+
+    int hm = m / 2, hk = k / 2, hn = n / 2;
+    Matrix S1, S2, T1, T2;
+    matrix_init(&S1, hm, hk, 1);
+    matrix_init(&S2, hm, hk, 1);
+    matrix_init(&T1, hk, hn, 1);
+    matrix_init(&T2, hk, hn, 1);
+    Strassen_scratch scratch;
+    strassen_scratch_init(&scratch, m, k, n, cutoff);
+    scratch.variant = variant;
+    Matrix S3 = matrix_view(scratch.levels[0].S, 0, 0, hm, hk);
+
+    Stream_loader loader;
+    loader.operands[0] = (Stream_operand){a, A, hm, 0, 0};
+    loader.operands[1] = (Stream_operand){b, B, hk, 0, 0};
+    pthread_mutex_init(&loader.lock, NULL);
+    pthread_cond_init(&loader.loaded, NULL);
+    pthread_t thread;
+    pthread_create(&thread, NULL, stream_loader_run, &loader);
+
+    // S1 = A21 + A22, S2 = S1 - A11, S3 = A11 - A21 as A's row pairs arrive
+    for (int r = 0; r < hm; r += STREAM_TILE)
+    {
+        int rows = (hm - r < STREAM_TILE) ? hm - r : STREAM_TILE;
+        stream_wait(&loader, &loader.operands[0], r + rows);
+        Matrix A11 = matrix_view(A, r, 0, rows, hk), A21 = matrix_view(A, hm + r, 0, rows, hk);
+        Matrix A22 = matrix_view(A, hm + r, hk, rows, hk);
+        Matrix S1_rows = matrix_view(S1, r, 0, rows, hk), S2_rows = matrix_view(S2, r, 0, rows, hk);
+        matrix_combine(A21, A22, S1_rows, 1);
+        matrix_combine(S1_rows, A11, S2_rows, -1);
+        matrix_combine(A11, A21, matrix_view(S3, r, 0, rows, hk), -1);
+    }
+
+    // T1 = B12 - B11, T2 = B22 - T1 as B's arrive
+    for (int r = 0; r < hk; r += STREAM_TILE)
+    {
+        int rows = (hk - r < STREAM_TILE) ? hk - r : STREAM_TILE;
+        stream_wait(&loader, &loader.operands[1], r + rows);
+        Matrix B11 = matrix_view(B, r, 0, rows, hn), B12 = matrix_view(B, r, hn, rows, hn);
+        Matrix B22 = matrix_view(B, hk + r, hn, rows, hn);
+        Matrix T1_rows = matrix_view(T1, r, 0, rows, hn);
+        matrix_combine(B12, B11, T1_rows, -1);
+        matrix_combine(B22, T1_rows, matrix_view(T2, r, 0, rows, hn), -1);
+    }
+
+    pthread_join(thread, NULL);
+    pthread_mutex_destroy(&loader.lock);
+    pthread_cond_destroy(&loader.loaded);
+    status = (loader.operands[0].failed || loader.operands[1].failed) ? -1 : 0;
+
+    if (status == 0)
+    {
+        Matrix A12 = matrix_view(A, 0, hk, hm, hk);
+        Matrix B12 = matrix_view(B, 0, hn, hk, hn), B22 = matrix_view(B, hk, hn, hk, hn);
+        Matrix C11 = matrix_view(C, 0, 0, hm, hn), C12 = matrix_view(C, 0, hn, hm, hn);
+        Matrix C21 = matrix_view(C, hm, 0, hm, hn), C22 = matrix_view(C, hm, hn, hm, hn);
+
+        strassen_product(S3, B22, B12, -1, C21, &scratch, 0); // P7 = S3(B22 - B12)
+        strassen_product(S1, T1, T1, 0, C22, &scratch, 0);    // P5 = S1 T1
+        strassen_product(S2, T2, T2, 0, C12, &scratch, 0);    // P6 = S2 T2
+        matrix_combine(A12, S2, S3, -1);                     // S4 = A12 - S2, over S3
+        strassen_product(S3, B22, B22, 0, C11, &scratch, 0);  // P3 = S4 B22
+        strassen_winograd_finish(A, B, C, T2, &scratch, 0);
+    }
+
+    strassen_scratch_destroy(&scratch);
+    matrix_free(&T2);
+    matrix_free(&T1);
+    matrix_free(&S2);
+    matrix_free(&S1);
+    matrix_free(&B);
+    matrix_free(&A);
+    arena_release(strassen_arena, mark);
+    return status;
+}
+
+/**
+ * Arena bytes for strassen_stream_multiply, the operands are allocated in it too
+ */
+size_t strassen_stream_arena_size(int m, int k, int n, int cutoff, Strassen_variant variant)
+{
+    size_t operands = matrix_bytes(m, k) + matrix_bytes(k, n);
+    if (!strassen_stream_overlaps(m, k, n, cutoff))
+    {
+        return operands + strassen_arena_size(m, k, n, cutoff, variant, 1);
+    }
+    int hm = m / 2, hk = k / 2, hn = n / 2;
+    return operands + 2 * matrix_bytes(hm, hk) + 2 * matrix_bytes(hk, hn) + strassen_scratch_bytes(m, k, n, cutoff, 0);
+}
+
+/**
+ * Batched multiply
+ * count independent products of one shape share a single plan: the split, the depth and the
+ * scratch layout are worked out once, and each worker allocates its scratch once and runs
+ * whole products back to back in it, so the level buffers and the packing buffer stay warm
+ * from one product to the next instead of being rebuilt per call. The batch is cut into a few
+ * chunks per worker and spread over the pool
+ */
+typedef struct
+{
+    const Matrix *A, *B;
+    Matrix *C;
+    int first;                 // First product of the chunk
+    int count;                 // Products in the chunk
+    int mc, kc, nc;            // Shared split
+    Strassen_scratch *scratch; // One per worker
+
+} Batch_task;
+
+void strassen_batch_chunk(void *arg)
+{
+    Batch_task *task = (Batch_task *)arg;
+    Strassen_scratch *scratch = &task->scratch[worker_id()];
+    for (int i = task->first; i < task->first + task->count; i++)
+    {
+        split_multiply(task->A[i], task->B[i], task->C[i], task->mc, task->kc, task->nc, strassen_dfs_block, scratch);
+    }
+}
+
+/**
+ * Workers a batch of count products runs on, no more than there are products
+ */
+int strassen_batch_threads(int count, int threads)
+{
+    threads = (threads > 0) ? threads : 1;
+    return (threads < count) ? threads : count;
+}
+
+/**
+ * C[i] = A[i] * B[i] for count pairs of the same shape, on threads workers
+ * Returns 0, or -1 if the shapes are not all the same
+ */
+int strassen_multiply_batch(const Matrix *A, const Matrix *B, Matrix *C, int count, int cutoff, Strassen_variant variant, int threads)
+{
+    if (count <= 0)
+    {
+        return 0;
+    }
+    int m = A[0].rows, k = A[0].cols, n = B[0].cols;
+    for (int i = 0; i < count; i++)
+    {
+        if (A[i].rows != m || A[i].cols != k || B[i].rows != k || B[i].cols != n || C[i].rows != m || C[i].cols != n)
+        {
+            return -1;
+        }
+    }
+
+    int mc, kc, nc;
+    split_shape(m, k, n, &mc, &kc, &nc);
+    threads = strassen_batch_threads(count, threads);
+
+    size_t mark = arena_mark(strassen_arena);
+    Strassen_scratch *scratch = (Strassen_scratch *)strassen_alloc(threads * sizeof(Strassen_scratch));
+    for (int t = 0; t < threads; t++)
+    {
+        strassen_scratch_init(&scratch[t], mc, kc, nc, cutoff);
+        scratch[t].variant = variant;
+    }
+
+    // A few chunks per worker so one that falls behind doesn't hold up the batch
+    int chunks = (threads > 1) ? 4 * threads : 1;
+    chunks = (chunks < count) ? chunks : count;
+    Batch_task *tasks = (Batch_task *)strassen_alloc(chunks * sizeof(Batch_task));
+
+    Thread_pool pool;
+    pool_init(&pool, threads);
+    atomic_int pending;
+    atomic_init(&pending, chunks);
+    for (int c = 0; c < chunks; c++)
+    {
+        int first = (int)((long long)count * c / chunks);
+        int last = (int)((long long)count * (c + 1) / chunks);
+        tasks[c] = (Batch_task){A, B, C, first, last - first, mc, kc, nc, scratch};
+        pool_spawn(&pool, strassen_batch_chunk, &tasks[c], &pending);
+    }
+    pool_wait(&pool, &pending);
+    pool_destroy(&pool);
+
+    strassen_free(tasks, chunks * sizeof(Batch_task));
+    for (int t = threads - 1; t >= 0; t--)
+    {
+        strassen_scratch_destroy(&scratch[t]);
+    }
+    strassen_free(scratch, threads * sizeof(Strassen_scratch));
+    arena_release(strassen_arena, mark);
+    return 0;
+}
+
+/**
+ * Arena bytes for strassen_multiply_batch, the k split's partial sums are per worker
+ */
+size_t strassen_batch_arena_size(int m, int k, int n, int count, int cutoff, int threads)
+{
+    int mc, kc, nc;
+    split_shape(m, k, n, &mc, &kc, &nc);
+    threads = strassen_batch_threads(count, threads);
+    int chunks = (threads > 1) ? 4 * threads : 1;
+    chunks = (chunks < count) ? chunks : count;
+
+    size_t partial = (kc < k) ? matrix_bytes(mc, nc) : 0;
+    return arena_round(threads * sizeof(Strassen_scratch)) + arena_round(chunks * sizeof(Batch_task)) +
+           threads * (strassen_scratch_bytes(mc, kc, nc, cutoff, 0) + partial);
+}
+
+double seconds_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Cutoff persisted by tuning mode, or fallback if there is none
+ */
+int strassen_load_cutoff(const char *path, int fallback)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return fallback;
+    }
+
+    int cutoff = 0;
+    if (fscanf(file, "cutoff %d", &cutoff) != 1 || cutoff <= 0)
+    {
+        cutoff = fallback;
+    }
+    fclose(file);
+    return cutoff;
+}
+
+/**
+ * Time the depth-first multiply on a size x size problem for every power of two cutoff from
+ * 16 up to size (size itself being pure classical), and persist the fastest one to path
+ * Each candidate keeps its best of a few runs so a single noisy run can't win or lose it
+ */
+int strassen_tune(int size, const char *path)
+{
+    const int repeats = 3;
+    Matrix A, B, C;
+    matrix_init(&A, size, size, 1);
+    matrix_init(&B, size, size, 1);
+    matrix_init(&C, size, size, 1);
+    for (int i = 0; i < size; i++)
+    {
+        for (int j = 0; j < size; j++)
+        {
+            MAT(A, i, j) = (i * 7 + j) % 101 - 50;
+            MAT(B, i, j) = (i + j * 3) % 97 - 48;
+        }
+    }
+
+    // The smallest cutoff recurses deepest, its arena fits every candidate
+    Strassen_arena arena;
+    arena_init(&arena, strassen_arena_size(size, size, size, 16, STRASSEN_CLASSIC, 1));
+    Strassen_arena *previous = arena_bind(&arena);
+
+    int best_cutoff = size;
+    double best_time = 0;
+    printf("cutoff,depth,seconds\n");
+    for (int cutoff = 16; cutoff <= size; cutoff *= 2)
+    {
+        double fastest = 0;
+        for (int r = 0; r < repeats; r++)
+        {
+            double start = seconds_now();
+            strassen_multiply(A, B, C, cutoff, STRASSEN_CLASSIC);
+            double elapsed = seconds_now() - start;
+            if (r == 0 || elapsed < fastest)
+            {
+                fastest = elapsed;
+            }
+        }
+
+        printf("%d,%d,%.6f\n", cutoff, strassen_depth(size, size, size, cutoff), fastest);
+        if (cutoff == 16 || fastest < best_time)
+        {
+            best_time = fastest;
+            best_cutoff = cutoff;
+        }
+    }
+
+    arena_bind(previous);
+    arena_destroy(&arena);
+    matrix_free(&A);
+    matrix_free(&B);
+    matrix_free(&C);
+
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error: cannot write %s\n", path);
+        return best_cutoff;
+    }
+    fprintf(file, "cutoff %d\n", best_cutoff);
+    fprintf(file, "# tuned on %dx%d, %.6f s\n", size, size, best_time);
+    fclose(file);
+    return best_cutoff;
+}
@@ -0,0 +1,181 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * Per-level counters for the Strassen stages
+ * partition, M_partition, compute_base, calculate_product and compute_result record the
+ * additions, multiplications, bytes moved, allocations and time of every call against the
+ * recursion level and stage it belongs to, so the summary shows which stage limits throughput
+ * at each level and how much buffering that level holds. The depth-first path records its
+ * operand sums, leaf products and C updates the same way through the profiled_ wrappers,
+ * its buffers are preallocated scratch so it records no allocations. The task-parallel upper
+ * levels are not counted, only the depth-first levels below them
+ * Bytes are the compulsory traffic of a call, each operand read once and each result written
+ * once, which is what a streaming implementation has to move. Counting is off unless a
+ * profile is bound, then it costs one clock read and a few atomic adds per call, never per
+ * element. Counters are atomic so the parallel path can share a profile
+ */
+
+#define PROFILE_LEVELS 32 // Deepest level recorded, deeper calls count against the last one
+
+typedef enum
+{
+    PROFILE_PARTITION, // Quadrant sums of the operands, M_partition and the nodes partition allocates
+    PROFILE_BASE,      // Classical products at the bottom level, compute_base or the leaf GEMMs
+    PROFILE_COMBINE,   // C quadrants from the seven Ms, calculate_product and compute_result
+    PROFILE_STAGES
+
+} Profile_stage;
+
+typedef struct
+{
+    atomic_uint_least64_t calls;
+    atomic_uint_least64_t adds;
+    atomic_uint_least64_t mults;
+    atomic_uint_least64_t bytes_read;
+    atomic_uint_least64_t bytes_written;
+    atomic_uint_least64_t allocations;
+    atomic_uint_least64_t alloc_bytes;
+    atomic_uint_least64_t nanoseconds;
+
+} Profile_counters;
+
+typedef struct
+{
+    Profile_counters stats[PROFILE_LEVELS][PROFILE_STAGES];
+
+} Strassen_profile;
+
+// Profile the stages record into, NULL when counting is off
+Strassen_profile *strassen_profile = NULL;
+
+static const char *const PROFILE_STAGE_NAMES[PROFILE_STAGES] = {"partition", "base", "combine"};
+
+void profile_init(Strassen_profile *profile)
+{
+    for (int level = 0; level < PROFILE_LEVELS; level++)
+    {
+        for (int stage = 0; stage < PROFILE_STAGES; stage++)
+        {
+            Profile_counters *counters = &profile->stats[level][stage];
+            atomic_init(&counters->calls, 0);
+            atomic_init(&counters->adds, 0);
+            atomic_init(&counters->mults, 0);
+            atomic_init(&counters->bytes_read, 0);
+            atomic_init(&counters->bytes_written, 0);
+            atomic_init(&counters->allocations, 0);
+            atomic_init(&counters->alloc_bytes, 0);
+            atomic_init(&counters->nanoseconds, 0);
+        }
+    }
+}
+
+/**
+ * Make profile the one the stages record into, returns the previous one
+ */
+Strassen_profile *profile_bind(Strassen_profile *profile)
+{
+    Strassen_profile *previous = strassen_profile;
+    strassen_profile = profile;
+    return previous;
+}
+
+/**
+ * Start of a timed call, 0 when no profile is bound so the clock is never read
+ */
+uint64_t profile_start(void)
+{
+    if (strassen_profile == NULL)
+    {
+        return 0;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+Profile_counters *profile_counters(int level, Profile_stage stage)
+{
+    if (level < 0)
+    {
+        level = 0;
+    }
+    if (level >= PROFILE_LEVELS)
+    {
+        level = PROFILE_LEVELS - 1;
+    }
+    return &strassen_profile->stats[level][stage];
+}
+
+/**
+ * One finished call, started is what profile_start returned for it
+ */
+void profile_record(int level, Profile_stage stage, uint64_t adds, uint64_t mults, uint64_t bytes_read, uint64_t bytes_written, uint64_t started)
+{
+    if (strassen_profile == NULL)
+    {
+        return;
+    }
+    Profile_counters *counters = profile_counters(level, stage);
+    atomic_fetch_add(&counters->calls, 1);
+    atomic_fetch_add(&counters->adds, adds);
+    atomic_fetch_add(&counters->mults, mults);
+    atomic_fetch_add(&counters->bytes_read, bytes_read);
+    atomic_fetch_add(&counters->bytes_written, bytes_written);
+    if (started != 0)
+    {
+        atomic_fetch_add(&counters->nanoseconds, profile_start() - started);
+    }
+}
+
+/**
+ * Buffers a stage allocated at a level, the ones it keeps until the level is combined
+ */
+void profile_alloc(int level, Profile_stage stage, uint64_t count, uint64_t bytes)
+{
+    if (strassen_profile == NULL)
+    {
+        return;
+    }
+    Profile_counters *counters = profile_counters(level, stage);
+    atomic_fetch_add(&counters->allocations, count);
+    atomic_fetch_add(&counters->alloc_bytes, bytes);
+}
+
+/**
+ * CSV summary, one row per level and stage that did any work, with the rates it achieved
+ */
+void profile_report(const Strassen_profile *profile, FILE *out)
+{
+    fprintf(out, "level,stage,calls,adds,mults,bytes_read,bytes_written,allocations,alloc_bytes,seconds,gops,gbytes_per_s\n");
+    for (int level = 0; level < PROFILE_LEVELS; level++)
+    {
+        for (int stage = 0; stage < PROFILE_STAGES; stage++)
+        {
+            const Profile_counters *counters = &profile->stats[level][stage];
+            uint64_t calls = atomic_load(&counters->calls);
+            uint64_t allocations = atomic_load(&counters->allocations);
+            if (calls == 0 && allocations == 0)
+            {
+                continue;
+            }
+
+            uint64_t ops = atomic_load(&counters->adds) + atomic_load(&counters->mults);
+            uint64_t bytes = atomic_load(&counters->bytes_read) + atomic_load(&counters->bytes_written);
+            double seconds = atomic_load(&counters->nanoseconds) * 1e-9;
+            fprintf(out, "%d,%s,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%.6f,%.3f,%.3f\n", level, PROFILE_STAGE_NAMES[stage],
+                    (unsigned long long)calls, (unsigned long long)atomic_load(&counters->adds),
+                    (unsigned long long)atomic_load(&counters->mults), (unsigned long long)atomic_load(&counters->bytes_read),
+                    (unsigned long long)atomic_load(&counters->bytes_written), (unsigned long long)allocations,
+                    (unsigned long long)atomic_load(&counters->alloc_bytes), seconds,
+                    (seconds > 0) ? ops / seconds * 1e-9 : 0.0, (seconds > 0) ? bytes / seconds * 1e-9 : 0.0);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,270 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * Work-stealing thread pool for fork/join task trees
+ * Every worker, the calling thread included as worker 0, owns a deque. Spawned tasks go on
+ * the spawner's deque, the owner pops the newest (depth-first, warm caches) and idle workers
+ * steal the oldest, which are the biggest pieces of work. A task that waits on its children
+ * keeps running queued tasks instead of blocking, so nested fork/join never deadlocks
+ * Deques are short (a handful of tasks per level) so each has a plain mutex
+ */
+
+typedef void (*Task_fn)(void *arg);
+
+typedef struct
+{
+    Task_fn fn;
+    void *arg;
+    atomic_int *pending; // Decremented once the task finishes
+
+} Task;
+
+typedef struct
+{
+    Task *items;
+    int head; // Thieves take from here
+    int tail; // Owner pushes and pops here
+    int capacity;
+    pthread_mutex_t lock;
+
+} Task_deque;
+
+typedef struct
+{
+    Task_deque *deques;
+    pthread_t *threads;
+    int num_threads;
+    atomic_int queued;  // Tasks sitting in any deque
+    atomic_int running; // Cleared to shut the workers down
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+
+} Thread_pool;
+
+typedef struct
+{
+    Thread_pool *pool;
+    int id;
+
+} Worker_arg;
+
+_Thread_local int current_worker = 0;
+
+int worker_id(void)
+{
+    return current_worker;
+}
+
+void deque_push(Task_deque *deque, Task task)
+{
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail == deque->capacity)
+    {
+        // Slide live tasks to the front, grow only if that isn't enough
+        int live = deque->tail - deque->head;
+        if (deque->head > 0)
+        {
+            for (int i = 0; i < live; i++)
+            {
+                deque->items[i] = deque->items[deque->head + i];
+            }
+            deque->head = 0;
+            deque->tail = live;
+        }
+        if (deque->tail == deque->capacity)
+        {
+            deque->capacity *= 2;
+            deque->items = (Task *)realloc(deque->items, deque->capacity * sizeof(Task));
+        }
+    }
+    deque->items[deque->tail++] = task;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+int deque_pop(Task_deque *deque, Task *task)
+{
+    int found = 0;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail > deque->head)
+    {
+        *task = deque->items[--deque->tail];
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+int deque_steal(Task_deque *deque, Task *task)
+{
+    int found = 0;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail > deque->head)
+    {
+        *task = deque->items[deque->head++];
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+/**
+ * Own deque first, then every other worker's in turn
+ */
+int pool_find_task(Thread_pool *pool, int self, Task *task)
+{
+    if (deque_pop(&pool->deques[self], task))
+    {
+        atomic_fetch_sub(&pool->queued, 1);
+        return 1;
+    }
+
+    for (int i = 1; i < pool->num_threads; i++)
+    {
+        int victim = (self + i) % pool->num_threads;
+        if (deque_steal(&pool->deques[victim], task))
+        {
+            atomic_fetch_sub(&pool->queued, 1);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void pool_run(Task task)
+{
+    task.fn(task.arg);
+    atomic_fetch_sub(task.pending, 1);
+}
+
+void *pool_worker(void *arg)
+{
+    Worker_arg *worker = (Worker_arg *)arg;
+    Thread_pool *pool = worker->pool;
+    current_worker = worker->id;
+
+    while (atomic_load(&pool->running))
+    {
+        Task task;
+        if (pool_find_task(pool, current_worker, &task))
+        {
+            pool_run(task);
+            continue;
+        }
+
+        // Nothing to steal, sleep until a spawn or a short timeout
+        pthread_mutex_lock(&pool->idle_lock);
+        if (atomic_load(&pool->queued) == 0 && atomic_load(&pool->running))
+        {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += 1000000;
+            if (until.tv_nsec >= 1000000000)
+            {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&pool->idle_cond, &pool->idle_lock, &until);
+        }
+        pthread_mutex_unlock(&pool->idle_lock);
+    }
+
+    free(worker);
+    return NULL;
+}
+
+/**
+ * Start num_threads - 1 workers, the calling thread becomes worker 0
+ */
+void pool_init(Thread_pool *pool, int num_threads)
+{
+    pool->num_threads = (num_threads > 0) ? num_threads : 1;
+    pool->deques = (Task_deque *)malloc(pool->num_threads * sizeof(Task_deque));
+    pool->threads = (pthread_t *)malloc(pool->num_threads * sizeof(pthread_t));
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->running, 1);
+    pthread_mutex_init(&pool->idle_lock, NULL);
+    pthread_cond_init(&pool->idle_cond, NULL);
+
+    for (int i = 0; i < pool->num_threads; i++)
+    {
+        pool->deques[i].capacity = 64;
+        pool->deques[i].items = (Task *)malloc(pool->deques[i].capacity * sizeof(Task));
+        pool->deques[i].head = 0;
+        pool->deques[i].tail = 0;
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+    }
+
+    current_worker = 0;
+    for (int i = 1; i < pool->num_threads; i++)
+    {
+        Worker_arg *worker = (Worker_arg *)malloc(sizeof(Worker_arg));
+        worker->pool = pool;
+        worker->id = i;
+        pthread_create(&pool->threads[i], NULL, pool_worker, worker);
+    }
+}
+
+void pool_destroy(Thread_pool *pool)
+{
+    atomic_store(&pool->running, 0);
+    pthread_mutex_lock(&pool->idle_lock);
+    pthread_cond_broadcast(&pool->idle_cond);
+    pthread_mutex_unlock(&pool->idle_lock);
+
+    for (int i = 1; i < pool->num_threads; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (int i = 0; i < pool->num_threads; i++)
+    {
+        free(pool->deques[i].items);
+        pthread_mutex_destroy(&pool->deques[i].lock);
+    }
+    pthread_mutex_destroy(&pool->idle_lock);
+    pthread_cond_destroy(&pool->idle_cond);
+    free(pool->deques);
+    free(pool->threads);
+}
+
+/**
+ * Queue fn(arg) on the calling worker's deque, pending is decremented when it finishes
+ * The caller increments pending (once per task) before spawning
+ */
+void pool_spawn(Thread_pool *pool, Task_fn fn, void *arg, atomic_int *pending)
+{
+    Task task = {fn, arg, pending};
+    deque_push(&pool->deques[worker_id()], task);
+    atomic_fetch_add(&pool->queued, 1);
+
+    pthread_mutex_lock(&pool->idle_lock);
+    pthread_cond_signal(&pool->idle_cond);
+    pthread_mutex_unlock(&pool->idle_lock);
+}
+
+/**
+ * Run queued tasks, own or stolen, until pending drops to zero
+ */
+void pool_wait(Thread_pool *pool, atomic_int *pending)
+{
+    while (atomic_load(pending) > 0)
+    {
+        Task task;
+        if (pool_find_task(pool, worker_id(), &task))
+        {
+            pool_run(task);
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+}
+
+#endif
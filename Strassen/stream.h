@@ -0,0 +1,186 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Tile sources for streaming matrix input
+ * A source hands out any rows x cols tile of a matrix straight into the caller's storage, so an
+ * operand is built in place with no staging copy of the whole thing. The caller chooses the
+ * order tiles are pulled in, which is what lets the top-level quadrant sums start on the
+ * first rows while later ones are still being read
+ *
+ * Matrix files are a Matrix_file_header followed by rows * cols native int32 values, row-major
+ */
+
+#define STREAM_TILE 128 // Rows and columns of the tiles pulled from a source
+
+/**
+ * Copy the tile at (row, col) of the source to dst, consecutive rows ld ints apart
+ * Returns 0, or nonzero if the tile cannot be produced
+ */
+typedef int (*Tile_read)(void *ctx, int row, int col, int rows, int cols, int *dst, int ld);
+
+typedef struct
+{
+    Tile_read read;
+    void *ctx;
+    int rows;
+    int cols;
+
+} Tile_source;
+
+typedef struct
+{
+    char magic[8];
+    int32_t rows;
+    int32_t cols;
+
+} Matrix_file_header;
+
+static const char MATRIX_FILE_MAGIC[8] = {'S', 'T', 'R', 'A', 'S', 'M', 'A', 'T'};
+
+typedef struct
+{
+    int fd;
+    const char *map; // Whole file, header included
+    size_t size;
+    const int *values;
+    int rows;
+    int cols;
+
+} Mapped_matrix;
+
+/**
+ * Read all rows x cols of a source into dst, one tile at a time starting at row0
+ */
+int tile_source_load(Tile_source *source, int row0, int rows, int *dst, int ld)
+{
+    for (int i = 0; i < rows; i += STREAM_TILE)
+    {
+        int tile_rows = (rows - i < STREAM_TILE) ? rows - i : STREAM_TILE;
+        for (int j = 0; j < source->cols; j += STREAM_TILE)
+        {
+            int tile_cols = (source->cols - j < STREAM_TILE) ? source->cols - j : STREAM_TILE;
+            if (source->read(source->ctx, row0 + i, j, tile_rows, tile_cols, dst + (size_t)i * ld + j, ld) != 0)
+            {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int mapped_matrix_read(void *ctx, int row, int col, int rows, int cols, int *dst, int ld)
+{
+    const Mapped_matrix *file = (const Mapped_matrix *)ctx;
+    if (row < 0 || col < 0 || row + rows > file->rows || col + cols > file->cols)
+    {
+        return -1;
+    }
+    for (int i = 0; i < rows; i++)
+    {
+        memcpy(dst + (size_t)i * ld, file->values + (size_t)(row + i) * file->cols + col, cols * sizeof(int));
+    }
+    return 0;
+}
+
+/**
+ * Map a matrix file read-only, pages are only read in as tiles touch them
+ * Returns 0, or -1 if the file cannot be mapped or is not a matrix file
+ */
+int mapped_matrix_open(Mapped_matrix *file, const char *path)
+{
+    file->map = NULL;
+    file->fd = open(path, O_RDONLY);
+    if (file->fd < 0)
+    {
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(file->fd, &info) != 0 || (size_t)info.st_size < sizeof(Matrix_file_header))
+    {
+        close(file->fd);
+        return -1;
+    }
+    file->size = (size_t)info.st_size;
+
+    void *mapped = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, file->fd, 0);
+    if (mapped == MAP_FAILED)
+    {
+        close(file->fd);
+        return -1;
+    }
+    file->map = (const char *)mapped;
+
+    Matrix_file_header header;
+    memcpy(&header, file->map, sizeof(header));
+    size_t expected = sizeof(header) + (size_t)header.rows * header.cols * sizeof(int);
+    if (memcmp(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic)) != 0 || header.rows <= 0 || header.cols <= 0 || file->size < expected)
+    {
+        munmap(mapped, file->size);
+        close(file->fd);
+        file->map = NULL;
+        return -1;
+    }
+    file->rows = header.rows;
+    file->cols = header.cols;
+    file->values = (const int *)(file->map + sizeof(header));
+    return 0;
+}
+
+void mapped_matrix_close(Mapped_matrix *file)
+{
+    if (file->map != NULL)
+    {
+        munmap((void *)file->map, file->size);
+        close(file->fd);
+        file->map = NULL;
+    }
+}
+
+Tile_source mapped_matrix_source(Mapped_matrix *file)
+{
+    Tile_source source = {mapped_matrix_read, file, file->rows, file->cols};
+    return source;
+}
+
+/**
+ * Write a matrix file from any source, one tile row band at a time
+ * Returns 0, or -1 on a write or source error
+ */
+int matrix_file_write(const char *path, Tile_source *source)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        return -1;
+    }
+
+    Matrix_file_header header;
+    memcpy(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic));
+    header.rows = source->rows;
+    header.cols = source->cols;
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    int *band = (int *)malloc((size_t)STREAM_TILE * source->cols * sizeof(int));
+    for (int i = 0; ok && band != NULL && i < source->rows; i += STREAM_TILE)
+    {
+        int rows = (source->rows - i < STREAM_TILE) ? source->rows - i : STREAM_TILE;
+        ok = tile_source_load(source, i, rows, band, source->cols) == 0 &&
+             fwrite(band, sizeof(int), (size_t)rows * source->cols, file) == (size_t)rows * source->cols;
+    }
+    ok = ok && band != NULL;
+
+    free(band);
+    return (fclose(file) == 0 && ok) ? 0 : -1;
+}
+
+#endif